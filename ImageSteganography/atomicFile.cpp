@@ -0,0 +1,226 @@
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "atomicFile.hpp"
+#include "helpFunctions.hpp"
+#include "stegStats.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#endif
+
+// Attempts at finding an unused temporary name before giving up
+static constexpr int maxNameAttempts = 16;
+
+// ".<target name>.<pid>-<n>.tmp.<source extension>" next to the target, so the image type still
+// follows from the extension
+static std::string temporaryName(const std::string& target, const std::string& sourcePath) {
+    static std::atomic<unsigned> counter{0};
+#ifdef _WIN32
+    const unsigned long processId = GetCurrentProcessId();
+#else
+    const long processId = static_cast<long>(getpid());
+#endif
+    const size_t nameStart = target.find_last_of("/\\");
+    const std::string directory = nameStart == std::string::npos ? "" : target.substr(0, nameStart + 1);
+    const std::string name = nameStart == std::string::npos ? target : target.substr(nameStart + 1);
+    return directory + "." + name + "." + std::to_string(processId) + "-" + std::to_string(counter++) + ".tmp."
+           + getFileExtension(sourcePath);
+}
+
+#ifndef _WIN32
+static bool writeAll(const int file, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = ::write(file, data, size);
+        STEG_COUNT(SYSCALLS, 1);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        STEG_COUNT(BYTES_WRITTEN, written);
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+// Copies everything from the current offset of source on
+static bool copyContents(const int source, const int destination, const off_t size) {
+#ifdef __linux__
+#ifdef FICLONE
+    // Shares all blocks with the source, the embed later only unshares the blocks it writes to
+    STEG_COUNT(SYSCALLS, 1);
+    if (ioctl(destination, FICLONE, source) == 0) {
+        return true;
+    }
+#endif
+    off_t copied = 0;
+    while (copied < size) {
+        const ssize_t chunk = copy_file_range(source, nullptr, destination, nullptr, static_cast<size_t>(size - copied), 0);
+        STEG_COUNT(SYSCALLS, 1);
+        if (chunk < 0 && errno == EINTR) continue;
+        if (chunk <= 0) break;
+        STEG_COUNT(BYTES_WRITTEN, chunk);
+        copied += chunk;
+    }
+    if (copied == size) {
+        return true;
+    }
+    // Not supported between these file systems: both offsets are at copied, go on with plain reads
+#else
+    (void)size;
+#endif
+    std::vector<char> buffer(1024 * 1024);
+    while (true) {
+        const ssize_t got = ::read(source, buffer.data(), buffer.size());
+        STEG_COUNT(SYSCALLS, 1);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return false;
+        if (got == 0) return true;
+        STEG_COUNT(BYTES_READ, got);
+        if (!writeAll(destination, buffer.data(), static_cast<size_t>(got))) return false;
+    }
+}
+#endif
+
+atomicFile::~atomicFile() {
+    discard();
+}
+atomicFile::atomicFile(atomicFile&& other) noexcept
+    : targetPath(std::move(other.targetPath)), temporaryPath(std::move(other.temporaryPath)) {
+    other.temporaryPath.clear();
+}
+atomicFile& atomicFile::operator=(atomicFile&& other) noexcept {
+    if (this != &other) {
+        discard();
+        targetPath = std::move(other.targetPath);
+        temporaryPath = std::move(other.temporaryPath);
+        other.temporaryPath.clear();
+    }
+    return *this;
+}
+
+stegStatus atomicFile::createCopy(const std::string& sourcePath, const std::string& target) {
+    discard();
+    targetPath = target;
+#ifdef _WIN32
+    // CopyFile clones the blocks itself on file systems that support it (ReFS)
+    for (int attempt = 0; attempt < maxNameAttempts; ++attempt) {
+        const std::string name = temporaryName(target, sourcePath);
+        if (CopyFileA(sourcePath.c_str(), name.c_str(), TRUE)) {
+            temporaryPath = name;
+            return {};
+        }
+        const DWORD error = GetLastError();
+        if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND || error == ERROR_ACCESS_DENIED) {
+            return {stegError::CANT_OPEN_FILE, "File can't be copied (" + sourcePath + ")."};
+        }
+        if (error != ERROR_FILE_EXISTS && error != ERROR_ALREADY_EXISTS) {
+            break;
+        }
+    }
+    return {stegError::WRITE_FAILED, "Temporary file can't be created next to " + target + "."};
+#else
+    // open and fstat of the source, open, fchmod and both closes
+    STEG_COUNT(SYSCALLS, 6);
+    const int source = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    struct stat sourceStat {};
+    if (fstat(source, &sourceStat) != 0 || !S_ISREG(sourceStat.st_mode)) {
+        ::close(source);
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    int destination = -1;
+    for (int attempt = 0; attempt < maxNameAttempts && destination < 0; ++attempt) {
+        temporaryPath = temporaryName(target, sourcePath);
+        destination = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (destination < 0 && errno != EEXIST) break;
+    }
+    if (destination < 0) {
+        temporaryPath.clear();
+        ::close(source);
+        return {stegError::WRITE_FAILED, "Temporary file can't be created next to " + target + "."};
+    }
+    const bool copied = copyContents(source, destination, sourceStat.st_size);
+    // The replacement gets the permissions of the file it is made from
+    const bool finished = fchmod(destination, sourceStat.st_mode & 07777) == 0 && copied;
+    ::close(source);
+    if (::close(destination) != 0 || !finished) {
+        discard();
+        return {stegError::WRITE_FAILED, "Image can't be copied to a temporary file next to " + target + "."};
+    }
+    return {};
+#endif
+}
+stegStatus atomicFile::sync() const {
+    STEG_PHASE(FINAL_WRITE);
+    // open, flush and close
+    STEG_COUNT(SYSCALLS, 3);
+#ifdef _WIN32
+    HANDLE file = CreateFileA(temporaryPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    const bool flushed = file != INVALID_HANDLE_VALUE && FlushFileBuffers(file);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    const int file = ::open(temporaryPath.c_str(), O_RDWR | O_CLOEXEC);
+    const bool flushed = file >= 0 && fsync(file) == 0;
+    if (file >= 0) ::close(file);
+#endif
+    if (!flushed) {
+        return {stegError::WRITE_FAILED, "Temporary file can't be flushed to disk (" + temporaryPath + ")."};
+    }
+    return {};
+}
+stegStatus atomicFile::commit() {
+    STEG_PHASE(FINAL_WRITE);
+    STEG_COUNT(SYSCALLS, 1);
+#ifdef _WIN32
+    const bool renamed = MoveFileExA(temporaryPath.c_str(), targetPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    const bool renamed = std::rename(temporaryPath.c_str(), targetPath.c_str()) == 0;
+#endif
+    if (!renamed) {
+        return {stegError::WRITE_FAILED, "Output can't be moved into place (" + targetPath + ")."};
+    }
+    temporaryPath.clear();
+    return {};
+}
+void atomicFile::discard() {
+    if (!temporaryPath.empty()) {
+        std::remove(temporaryPath.c_str());
+        temporaryPath.clear();
+    }
+}
+
+std::string parentDirectory(const std::string& path) {
+    const size_t nameStart = path.find_last_of("/\\");
+    if (nameStart == std::string::npos) return ".";
+    if (nameStart == 0) return path.substr(0, 1);
+    return path.substr(0, nameStart);
+}
+stegStatus syncDirectory(const std::string& directory) {
+#ifdef _WIN32
+    // MoveFileEx with MOVEFILE_WRITE_THROUGH already returns after the rename is on disk
+    (void)directory;
+#else
+    STEG_PHASE(FINAL_WRITE);
+    STEG_COUNT(SYSCALLS, 3);
+    const int file = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    const bool flushed = file >= 0 && fsync(file) == 0;
+    if (file >= 0) ::close(file);
+    if (!flushed) {
+        return {stegError::WRITE_FAILED, "Directory can't be flushed to disk (" + directory + ")."};
+    }
+#endif
+    return {};
+}
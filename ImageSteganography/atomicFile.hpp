@@ -0,0 +1,42 @@
+#ifndef ATOMICFILE_HPP
+#define ATOMICFILE_HPP
+#include <string>
+#include "stegStatus.hpp"
+
+// Replaces a file as a whole: the new contents are prepared in a temporary file in the target's
+// directory, which is renamed over the target once complete, so readers and crashes only ever
+// see the old file or the new one. Call sync() before commit() and syncDirectory() after it
+// for the replacement to survive a power loss too.
+struct atomicFile {
+private:
+    std::string targetPath;
+    std::string temporaryPath;
+public:
+    atomicFile() = default;
+    // Removes the temporary file unless it was committed
+    ~atomicFile();
+    atomicFile(const atomicFile&) = delete;
+    atomicFile& operator=(const atomicFile&) = delete;
+    atomicFile(atomicFile&& other) noexcept;
+    atomicFile& operator=(atomicFile&& other) noexcept;
+
+    // Starts the temporary file as a copy of sourcePath, which may be the target itself. The copy
+    // shares its blocks with the source where the file system can (reflink) and is made inside
+    // the kernel otherwise (copy_file_range), so the image data never passes through this process.
+    // The temporary file keeps the extension of sourcePath.
+    stegStatus createCopy(const std::string& sourcePath, const std::string& target);
+    const std::string& path() const { return temporaryPath; }
+    const std::string& target() const { return targetPath; }
+    // Flushes the temporary file to the disk
+    stegStatus sync() const;
+    // Renames the temporary file over the target
+    stegStatus commit();
+    void discard();
+};
+
+// Directory part of a path, "." for a bare file name
+std::string parentDirectory(const std::string& path);
+// Flushes the entries of a directory (e.g. a rename into it) to the disk
+stegStatus syncDirectory(const std::string& directory);
+
+#endif //ATOMICFILE_HPP
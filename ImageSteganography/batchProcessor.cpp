@@ -0,0 +1,256 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <semaphore>
+#include <cstdio>
+#include <set>
+#include <filesystem>
+#include "batchProcessor.hpp"
+#include "steganography.hpp"
+#include "atomicFile.hpp"
+#include "threadPool.hpp"
+#include "lsbAnalysis.hpp"
+#include "bulkPipeline.hpp"
+
+// Manifest lines are processed in chunks so memory stays bounded for endless manifests
+static constexpr size_t manifestChunkSize = 4096;
+
+// Key that names an image the same however the manifest spells its path ("a.bmp", "./a.bmp",
+// "dir/../a.bmp"); paths that can't be resolved are kept as written
+static std::string imageKey(const std::string& filePath) {
+    std::error_code error;
+    const std::filesystem::path resolved = std::filesystem::weakly_canonical(filePath, error);
+    return error ? filePath : resolved.string();
+}
+
+struct batchItem {
+    size_t lineNumber;
+    std::string filePath;
+    std::string message;
+    bool embed;
+    stegStatus status;
+    size_t payloadBytes = 0;
+    std::string extracted;
+    std::chrono::microseconds elapsed{0};
+    atomicFile output;      // the copy being embedded into, with atomic writes
+};
+
+// Keeps the result line tab separated and on a single line
+static std::string escapeField(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c : text) {
+        switch (c) {
+            case '\\': escaped += "\\\\"; break;
+            case '\t': escaped += "\\t"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20 || c == 0x7f) {
+                    char hex[5];
+                    std::snprintf(hex, sizeof(hex), "\\x%02x", static_cast<unsigned char>(c));
+                    escaped += hex;
+                } else {
+                    escaped.push_back(c);
+                }
+        }
+    }
+    return escaped;
+}
+
+static void processItem(batchItem& item, const stegOptions& options, const bool atomicWrites) {
+    const auto start = std::chrono::steady_clock::now();
+    if (item.embed && atomicWrites) {
+        item.status = item.output.createCopy(item.filePath, item.filePath);
+        if (item.status) {
+            item.status = embedInImageFile(item.output.path(), asBytes(item.message), options).status;
+        }
+        item.payloadBytes = item.message.size();
+    } else if (item.embed) {
+        item.status = embedInImageFile(item.filePath, asBytes(item.message), options).status;
+        item.payloadBytes = item.message.size();
+    } else {
+        const extractResult result = extractFromImageFile(item.filePath, options);
+        item.status = result.status;
+        item.extracted = asText(result.payload);
+        item.payloadBytes = item.extracted.size();
+    }
+    if (!item.status) {
+        item.output.discard();
+    }
+    item.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+// Flushes the copies of a chunk, renames them over the images and flushes their directories once
+static void commitOutputs(std::vector<batchItem>& items, threadPool& pool) {
+    // All flushes are in flight at once, which lets the file system merge them into few journal commits
+    pool.parallelFor(items.size(), [&](const size_t i) {
+        if (!items[i].output.path().empty()) {
+            items[i].status = items[i].output.sync();
+        }
+    });
+    std::set<std::string> directories;
+    for (batchItem& item : items) {
+        if (item.output.path().empty()) continue;
+        if (item.status) item.status = item.output.commit();
+        if (item.status) directories.insert(parentDirectory(item.filePath));
+        item.output.discard();
+    }
+    for (const std::string& directory : directories) {
+        if (const stegStatus status = syncDirectory(directory); !status) {
+            for (batchItem& item : items) {
+                if (item.status && item.embed && parentDirectory(item.filePath) == directory) item.status = status;
+            }
+        }
+    }
+}
+static std::string resultLine(const batchItem& item) {
+    const bool succeeded = item.status.ok();
+    std::string line = std::to_string(item.lineNumber) + '\t' + (succeeded ? "ok" : "error") + '\t'
+                     + (item.embed ? "embed" : "extract") + '\t' + escapeField(item.filePath) + '\t'
+                     + std::to_string(succeeded ? item.payloadBytes : 0) + '\t' + std::to_string(item.elapsed.count());
+    if (succeeded && !item.embed) {
+        line += '\t' + escapeField(item.extracted);
+    }
+    return line;
+}
+
+// The same with every image of the chunk going through the queue of processBulk at once
+static void processQueued(std::vector<batchItem>& items, const stegOptions& options, const bool atomicWrites,
+                          const ioBackend backend, const unsigned maxOpenFiles, threadPool& pool) {
+#ifndef _WIN32
+    std::vector<bulkJob> jobs(items.size());
+    if (atomicWrites) {
+        pool.parallelFor(items.size(), [&](const size_t i) {
+            if (items[i].embed) items[i].status = items[i].output.createCopy(items[i].filePath, items[i].filePath);
+        });
+    }
+    for (size_t i = 0; i < items.size(); ++i) {
+        jobs[i].filePath = items[i].embed && atomicWrites ? items[i].output.path() : items[i].filePath;
+        jobs[i].embed = items[i].embed;
+        jobs[i].payload = items[i].message;
+        // A copy that couldn't be made leaves nothing to process
+        if (!items[i].status) jobs[i].filePath.clear();
+    }
+    processBulk(jobs, options, backend, maxOpenFiles);
+    for (size_t i = 0; i < items.size(); ++i) {
+        batchItem& item = items[i];
+        if (item.status) item.status = std::move(jobs[i].status);
+        item.payloadBytes = item.embed ? item.message.size() : jobs[i].payload.size();
+        if (!item.embed) item.extracted = std::move(jobs[i].payload);
+        item.elapsed = jobs[i].elapsed;
+        if (!item.status) item.output.discard();
+    }
+#else
+    (void)items, (void)options, (void)atomicWrites, (void)backend, (void)maxOpenFiles, (void)pool;
+#endif
+}
+
+size_t runBatch(std::istream& manifest, std::ostream& results, const unsigned maxOpenFiles, const stegOptions& options,
+                const bool atomicWrites, const ioBackend backend) {
+    threadPool& pool = globalThreadPool();
+    std::counting_semaphore<> openFiles(std::max(1u, maxOpenFiles));
+    std::vector<batchItem> items;
+    items.reserve(manifestChunkSize);
+    size_t lineNumber = 0;
+    size_t failures = 0;
+    std::string line;
+
+    // Images embedded into in the current chunk, and without atomic writes (where embeds change
+    // the images in place while other items of the chunk run) every image of the chunk, by imageKey
+    std::set<std::string> embeddedPaths;
+    std::set<std::string> chunkPaths;
+
+    auto flushChunk = [&] {
+        if (backend == ioBackend::MAPPED) {
+            pool.parallelFor(items.size(), [&](const size_t i) {
+                openFiles.acquire();
+                processItem(items[i], options, atomicWrites);
+                openFiles.release();
+            });
+        } else {
+            processQueued(items, options, atomicWrites, backend, maxOpenFiles, pool);
+        }
+        if (atomicWrites) {
+            commitOutputs(items, pool);
+        }
+        for (const batchItem& item : items) {
+            if (!item.status) {
+                std::cerr << "Error: " << item.filePath << ": " << item.status.detail << std::endl;
+                ++failures;
+            }
+            results << resultLine(item) << '\n';
+        }
+        results.flush();
+        items.clear();
+        embeddedPaths.clear();
+        chunkPaths.clear();
+    };
+
+    while (std::getline(manifest, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+
+        batchItem item;
+        item.lineNumber = lineNumber;
+        const size_t separator = line.find('\t');
+        item.embed = separator != std::string::npos;
+        item.filePath = line.substr(0, separator);
+        if (item.embed) item.message = line.substr(separator + 1);
+        // A later line for the same image has to see the embedded one, and an embed in place must
+        // not run next to another item on its image
+        const std::string key = imageKey(item.filePath);
+        if (embeddedPaths.contains(key) || (!atomicWrites && item.embed && chunkPaths.contains(key))) flushChunk();
+        if (item.embed) embeddedPaths.insert(key);
+        if (!atomicWrites) chunkPaths.insert(key);
+        items.push_back(std::move(item));
+        if (items.size() == manifestChunkSize) flushChunk();
+    }
+    flushChunk();
+    return failures;
+}
+
+size_t runAnalysis(std::istream& paths, std::ostream& results, const unsigned maxOpenFiles) {
+    threadPool& pool = globalThreadPool();
+    std::counting_semaphore<> openFiles(std::max(1u, maxOpenFiles));
+    std::vector<std::string> chunk;
+    std::vector<analysisResult> analyses;
+    chunk.reserve(manifestChunkSize);
+    size_t failures = 0;
+    std::string path;
+
+    auto flushChunk = [&] {
+        analyses.assign(chunk.size(), analysisResult());
+        pool.parallelFor(chunk.size(), [&](const size_t i) {
+            openFiles.acquire();
+            analyses[i] = analyzeImageFile(chunk[i]);
+            openFiles.release();
+        });
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            const analysisResult& analysis = analyses[i];
+            if (!analysis.status) {
+                std::cerr << "Error: " << chunk[i] << ": " << analysis.status.detail << std::endl;
+                results << escapeField(chunk[i]) << "\terror\n";
+                ++failures;
+                continue;
+            }
+            char line[128];
+            std::snprintf(line, sizeof(line), "\tok\t%.4f\t%.4f\t%.4f\t%.4f\n", analysis.score, analysis.overall.chiSquareP,
+                          analysis.overall.rsEstimate, analysis.sequentialShare);
+            results << escapeField(chunk[i]) << line;
+        }
+        results.flush();
+        chunk.clear();
+    };
+
+    while (std::getline(paths, path)) {
+        if (!path.empty() && path.back() == '\r') path.pop_back();
+        if (path.empty()) continue;
+        chunk.push_back(std::move(path));
+        if (chunk.size() == manifestChunkSize) flushChunk();
+    }
+    flushChunk();
+    return failures;
+}
@@ -0,0 +1,33 @@
+#ifndef BATCHPROCESSOR_HPP
+#define BATCHPROCESSOR_HPP
+#include <iosfwd>
+#include <cstddef>
+#include "ioQueue.hpp"
+
+struct stegOptions;
+
+// Processes a manifest with one item per line:
+//   <path><TAB><message>   embeds the message into the image
+//   <path>                 extracts the message from the image
+// Items run concurrently on the global thread pool with at most maxOpenFiles images open
+// at once, all items with the same options (extraction only uses the key). Items for an image
+// that one of them embeds into see each other's changes in manifest order. Every item prints one
+// tab separated result line:
+//   <line> <ok|error> <embed|extract> <path> <payload bytes> <elapsed us> [<extracted message>]
+// With atomicWrites every embed goes to a copy of the image that replaces it in one rename
+// (atomicFile.hpp). The copies of a chunk of items are flushed to disk together, followed by one
+// flush per directory, instead of a flush per image.
+// backend IO_URING or THREADS queues the reads and writes of all images of a chunk at once
+// (bulkPipeline.hpp) instead of mapping every image on a thread of its own.
+// Returns the number of failed items.
+size_t runBatch(std::istream& manifest, std::ostream& results, unsigned maxOpenFiles, const stegOptions& options,
+                bool atomicWrites = false, ioBackend backend = ioBackend::MAPPED);
+
+// Runs the steganalysis of lsbAnalysis.hpp on every image listed in paths, one path per line,
+// concurrently with at most maxOpenFiles images open at once. Every image prints one tab
+// separated result line in the order listed:
+//   <path> <ok|error> <score> <chi-square p> <RS estimate> <sequential share>
+// Returns the number of images that couldn't be analyzed.
+size_t runAnalysis(std::istream& paths, std::ostream& results, unsigned maxOpenFiles);
+
+#endif //BATCHPROCESSOR_HPP
@@ -0,0 +1,401 @@
+// steg_bench: generates synthetic carriers and times header parsing, the capacity check,
+// embedding and extraction on them. Prints a table and optionally writes JSON so runs
+// can be compared over time.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <span>
+#include "syntheticImage.hpp"
+#include "../bmpProcessor.hpp"
+#include "../ppmProcessor.hpp"
+#include "../lsbKernels.hpp"
+#include "../payloadFrame.hpp"
+#include "../threadPool.hpp"
+#include "../lsbAnalysis.hpp"
+#include "../shardedPayload.hpp"
+
+static const std::string benchKey = "steg_bench";
+// Headers handed to queryCapacity in one call
+static constexpr size_t capacityQueryBatch = 1024;
+// Carriers a sharded payload is split over, handled one at a time (maxOpenFiles 1)
+static constexpr size_t shardCarriers = 4;
+
+struct benchOptions {
+    std::vector<double> megapixels = {0.1, 1, 10};
+    std::vector<syntheticFormat> formats = {syntheticFormat::BMP, syntheticFormat::BMP32, syntheticFormat::P6, syntheticFormat::P6_16, syntheticFormat::P3};
+    // 0 stands for the full capacity of the image
+    std::vector<size_t> payloadSizes = {16, 4096, 1024 * 1024, 0};
+    std::vector<unsigned> bitsPerChannel = {1};
+    double minTime = 0.5;
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "steg_bench";
+    std::string jsonPath;
+    bool keepImages = false;
+};
+
+struct benchResult {
+    std::string name;
+    std::string operation;
+    syntheticFormat format;
+    double megapixels;
+    size_t payloadBytes;
+    unsigned bitsPerChannel;
+    size_t iterations;
+    double nanosecondsPerOperation;
+    // Carrier bytes touched by one operation, 0 when throughput doesn't apply
+    size_t bytesPerOperation;
+    size_t bitsPerOperation;
+
+    double megabytesPerSecond() const {
+        return bytesPerOperation == 0 ? 0 : bytesPerOperation / nanosecondsPerOperation * 1e3;
+    }
+    double nanosecondsPerBit() const {
+        return bitsPerOperation == 0 ? 0 : nanosecondsPerOperation / bitsPerOperation;
+    }
+};
+
+static void printUsage() {
+    std::cout << "Usage: steg_bench [options]\n"
+              << "  --sizes LIST       Image sizes in megapixels (default: 0.1,1,10, up to 500)\n"
+              << "  --formats LIST     Any of bmp,bmp32,p6,p6_16,p3 (default: all)\n"
+              << "  --payloads LIST    Payload sizes in bytes, \"full\" for the whole capacity\n"
+              << "                     (default: 16,4096,1048576,full)\n"
+              << "  --bits-per-channel LIST\n"
+              << "                     Payload bits per color channel, 1 to 4; P3 only runs with 1 (default: 1)\n"
+              << "  --min-time S       Minimum measuring time per benchmark in seconds (default: 0.5)\n"
+              << "  --threads N        Threads used by embed/extract (default: all cores)\n"
+              << "  --dir PATH         Where the synthetic images are written (default: temp directory)\n"
+              << "  --keep             Keep the synthetic images afterwards\n"
+              << "  --json FILE        Also write the results as JSON\n";
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static bool parseOptions(const std::vector<std::string>& args, benchOptions& options) {
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string& flag = args[i];
+            if (flag == "--keep") {
+                options.keepImages = true;
+                continue;
+            }
+            if (i + 1 >= args.size()) {
+                return false;
+            }
+            const std::string& value = args[++i];
+            if (flag == "--sizes") {
+                options.megapixels.clear();
+                for (const std::string& item : splitList(value)) {
+                    const double megapixels = std::stod(item);
+                    if (megapixels <= 0 || megapixels > 500) throw std::out_of_range(item);
+                    options.megapixels.push_back(megapixels);
+                }
+            } else if (flag == "--formats") {
+                options.formats.clear();
+                for (const std::string& item : splitList(value)) {
+                    if (item == "bmp") options.formats.push_back(syntheticFormat::BMP);
+                    else if (item == "bmp32") options.formats.push_back(syntheticFormat::BMP32);
+                    else if (item == "p6") options.formats.push_back(syntheticFormat::P6);
+                    else if (item == "p6_16") options.formats.push_back(syntheticFormat::P6_16);
+                    else if (item == "p3") options.formats.push_back(syntheticFormat::P3);
+                    else throw std::invalid_argument(item);
+                }
+            } else if (flag == "--payloads") {
+                options.payloadSizes.clear();
+                for (const std::string& item : splitList(value)) {
+                    options.payloadSizes.push_back(item == "full" ? 0 : std::stoull(item));
+                }
+            } else if (flag == "--bits-per-channel") {
+                options.bitsPerChannel.clear();
+                for (const std::string& item : splitList(value)) {
+                    const unsigned bits = static_cast<unsigned>(std::stoul(item));
+                    if (bits < 1 || bits > maxBitsPerChannel) throw std::out_of_range(item);
+                    options.bitsPerChannel.push_back(bits);
+                }
+            } else if (flag == "--min-time") {
+                options.minTime = std::stod(value);
+            } else if (flag == "--threads") {
+                setThreadCount(static_cast<unsigned>(std::stoul(value)));
+            } else if (flag == "--dir") {
+                options.directory = value;
+            } else if (flag == "--json") {
+                options.jsonPath = value;
+            } else {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Error: Invalid option value." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Repeats operation until minTime has passed (after one warm-up run), like Google Benchmark
+static bool measure(const std::function<bool()>& operation, const double minTime, size_t& iterations, double& nanoseconds) {
+    if (!operation()) {
+        return false;
+    }
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const auto deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(minTime));
+    iterations = 0;
+    auto now = start;
+    do {
+        if (!operation()) {
+            return false;
+        }
+        ++iterations;
+        now = clock::now();
+    } while (now < deadline);
+    nanoseconds = std::chrono::duration<double, std::nano>(now - start).count() / static_cast<double>(iterations);
+    return true;
+}
+
+// Printable noise, so the payload looks like a typical text message
+static std::string makeMessage(const size_t size) {
+    std::string message(size, ' ');
+    uint32_t state = 0x12345678;
+    for (char& c : message) {
+        state = state * 1664525u + 1013904223u;
+        c = static_cast<char>('!' + (state >> 24) % 94);
+    }
+    return message;
+}
+
+template <typename imageObject>
+static bool benchImage(const std::string& path, const syntheticFormat format, const double megapixels,
+                       const size_t width, const size_t height, const benchOptions& options, std::vector<benchResult>& results) {
+    std::ostringstream prefix;
+    prefix << syntheticFormatName(format) << '/' << megapixels << "MP/";
+    const size_t capacityBits = width * height * 3;
+
+    auto record = [&](const std::string& operation, const size_t payloadBytes, const unsigned bitsPerChannel, const std::function<bool()>& run,
+                      const size_t bytesPerOperation, const size_t bitsPerOperation) {
+        benchResult result{prefix.str() + operation, operation, format, megapixels, payloadBytes, bitsPerChannel, 0, 0, bytesPerOperation, bitsPerOperation};
+        if (bitsPerChannel > 1) result.name += "/k" + std::to_string(bitsPerChannel);
+        if (payloadBytes > 0) result.name += '/' + std::to_string(payloadBytes) + 'B';
+        if (!measure(run, options.minTime, result.iterations, result.nanosecondsPerOperation)) {
+            std::cerr << "Error: " << result.name << " failed." << std::endl;
+            return false;
+        }
+        std::cout << std::left << std::setw(40) << result.name << std::right
+                  << std::setw(14) << std::fixed << std::setprecision(0) << result.nanosecondsPerOperation << " ns"
+                  << std::setw(11) << result.iterations;
+        if (result.bytesPerOperation > 0) std::cout << std::setw(12) << std::setprecision(1) << result.megabytesPerSecond();
+        else std::cout << std::setw(12) << '-';
+        if (result.bitsPerOperation > 0) std::cout << std::setw(11) << std::setprecision(3) << result.nanosecondsPerBit();
+        else std::cout << std::setw(11) << '-';
+        std::cout << std::endl;
+        results.push_back(result);
+        return true;
+    };
+
+    bool succeeded = record("header_parse", 0, 1, [&] {
+        imageObject image(path);
+        return image.isHeaderCorrect().ok();
+    }, 0, 0);
+
+    // The same header many times over, as a carrier index would hand them in
+    std::vector<unsigned char> header(ppmObject::headerBufferSize);
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size()));
+        header.resize(static_cast<size_t>(file.gcount()));
+    }
+    const std::vector<std::span<const std::byte>> headers(capacityQueryBatch, std::as_bytes(std::span(header)));
+    std::vector<size_t> capacities(headers.size());
+    succeeded &= record("capacity_query", 0, 1, [&] {
+        queryCapacity(headers, 1, capacities);
+        return capacities.back() == capacityBits - frameHeaderSize * 8;
+    }, 0, 0);
+
+    // Steganalysis reads the whole image through a bounded buffer, so it is timed as MB/s of channels
+    if (format != syntheticFormat::P3) {
+        succeeded &= record("analyze", 0, 1, [&] {
+            return analyzeImageFile(path).status.ok();
+        }, capacityBits, 0);
+    }
+
+    imageObject image(path);
+    if (!image.isHeaderCorrect()) {
+        return false;
+    }
+    for (const unsigned bitsPerChannel : options.bitsPerChannel) {
+        if (format == syntheticFormat::P3 && bitsPerChannel != 1) {
+            continue;
+        }
+        for (const size_t requested : options.payloadSizes) {
+            const size_t payloadBytes = requested == 0 ? capacityBits * bitsPerChannel / 8 - frameHeaderSize : requested;
+            // The frame header is embedded too
+            const size_t payloadBits = (frameHeaderSize + payloadBytes) * 8;
+            if (payloadBits > capacityBits * bitsPerChannel) {
+                continue;
+            }
+            std::string message = makeMessage(payloadBytes);
+            std::string extracted;
+            succeeded &= record("capacity_check", payloadBytes, bitsPerChannel, [&] {
+                return image.isEncryptPossible(message, bitsPerChannel);
+            }, payloadBytes, payloadBits);
+            // One channel byte carries bitsPerChannel bits
+            const size_t channelBytes = (payloadBits + bitsPerChannel - 1) / bitsPerChannel;
+            succeeded &= record("embed", payloadBytes, bitsPerChannel, [&] {
+                return image.encryption(message, bitsPerChannel).ok();
+            }, channelBytes, payloadBits);
+            // The image already holds this payload, so a delta write only compares
+            size_t bytesWritten = 0;
+            succeeded &= record("embed_delta", payloadBytes, bitsPerChannel, [&] {
+                return image.embedFrame(buildFrame(message, bitsPerChannel), bitsPerChannel, {}, true, bytesWritten).ok() && bytesWritten == 0;
+            }, channelBytes, payloadBits);
+            succeeded &= record("extract", payloadBytes, bitsPerChannel, [&] {
+                return image.decryption(extracted).ok();
+            }, channelBytes, payloadBits);
+            if (extracted != message) {
+                std::cerr << "Error: Extracted payload differs from the embedded one (" << path << ")." << std::endl;
+                succeeded = false;
+            }
+            if (format == syntheticFormat::P3) {
+                continue;
+            }
+            // Same payload scattered with a key, which trades the kernels for random access
+            const std::string frame = buildFrame(message, bitsPerChannel);
+            succeeded &= record("embed_keyed", payloadBytes, bitsPerChannel, [&] {
+                return image.embedFrame(frame, bitsPerChannel, benchKey, false, bytesWritten).ok();
+            }, channelBytes, payloadBits);
+            succeeded &= record("extract_keyed", payloadBytes, bitsPerChannel, [&] {
+                return image.decryption(extracted, benchKey).ok();
+            }, channelBytes, payloadBits);
+            if (extracted != message) {
+                std::cerr << "Error: Payload extracted with the key differs from the embedded one (" << path << ")." << std::endl;
+                succeeded = false;
+            }
+        }
+    }
+    if (format == syntheticFormat::P3) {
+        return succeeded;
+    }
+    // Half the capacity of a few copies of the image, one carrier open at a time while the row
+    // bands of each run on the pool
+    std::vector<std::string> carriers;
+    std::error_code error;
+    for (size_t i = 0; i < shardCarriers; ++i) {
+        carriers.push_back(path + ".shard" + std::to_string(i) + syntheticFormatExtension(format));
+        std::filesystem::copy_file(path, carriers.back(), std::filesystem::copy_options::overwrite_existing, error);
+    }
+    const std::string shardMessage = makeMessage(shardCarriers * (capacityBits / 8 - frameHeaderSize - shardHeaderSize) / 2);
+    const size_t shardBits = shardMessage.size() * 8;
+    std::vector<std::byte> shardExtracted;
+    succeeded &= !error && record("shard_embed_open1", shardMessage.size(), 1, [&] {
+        return embedSharded(carriers, asBytes(shardMessage), {}, 1).ok();
+    }, shardBits, shardBits);
+    succeeded &= !error && record("shard_extract_open1", shardMessage.size(), 1, [&] {
+        extractResult result = extractSharded(carriers, {}, 1);
+        shardExtracted = std::move(result.payload);
+        return result.status.ok();
+    }, shardBits, shardBits);
+    if (!error && asText(shardExtracted) != shardMessage) {
+        std::cerr << "Error: Sharded payload differs from the embedded one (" << path << ")." << std::endl;
+        succeeded = false;
+    }
+    if (!options.keepImages) {
+        for (const std::string& carrier : carriers) std::filesystem::remove(carrier, error);
+    }
+    return succeeded;
+}
+
+static bool writeJson(const std::string& jsonPath, const benchOptions& options, const std::vector<benchResult>& results) {
+    std::ofstream json(jsonPath, std::ios::trunc);
+    if (!json.is_open()) {
+        std::cerr << "Error: File can't be created (" << jsonPath << ")." << std::endl;
+        return false;
+    }
+    const std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    json << std::setprecision(6) << "{\n  \"context\": {\n"
+         << "    \"date\": \"" << date << "\",\n"
+         << "    \"threads\": " << globalThreadPool().size() << ",\n"
+         << "    \"lsb_kernel\": \"" << selectLsbKernels().name << "\",\n"
+         << "    \"min_time_s\": " << options.minTime << "\n  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const benchResult& result = results[i];
+        json << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\""
+             << ", \"operation\": \"" << result.operation << "\""
+             << ", \"format\": \"" << syntheticFormatName(result.format) << "\""
+             << ", \"megapixels\": " << result.megapixels
+             << ", \"payload_bytes\": " << result.payloadBytes
+             << ", \"bits_per_channel\": " << result.bitsPerChannel
+             << ", \"iterations\": " << result.iterations
+             << ", \"real_time_ns\": " << std::fixed << std::setprecision(1) << result.nanosecondsPerOperation
+             << ", \"mb_per_s\": " << std::setprecision(3) << result.megabytesPerSecond()
+             << ", \"ns_per_bit\": " << std::setprecision(4) << result.nanosecondsPerBit() << std::defaultfloat << std::setprecision(6) << "}";
+    }
+    json << "\n  ]\n}\n";
+    return static_cast<bool>(json.flush());
+}
+
+int main(int argc, char* argv[]) {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    if (std::find(args.begin(), args.end(), "--help") != args.end() || std::find(args.begin(), args.end(), "-h") != args.end()) {
+        printUsage();
+        return 0;
+    }
+    benchOptions options;
+    if (!parseOptions(args, options)) {
+        printUsage();
+        return 1;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(options.directory, error);
+    if (error) {
+        std::cerr << "Error: Directory can't be created (" << options.directory.string() << ")." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Threads: " << globalThreadPool().size() << ", LSB kernel: " << selectLsbKernels().name << "\n"
+              << std::left << std::setw(40) << "Benchmark" << std::right << std::setw(17) << "Time"
+              << std::setw(11) << "Iterations" << std::setw(12) << "MB/s" << std::setw(11) << "ns/bit" << "\n"
+              << std::string(91, '-') << std::endl;
+
+    std::vector<benchResult> results;
+    bool succeeded = true;
+    for (const double megapixels : options.megapixels) {
+        size_t width, height;
+        syntheticDimensions(megapixels, width, height);
+        for (const syntheticFormat format : options.formats) {
+            std::ostringstream name;
+            name << "synthetic_" << megapixels << "MP_" << syntheticFormatName(format) << syntheticFormatExtension(format);
+            const std::string path = (options.directory / name.str()).string();
+            if (!writeSyntheticImage(path, format, width, height, static_cast<uint64_t>(megapixels * 1e6) + static_cast<uint64_t>(format))) {
+                succeeded = false;
+                continue;
+            }
+            succeeded &= format == syntheticFormat::BMP || format == syntheticFormat::BMP32
+                ? benchImage<bmpObject>(path, format, megapixels, width, height, options, results)
+                : benchImage<ppmObject>(path, format, megapixels, width, height, options, results);
+            if (!options.keepImages) {
+                std::filesystem::remove(path, error);
+            }
+        }
+    }
+    if (!options.jsonPath.empty() && !writeJson(options.jsonPath, options, results)) {
+        return 1;
+    }
+    return succeeded ? 0 : 1;
+}
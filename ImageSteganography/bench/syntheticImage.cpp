@@ -0,0 +1,140 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <charconv>
+#include <algorithm>
+#include "syntheticImage.hpp"
+
+static constexpr size_t writeBlockSize = 4 * 1024 * 1024;
+// Netpbm asks for text lines of at most 70 characters
+static constexpr size_t asciiSamplesPerLine = 15;
+
+// xorshift64*, plenty for noise and far faster than <random>
+struct noiseGenerator {
+    uint64_t state;
+    explicit noiseGenerator(const uint64_t seed) : state(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1dull;
+    }
+    void fill(unsigned char* bytes, const size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const uint64_t value = next();
+            for (size_t b = 0; b < 8; ++b) bytes[i + b] = static_cast<unsigned char>(value >> (b * 8));
+        }
+        if (i < count) {
+            const uint64_t value = next();
+            for (size_t b = 0; i < count; ++i, ++b) bytes[i] = static_cast<unsigned char>(value >> (b * 8));
+        }
+    }
+};
+
+static void storeLittleEndian(unsigned char* bytes, const uint32_t value, const size_t size) {
+    for (size_t i = 0; i < size; ++i) bytes[i] = static_cast<unsigned char>(value >> (i * 8));
+}
+
+void syntheticDimensions(const double megapixels, size_t& width, size_t& height) {
+    const double pixels = std::max(1.0, megapixels * 1e6);
+    width = std::max<size_t>(1, static_cast<size_t>(std::llround(std::sqrt(pixels * 4.0 / 3.0))));
+    height = std::max<size_t>(1, static_cast<size_t>(std::llround(pixels / static_cast<double>(width))));
+}
+const char* syntheticFormatName(const syntheticFormat format) {
+    switch (format) {
+        case syntheticFormat::BMP: return "bmp";
+        case syntheticFormat::BMP32: return "bmp32";
+        case syntheticFormat::P3: return "p3";
+        case syntheticFormat::P6_16: return "p6_16";
+        default: return "p6";
+    }
+}
+const char* syntheticFormatExtension(const syntheticFormat format) {
+    return format == syntheticFormat::BMP || format == syntheticFormat::BMP32 ? ".bmp" : ".ppm";
+}
+
+static bool writeBmp(std::ofstream& file, const bool bgra, const size_t width, const size_t height, noiseGenerator& noise) {
+    const size_t rowBytes = width * (bgra ? 4 : 3);
+    const size_t rowStride = (rowBytes + 3) / 4 * 4;
+    const uint64_t fileSize = 54 + static_cast<uint64_t>(rowStride) * height;
+    if (fileSize > UINT32_MAX || width > INT32_MAX || height > INT32_MAX) {
+        std::cerr << "Error: Image is too large for a BMP file." << std::endl;
+        return false;
+    }
+    unsigned char header[54] = {'B', 'M'};
+    storeLittleEndian(header + 2, static_cast<uint32_t>(fileSize), 4);
+    storeLittleEndian(header + 10, 54, 4);
+    storeLittleEndian(header + 14, 40, 4);
+    storeLittleEndian(header + 18, static_cast<uint32_t>(width), 4);
+    // BGRA images are stored top-down, which a negative height announces
+    storeLittleEndian(header + 22, bgra ? static_cast<uint32_t>(-static_cast<int32_t>(height)) : static_cast<uint32_t>(height), 4);
+    storeLittleEndian(header + 26, 1, 2);
+    storeLittleEndian(header + 28, bgra ? 32 : 24, 2);
+    storeLittleEndian(header + 34, static_cast<uint32_t>(rowStride * height), 4);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    const size_t rowsPerBlock = std::max<size_t>(1, writeBlockSize / rowStride);
+    std::vector<unsigned char> block(rowsPerBlock * rowStride, 0);
+    for (size_t row = 0; row < height; row += rowsPerBlock) {
+        const size_t rows = std::min(rowsPerBlock, height - row);
+        for (size_t y = 0; y < rows; ++y) {
+            unsigned char* row = block.data() + y * rowStride;
+            noise.fill(row, rowBytes);
+            for (size_t x = 3; bgra && x < rowBytes; x += 4) {
+                row[x] = 0xFF;
+            }
+        }
+        file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(rows * rowStride));
+    }
+    return true;
+}
+
+static void writePpm(std::ofstream& file, const bool binary, const bool wideSamples, const size_t width, const size_t height,
+                     noiseGenerator& noise) {
+    file << (binary ? "P6" : "P3") << "\n# synthetic benchmark image\n" << width << ' ' << height
+         << (wideSamples ? "\n65535\n" : "\n255\n");
+    const size_t rowBytes = width * (wideSamples ? 6 : 3);
+    const size_t rowsPerBlock = std::max<size_t>(1, writeBlockSize / rowBytes);
+    std::vector<unsigned char> block(rowsPerBlock * rowBytes);
+    std::vector<char> text;
+    for (size_t row = 0; row < height; row += rowsPerBlock) {
+        const size_t rows = std::min(rowsPerBlock, height - row);
+        const size_t bytes = rows * rowBytes;
+        noise.fill(block.data(), bytes);
+        if (binary) {
+            file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(bytes));
+            continue;
+        }
+        // At most "255 " per sample plus a newline per line
+        text.resize(bytes * 4 + bytes / asciiSamplesPerLine + 1);
+        char* out = text.data();
+        for (size_t i = 0; i < bytes; ++i) {
+            out = std::to_chars(out, text.data() + text.size(), block[i]).ptr;
+            *out++ = (i + 1) % asciiSamplesPerLine == 0 || i + 1 == bytes ? '\n' : ' ';
+        }
+        file.write(text.data(), out - text.data());
+    }
+}
+
+bool writeSyntheticImage(const std::string& filePath, const syntheticFormat format, const size_t width, const size_t height, const uint64_t seed) {
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error: File can't be created (" << filePath << ")." << std::endl;
+        return false;
+    }
+    noiseGenerator noise(seed);
+    if (format == syntheticFormat::BMP || format == syntheticFormat::BMP32) {
+        if (!writeBmp(file, format == syntheticFormat::BMP32, width, height, noise)) {
+            return false;
+        }
+    } else {
+        writePpm(file, format != syntheticFormat::P3, format == syntheticFormat::P6_16, width, height, noise);
+    }
+    if (!file.flush()) {
+        std::cerr << "Error: File can't be written (" << filePath << ")." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef SYNTHETICIMAGE_HPP
+#define SYNTHETICIMAGE_HPP
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+enum class syntheticFormat { BMP, P3, P6, BMP32, P6_16 };
+
+// Width and height of a roughly 4:3 image with the given number of megapixels
+void syntheticDimensions(double megapixels, size_t& width, size_t& height);
+const char* syntheticFormatName(syntheticFormat format);
+const char* syntheticFormatExtension(syntheticFormat format);
+
+// Writes a noise image (24-bit bottom-up BMP, 32-bit top-down BGRA BMP with opaque alpha, P3,
+// P6 or 16-bit P6 PPM) row block by row block,
+// so generating a 500 MP carrier doesn't need the whole image in memory
+bool writeSyntheticImage(const std::string& filePath, syntheticFormat format, size_t width, size_t height, uint64_t seed);
+
+#endif //SYNTHETICIMAGE_HPP
@@ -1,185 +1,134 @@
-#include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
+#include <climits>
 #include "bmpProcessor.hpp"
 #include "helpFunctions.hpp"
+#include "payloadFrame.hpp"
+#include "stegStats.hpp"
 
 bmpObject::bmpObject(const std::string& inputFilePath) {
     filePath = inputFilePath;
     fileSize = 0,dataOffset = 0,headerSize = 0,compression = 0,imageSize = 0,colorsUsed = 0,colorsImportant = 0,colorPlanes = 0,bitsPerPixel = 0;
     width = 0,height = 0,xResolution = 0,yResolution = 0;paddingSize = 0,bfReserved1 = 0,bfReserved2 = 0,fileType = 0;
 }
-bool bmpObject::isHeaderCorrect() {
-    std::fstream file(filePath,std::ios::in |std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: File can't be opened."<< std::endl;;
-        return false;
+stegStatus bmpObject::isHeaderCorrect() {
+    STEG_PHASE(HEADER_PARSE);
+    if (stegStatus status = file.open(filePath); !status) {
+        return status;
     }
-    fileType = static_cast<unsigned short>(readLittleEndian(file, 2, EndianReadType::USHORT));
+    // File header and the largest info header (BITMAPV5HEADER) are read in one go
+    unsigned char header[headerBufferSize];
+    return parseHeader(header, file.readHeader(header, sizeof(header)));
+}
+stegStatus bmpObject::parseHeader(const unsigned char* header, const size_t headerBytes) {
+    if (headerBytes < fileHeaderSize + 4) {
+        return {stegError::INVALID_HEADER, "Not a valid BMP file (file is too short)."};
+    }
+    fileType = loadLittleEndian<unsigned short>(header);
     if (fileType != 0x4D42) {
-        std::cerr << "Error: Not a valid BMP file (invalid signature)." << std::endl;
-        return false;
+        return {stegError::INVALID_HEADER, "Not a valid BMP file (invalid signature)."};
     }
 
-    fileSize = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
-    bfReserved1 = static_cast<unsigned short>(readLittleEndian(file, 2, EndianReadType::USHORT));
-    bfReserved2 = static_cast<unsigned short>(readLittleEndian(file, 2, EndianReadType::USHORT));
-    dataOffset = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
-    headerSize = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
+    fileSize = loadLittleEndian<unsigned int>(header + 2);
+    bfReserved1 = loadLittleEndian<unsigned short>(header + 6);
+    bfReserved2 = loadLittleEndian<unsigned short>(header + 8);
+    dataOffset = loadLittleEndian<unsigned int>(header + 10);
+    headerSize = loadLittleEndian<unsigned int>(header + 14);
 
     // Standard size BITMAPINFOHEADER = 40 bytes
     if (headerSize >= 40) {
-        width = static_cast<int>(readLittleEndian(file, 4, EndianReadType::INT));
-        height = static_cast<int>(readLittleEndian(file, 4, EndianReadType::INT));
-        colorPlanes = static_cast<unsigned short>(readLittleEndian(file, 2, EndianReadType::USHORT));
-        bitsPerPixel = static_cast<unsigned short>(readLittleEndian(file, 2, EndianReadType::USHORT));
-        compression = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
-        imageSize = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
-        xResolution = static_cast<int>(readLittleEndian(file, 4, EndianReadType::INT));
-        yResolution = static_cast<int>(readLittleEndian(file, 4, EndianReadType::INT));
-        colorsUsed = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
-        colorsImportant = static_cast<unsigned int>(readLittleEndian(file, 4, EndianReadType::UINT));
+        if (headerBytes < fileHeaderSize + 40) {
+            return {stegError::INVALID_HEADER, "Not a valid BMP file (truncated info header)."};
+        }
+        width = loadLittleEndian<int>(header + 18);
+        height = loadLittleEndian<int>(header + 22);
+        colorPlanes = loadLittleEndian<unsigned short>(header + 26);
+        bitsPerPixel = loadLittleEndian<unsigned short>(header + 28);
+        compression = loadLittleEndian<unsigned int>(header + 30);
+        imageSize = loadLittleEndian<unsigned int>(header + 34);
+        xResolution = loadLittleEndian<int>(header + 38);
+        yResolution = loadLittleEndian<int>(header + 42);
+        colorsUsed = loadLittleEndian<unsigned int>(header + 46);
+        colorsImportant = loadLittleEndian<unsigned int>(header + 50);
 
-        if (width > 0 && bitsPerPixel > 0) {
-            int bytes_per_pixel_calc = bitsPerPixel / 8;
-            if (bytes_per_pixel_calc == 0 && bitsPerPixel > 0) bytes_per_pixel_calc = 1;
-            if (bytes_per_pixel_calc > 0) {
-                paddingSize = (4 - ((width * bytes_per_pixel_calc) % 4)) % 4;
-            } else {
-                paddingSize = 0;
+        if (compression != biRgb && !(compression == biBitfields && bitsPerPixel == 32)) {
+            return {stegError::UNSUPPORTED_FORMAT, "Compressed BMP formats are not supported (compression method: " + std::to_string(compression) + ")."};
+        }
+        if (bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32) {
+            return {stegError::UNSUPPORTED_FORMAT, "Only 8-bit paletted, 24-bit and 32-bit BMP formats are supported (bits per pixel: " + std::to_string(bitsPerPixel) + ")."};
+        }
+        // The channel masks follow a 40 byte info header and are part of the larger ones
+        if (compression == biBitfields) {
+            if (headerBytes < fileHeaderSize + 52) {
+                return {stegError::INVALID_HEADER, "Not a valid BMP file (truncated channel masks)."};
+            }
+            if (loadLittleEndian<unsigned int>(header + 54) != 0x00FF0000 || loadLittleEndian<unsigned int>(header + 58) != 0x0000FF00
+                || loadLittleEndian<unsigned int>(header + 62) != 0x000000FF) {
+                return {stegError::UNSUPPORTED_FORMAT, "Only BGRA channel masks are supported for 32-bit BMPs."};
             }
-        } else {
-            paddingSize = 0;
         }
-
-        if (compression != 0) {
-            std::cerr << "Error: Compressed BMP formats are not supported (compression method: " << compression << ")."<< std::endl;;
-            return false;
+        if (width < 1) {
+            return {stegError::INVALID_HEADER, "File width size is too small."};
         }
-        if(bitsPerPixel != 24) {
-            std::cerr << "Error: Only 24-bit BMP format is supported (bits per pixel: " << bitsPerPixel << ")."<< std::endl;;
-            return false;
+        // A negative height marks a top-down image
+        if (height == 0 || height == INT_MIN) {
+            return {stegError::INVALID_HEADER, "File height size is invalid."};
         }
+        if (bitsPerPixel == 8 && (colorsUsed > 256 || fileHeaderSize + headerSize + 4 * paletteColors() > dataOffset)) {
+            return {stegError::INVALID_HEADER, "Not a valid BMP file (palette doesn't fit before the pixel data)."};
+        }
+        // Rows are padded to a multiple of 4 bytes
+        const size_t rowBytes = static_cast<size_t>(width) * (bitsPerPixel / 8);
+        paddingSize = static_cast<int>((4 - rowBytes % 4) % 4);
     }else {
-        std::cerr << "Unsupported BMP info header size (" << headerSize << " bytes). Expected at least 40 bytes."<< std::endl;;
-        return false;
+        return {stegError::UNSUPPORTED_FORMAT, "Unsupported BMP info header size (" + std::to_string(headerSize) + " bytes). Expected at least 40 bytes."};
     }
-    return true;
+    return {};
 }
-void bmpObject::printInfo(){
-    std::cout << "--- BMP Header Info ---" << std::endl;
-    std::cout << "File Size: " << fileSize << " bytes" << std::endl;
-    std::cout << "Data Offset: " << dataOffset << " bytes" << std::endl;
-    std::cout << "Header Size: " << headerSize << " bytes" << std::endl;
-    std::cout << "Width: " << width << " pixels" << std::endl;
-    std::cout << "Height: " << height << " pixels" << std::endl;
-    std::cout << "Bits Per Pixel: " << bitsPerPixel << std::endl;
-    std::cout << "Compression: " << (compression == 0 ? "None" : std::to_string(compression)) << std::endl;
-    std::cout << "Image Size: " << ((width*bitsPerPixel+31)/32)*4*height << " bytes" << std::endl;
-    std::cout << "-----------------------" << std::endl;
+imageDescription bmpObject::describe() const {
+    imageDescription description;
+    description.format = imageFormat::BMP;
+    description.width = width;
+    description.height = height;
+    description.bitsPerPixel = bitsPerPixel;
+    description.fileSize = fileSize;
+    description.headerSize = headerSize;
+    description.compression = compression;
+    description.paletteColors = bitsPerPixel == 8 ? static_cast<unsigned>(paletteColors()) : 0;
+    description.layout = pixelRegion();
+    return description;
 }
-bool bmpObject::isEncryptPossible(const std::string& message)  {
-    std::string messageCopy = message;
-    const std::vector<bool> messageInBits = textToBits(messageCopy);
-    if (!static_cast<size_t>(width)*static_cast<size_t>(std::abs(height))*3 >= messageInBits.size()) {
-        return false;
-    }
-    return true;
+bool bmpObject::isEncryptPossible(const std::string& message, const unsigned bitsPerChannel, const payloadCodec codec)  {
+    return storedPayloadSize(message, codec) * 8 <= describe().capacityBits(bitsPerChannel);
 }
-bool bmpObject::encryption(std::string& message){
-    size_t messageIndex = 0;
-    std::string messageCopy = message;
-    const std::vector<bool>& messageInBits = textToBits(messageCopy);
-    auto encodeSingleLSB = [&](unsigned char& channel_byte) -> bool {
-        if (messageIndex < messageInBits.size()) {
-            const bool message_bit = messageInBits[messageIndex];
-            channel_byte = (channel_byte & ~1) | static_cast<unsigned char>(message_bit);
-            messageIndex++;
-            return true;
-        }
-        return false;
-    };
-    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: File can't be opened."<< std::endl;;
-        return false;
-    }
-
-    file.seekg(dataOffset, std::ios::beg);
-    bool message_embedded_completely = false;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            unsigned char b, g, r;
-            const long long current_pixel_pos = file.tellg();
-            if (!file.read(reinterpret_cast<char*>(&b), 1) ||
-                !file.read(reinterpret_cast<char*>(&g), 1) ||
-                !file.read(reinterpret_cast<char*>(&r), 1)) {
-                std::cerr << "Error reading pixel data at row " << y << ", pixel " << x << std::endl;
-                return false;
-            }
-            if (!message_embedded_completely) {
-                if (!encodeSingleLSB(b)) {message_embedded_completely = true; }
-            }
-            if (!message_embedded_completely) {
-                if (!encodeSingleLSB(g)) {message_embedded_completely = true; }
-            }
-            if (!message_embedded_completely) {
-                if (!encodeSingleLSB(r)) {message_embedded_completely = true; }
-            }
-            file.seekp(current_pixel_pos, std::ios::beg);
-            if (!file.write(reinterpret_cast<char*>(&b), 1) ||
-                !file.write(reinterpret_cast<char*>(&g), 1) ||
-                !file.write(reinterpret_cast<char*>(&r), 1)) {
-                std::cerr << "Error writing pixel data at row " << y << ", pixel " << x << std::endl;
-                return false;
-            }
-        }
-        if (message_embedded_completely) {
-            break;
-        }
-        file.seekg(paddingSize, std::ios::cur);
-        file.seekp(paddingSize, std::ios::cur);
-    }
-    return true;
+pixelLayout bmpObject::pixelRegion() const {
+    pixelLayout layout;
+    layout.dataOffset = dataOffset;
+    layout.rowBytes = static_cast<size_t>(width) * (bitsPerPixel / 8);
+    layout.rowStride = layout.rowBytes + static_cast<size_t>(paddingSize);
+    layout.rows = height > 0 ? static_cast<size_t>(height) : static_cast<size_t>(-static_cast<long long>(height));
+    // 32-bit pixels keep their alpha byte; 8-bit ones carry the payload in their palette indices
+    layout.packing = bitsPerPixel == 32 ? channelPacking::BGRA : channelPacking::PACKED;
+    layout.topDown = height < 0;
+    return layout;
 }
-bool bmpObject::decryption() {
-    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: File can't be opened."<< std::endl;;
-        return false;
-    }
-    std::vector<char> pixelsChannels;
-    pixelsChannels.reserve(static_cast<size_t>(width) * static_cast<size_t>(std::abs(height)) * 3);
-    file.seekg(dataOffset, std::ios::beg);
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            unsigned char b, g, r;
-            // Read BGR bytes
-            if (!file.read(reinterpret_cast<char*>(&b), 1) ||
-                !file.read(reinterpret_cast<char*>(&g), 1) ||
-                !file.read(reinterpret_cast<char*>(&r), 1)) {
-                std::cerr << "Error reading pixel data at row " << y << ", pixel " << x << std::endl;
-                pixelsChannels.clear();
-                return false;
-            }
-            pixelsChannels.emplace_back(b);
-            pixelsChannels.emplace_back(g);
-            pixelsChannels.emplace_back(r);
+stegStatus bmpObject::encryption(std::string& message, const unsigned bitsPerChannel, const payloadCodec codec){
+    size_t bytesWritten;
+    return embedFrame(buildFrame(message, bitsPerChannel, codec), bitsPerChannel, {}, false, bytesWritten);
+}
+stegStatus bmpObject::embedFrame(const std::string& frame, const unsigned bitsPerChannel, const std::string& key, const bool deltaWrite, size_t& bytesWritten) {
+    const pixelLayout layout = pixelRegion();
+    size_t paletteBytes = 0;
+    if (bitsPerPixel == 8 && paletteColors() % 2 == 0 && frame.size() * 8 <= layout.channelCount() * bitsPerChannel) {
+        if (stegStatus status = file.pairPalette(fileHeaderSize + headerSize, paletteColors(), layout, paletteBytes); !status) {
+            return status;
         }
-        // Skip padding bytes at the end of the row
-        file.seekg(paddingSize, std::ios::cur);
     }
-
-    auto extractBit = [&](unsigned char byte) -> bool {
-        return (byte & 1);
-    };
-    std::vector<bool> extractedBits;
-    extractedBits.reserve(static_cast<size_t>(width) * static_cast<size_t>(height) * 3);
-    for (const auto& channel : pixelsChannels) {
-        extractedBits.push_back(extractBit(channel));
-    }
-    std::cout << "Extracted message: " << bitsToText(extractedBits) << std::endl;
-    return true;
+    stegStatus status = file.embedPayload(layout, frame, bitsPerChannel, key, deltaWrite, bytesWritten);
+    bytesWritten += paletteBytes;
+    return status;
+}
+stegStatus bmpObject::decryption(std::string& message, const std::string& key) {
+    return file.extractPayload(pixelRegion(), key, message);
 }
@@ -1,5 +1,7 @@
 #ifndef BMPPROCESSOR_HPP
 #define BMPPROCESSOR_HPP
+#include "pixelAccess.hpp"
+#include "steganography.hpp"
 
 struct bmpObject{
 private:
@@ -7,13 +9,33 @@ private:
     unsigned short fileType,bfReserved1,bfReserved2;
     int width,height,xResolution,yResolution,paddingSize;
     std::string filePath;
+    imageFile file;
+    static constexpr size_t maxInfoHeaderSize = 124;
+    // Compression methods: none, and uncompressed with channel masks
+    static constexpr unsigned biRgb = 0;
+    static constexpr unsigned biBitfields = 3;
+
+    // Entries of the palette an 8-bit image has, which starts right after the info header
+    size_t paletteColors() const { return colorsUsed == 0 ? 256 : colorsUsed; }
 public:
+    // The info header, and the palette of an 8-bit image after it, follow the file header
+    static constexpr size_t fileHeaderSize = 14;
+    // Bytes parseHeader needs at most
+    static constexpr size_t headerBufferSize = fileHeaderSize + maxInfoHeaderSize;
+
     bmpObject(const std::string &inputFilePath);
-    bool isHeaderCorrect();
-    void printInfo();
-    bool isEncryptPossible(const std::string& message) ;
-    bool encryption(std::string& message) ;
-    bool decryption();
+    stegStatus isHeaderCorrect();
+    // Validates a header already held in memory (e.g. read from a pipe)
+    stegStatus parseHeader(const unsigned char* header, size_t headerBytes);
+    pixelLayout pixelRegion() const;
+    imageDescription describe() const;
+    bool isEncryptPossible(const std::string& message, unsigned bitsPerChannel = 1, payloadCodec codec = payloadCodec::RAW) ;
+    stegStatus encryption(std::string& message, unsigned bitsPerChannel = 1, payloadCodec codec = payloadCodec::RAW) ;
+    // Embeds a frame already built with buildFrame, see imageFile::embedPayload for key and deltaWrite.
+    // An 8-bit image gets its palette paired first (paletteOrder.hpp) when the frame fits.
+    stegStatus embedFrame(const std::string& frame, unsigned bitsPerChannel, const std::string& key, bool deltaWrite, size_t& bytesWritten);
+    // The bits per channel setting is read from the hidden frame
+    stegStatus decryption(std::string& message, const std::string& key = {});
 };
 
 #endif //BMPPROCESSOR_HPP
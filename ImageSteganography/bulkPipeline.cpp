@@ -0,0 +1,341 @@
+#include "bulkPipeline.hpp"
+#ifndef _WIN32
+#include <algorithm>
+#include <cerrno>
+#include <semaphore>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bmpProcessor.hpp"
+#include "ppmProcessor.hpp"
+#include "helpFunctions.hpp"
+#include "keyedScatter.hpp"
+#include "threadPool.hpp"
+#include "stegStats.hpp"
+
+// Queue depth per open image: its header or row read, or a few range writes
+static constexpr unsigned requestsPerFile = 4;
+
+enum class bulkStage {
+    OPEN,           // the file gets opened and its header read
+    HEADER,         // the header is in, the first rows (or all of them) get read
+    FRAME_HEADER,   // extract: the rows holding the frame header are in, the others get read
+    ROWS,           // the rows holding the frame are in, embed writes back the bytes that changed
+    WRITES,         // the changed bytes are written
+    DONE,
+    MAPPED,         // left to embedInImageFile or extractFromImageFile
+};
+
+// A job's progress, kept while the queue works on its file
+struct jobState {
+    bulkStage stage = bulkStage::OPEN;
+    int file = -1;
+    uint64_t fileSize = 0;
+    std::chrono::steady_clock::time_point start;
+    std::vector<unsigned char> buffer;   // the header, then the pixel rows from the first one on
+    size_t rows = 0;                     // pixel rows in buffer
+    std::vector<ioRequest> requests;     // reads or writes of the current stage
+    size_t outstanding = 0;
+    imageDescription description;
+    frameHeader header;                  // extract
+    std::string frame;                   // embed
+};
+
+static void finishJob(bulkJob& job, jobState& state, const bulkStage stage = bulkStage::DONE) {
+    if (state.file >= 0) {
+        ::close(state.file);
+        STEG_COUNT(SYSCALLS, 1);
+        state.file = -1;
+    }
+    state.stage = stage;
+    std::vector<unsigned char>().swap(state.buffer);
+    std::vector<ioRequest>().swap(state.requests);
+    std::string().swap(state.frame);
+    job.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - state.start);
+}
+static void failJob(bulkJob& job, jobState& state, stegStatus status) {
+    job.status = std::move(status);
+    finishJob(job, state);
+}
+static void queueRead(jobState& state, const uint64_t offset, const size_t size) {
+    state.buffer.resize(size);
+    state.requests.assign(1, {state.file, offset, state.buffer.data(), size, false, 0});
+}
+static void queueRows(jobState& state, const size_t rows) {
+    pixelLayout layout = state.description.layout;
+    layout.rows = rows;
+    state.rows = rows;
+    queueRead(state, layout.dataOffset, layout.regionSize());
+}
+// Rows holding the first channels of the image
+static size_t rowsHolding(const pixelLayout& layout, const size_t channels) {
+    return std::min(layout.rows, (channels + layout.rowChannels() - 1) / layout.rowChannels());
+}
+static bool exceedsReadLimit(const pixelLayout& layout, const size_t rows) {
+    pixelLayout readLayout = layout;
+    readLayout.rows = rows;
+    return readLayout.regionSize() > bulkReadLimit;
+}
+
+// Takes a job from the stage its reads just completed to the next one, queueing that stage's
+// requests in state.requests
+static void advanceJob(bulkJob& job, jobState& state, const stegOptions& options) {
+    if (state.stage != bulkStage::OPEN && !job.status) {
+        finishJob(job, state);
+        return;
+    }
+    const pixelLayout& layout = state.description.layout;
+    switch (state.stage) {
+        case bulkStage::OPEN: {
+            state.start = std::chrono::steady_clock::now();
+            const FileType type = detectFileType(job.filePath);
+            if (type == FileType::UNKNOWN) {
+                failJob(job, state, {stegError::UNSUPPORTED_FORMAT, "Unsupported file format."});
+                return;
+            }
+            state.file = ::open(job.filePath.c_str(), (job.embed ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+            struct stat info;
+            // open and fstat
+            STEG_COUNT(SYSCALLS, 2);
+            if (state.file < 0 || fstat(state.file, &info) != 0) {
+                failJob(job, state, {stegError::CANT_OPEN_FILE, "File can't be opened."});
+                return;
+            }
+            state.fileSize = static_cast<uint64_t>(info.st_size);
+            const size_t headerSize = type == FileType::BMP ? bmpObject::headerBufferSize : ppmObject::headerBufferSize;
+            queueRead(state, 0, static_cast<size_t>(std::min<uint64_t>(state.fileSize, headerSize)));
+            state.stage = bulkStage::HEADER;
+            return;
+        }
+        case bulkStage::HEADER: {
+            {
+                STEG_PHASE(HEADER_PARSE);
+                if (stegStatus status = describeImage(std::as_bytes(std::span(state.buffer)), state.description); !status) {
+                    failJob(job, state, std::move(status));
+                    return;
+                }
+            }
+            // The mapped path also turns down settings the image doesn't take, and pairs the palette
+            // of an 8-bit BMP (paletteOrder.hpp) before embedding into it
+            const bool paletted = state.description.format == imageFormat::BMP && state.description.bitsPerPixel == 8;
+            if (state.description.format == imageFormat::P3 || (job.embed && (paletted || options.bitsPerChannel > state.description.bitsPerChannelLimit()))) {
+                finishJob(job, state, bulkStage::MAPPED);
+                return;
+            }
+            if (layout.dataOffset > state.fileSize || layout.regionSize() > state.fileSize - layout.dataOffset) {
+                failJob(job, state, {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."});
+                return;
+            }
+            size_t rows = layout.rows;
+            if (job.embed) {
+                const unsigned bitsPerChannel = options.bitsPerChannel;
+                if (bitsPerChannel < 1 || bitsPerChannel > maxBitsPerChannel) {
+                    failJob(job, state, {stegError::INVALID_OPTION, "Bits per channel must be between 1 and " + std::to_string(maxBitsPerChannel) + "."});
+                    return;
+                }
+                state.frame = buildFrame(job.payload, bitsPerChannel, options.codec);
+                if (state.frame.size() * 8 > layout.channelCount() * bitsPerChannel) {
+                    failJob(job, state, {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."});
+                    return;
+                }
+                if (options.key.empty()) {
+                    rows = rowsHolding(layout, (state.frame.size() * 8 + bitsPerChannel - 1) / bitsPerChannel);
+                }
+                state.stage = bulkStage::ROWS;
+            } else {
+                if (layout.channelCount() == 0) {
+                    failJob(job, state, {stegError::NO_PAYLOAD, "No hidden payload found in this image."});
+                    return;
+                }
+                // The header is looked for at every bits per channel setting, 1 takes the most channels
+                if (options.key.empty()) {
+                    rows = rowsHolding(layout, frameHeaderSize * 8);
+                }
+                state.stage = options.key.empty() ? bulkStage::FRAME_HEADER : bulkStage::ROWS;
+            }
+            if (exceedsReadLimit(layout, rows)) {
+                finishJob(job, state, bulkStage::MAPPED);
+                return;
+            }
+            queueRows(state, rows);
+            return;
+        }
+        case bulkStage::FRAME_HEADER: {
+            if (stegStatus status = findFrameHeader(layout.view(state.buffer.data(), state.rows), layout.channelCount(), state.header); !status) {
+                failJob(job, state, std::move(status));
+                return;
+            }
+            const size_t rows = rowsHolding(layout, state.header.frameChannels());
+            state.stage = bulkStage::ROWS;
+            if (exceedsReadLimit(layout, rows)) {
+                finishJob(job, state, bulkStage::MAPPED);
+                return;
+            }
+            if (rows > state.rows) {
+                queueRows(state, rows);
+                return;
+            }
+            // The frame is in the rows already read
+            [[fallthrough]];
+        }
+        case bulkStage::ROWS: {
+            STEG_PHASE(PIXEL_IO);
+            const pixelView view = layout.view(state.buffer.data(), state.rows);
+            if (!job.embed) {
+                std::string payload;
+                if (options.key.empty()) {
+                    payload.assign(state.header.frameBits() / 8, '\0');
+                    size_t bitIndex = 0;
+                    extractPayloadFromView(view, payload, bitIndex, state.header.bitsPerChannel);
+                    job.status = unpackFrame(state.header, payload);
+                } else {
+                    job.status = extractScatteredFrameFromView(view, options.key, payload);
+                }
+                if (job.status) {
+                    job.payload = std::move(payload);
+                }
+                finishJob(job, state);
+                return;
+            }
+            // Only the bytes that change are written back with a key or deltaWrite, otherwise
+            // everything up to the last channel of the frame
+            const unsigned bitsPerChannel = options.bitsPerChannel;
+            const std::vector<unsigned char> original = options.deltaWrite || !options.key.empty() ? state.buffer : std::vector<unsigned char>();
+            std::vector<byteRange> ranges;
+            if (options.key.empty()) {
+                size_t bitIndex = 0;
+                const size_t dirtyBytes = embedPayloadInView(view, state.frame, bitIndex, bitsPerChannel);
+                if (options.deltaWrite) {
+                    collectChangedRanges(original.data(), state.buffer.data(), dirtyBytes, fileMergeGap, ranges);
+                } else {
+                    ranges.assign(1, {0, dirtyBytes});
+                }
+            } else {
+                const size_t frameChannels = (state.frame.size() * 8 + bitsPerChannel - 1) / bitsPerChannel;
+                const scatterPlan plan(scatterPermutation(options.key, layout.channelCount()), frameChannels);
+                embedScatteredRows(view, 0, state.frame, bitsPerChannel, plan, false);
+                collectChangedRanges(original.data(), state.buffer.data(), state.buffer.size(), fileMergeGap, ranges);
+            }
+            state.requests.clear();
+            for (const byteRange& range : ranges) {
+                STEG_COUNT(CHANNEL_BYTES, range.end - range.begin);
+                state.requests.push_back({state.file, layout.dataOffset + range.begin, state.buffer.data() + range.begin,
+                                          range.end - range.begin, true, 0});
+            }
+            state.stage = bulkStage::WRITES;
+            return;
+        }
+        case bulkStage::WRITES:
+            finishJob(job, state);
+            return;
+        case bulkStage::DONE:
+        case bulkStage::MAPPED:
+            return;
+    }
+}
+
+void processBulk(const std::span<bulkJob> jobs, const stegOptions& options, const ioBackend backend, const unsigned maxOpenFiles) {
+    threadPool& pool = globalThreadPool();
+    const unsigned openLimit = std::max(1u, maxOpenFiles);
+    ioQueue queue(backend, openLimit * requestsPerFile);
+    std::vector<jobState> states(jobs.size());
+    std::vector<size_t> ready;      // jobs whose requests all completed, to be advanced
+    std::vector<size_t> unqueued;   // jobs advanced without requesting anything
+    std::vector<ioCompletion> completions;
+    size_t nextJob = 0;
+    unsigned openJobs = 0;
+
+    while (true) {
+        for (; openJobs < openLimit && nextJob < jobs.size(); ++nextJob, ++openJobs) {
+            ready.push_back(nextJob);
+        }
+        if (ready.empty() && queue.pending() == 0) {
+            break;
+        }
+        // Header parsing and the LSB kernels of the jobs whose reads are in, while the queue
+        // keeps serving the others
+        pool.parallelFor(ready.size(), [&](const size_t i) {
+            advanceJob(jobs[ready[i]], states[ready[i]], options);
+        });
+        unqueued.clear();
+        for (const size_t j : ready) {
+            jobState& state = states[j];
+            if (state.stage == bulkStage::DONE || state.stage == bulkStage::MAPPED) {
+                --openJobs;
+                continue;
+            }
+            state.outstanding = 0;
+            for (size_t r = 0; r < state.requests.size(); ++r) {
+                ioRequest& request = state.requests[r];
+                if (request.size == 0) continue;
+                request.tag = (static_cast<uint64_t>(j) << 32) | r;
+                queue.submit(request);
+                ++state.outstanding;
+            }
+            if (state.outstanding == 0) unqueued.push_back(j);
+        }
+        ready.swap(unqueued);
+        if (!ready.empty() || queue.pending() == 0) {
+            continue;
+        }
+
+        completions.clear();
+        queue.wait(completions);
+        for (const ioCompletion& completion : completions) {
+            const size_t j = static_cast<size_t>(completion.tag >> 32);
+            jobState& state = states[j];
+            ioRequest& request = state.requests[static_cast<size_t>(completion.tag & 0xffffffff)];
+            if (completion.result == -EINTR || completion.result == -EAGAIN) {
+                queue.submit(request);
+                continue;
+            }
+            if (completion.result > 0) {
+                const size_t done = static_cast<size_t>(completion.result);
+                if (request.write) {
+                    STEG_COUNT(BYTES_WRITTEN, done);
+                } else {
+                    STEG_COUNT(BYTES_READ, done);
+                }
+                request.offset += done;
+                request.buffer += done;
+                request.size -= done;
+                // The rest of a partial transfer goes back into the queue
+                if (request.size > 0) {
+                    queue.submit(request);
+                    continue;
+                }
+            } else if (jobs[j].status) {
+                // A read ends early when the file shrank after it was opened
+                jobs[j].status = request.write
+                    ? stegStatus(stegError::WRITE_FAILED, "Pixel data can't be written at byte " + std::to_string(request.offset) + ".")
+                    : stegStatus(stegError::READ_FAILED, "Image data can't be read at byte " + std::to_string(request.offset) + ".");
+            }
+            if (--state.outstanding == 0) {
+                ready.push_back(j);
+            }
+        }
+    }
+
+    // Images the queue doesn't handle, each on its own
+    std::vector<size_t> mapped;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        if (states[j].stage == bulkStage::MAPPED) mapped.push_back(j);
+    }
+    std::counting_semaphore<> openFiles(openLimit);
+    pool.parallelFor(mapped.size(), [&](const size_t i) {
+        bulkJob& job = jobs[mapped[i]];
+        openFiles.acquire();
+        if (job.embed) {
+            job.status = embedInImageFile(job.filePath, asBytes(job.payload), options).status;
+        } else {
+            const extractResult result = extractFromImageFile(job.filePath, options);
+            job.status = result.status;
+            job.payload = asText(result.payload);
+        }
+        openFiles.release();
+        job.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - states[mapped[i]].start);
+    });
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef BULKPIPELINE_HPP
+#define BULKPIPELINE_HPP
+#include <chrono>
+#include <span>
+#include <string>
+#include "ioQueue.hpp"
+#include "steganography.hpp"
+
+struct bulkJob {
+    std::string filePath;
+    bool embed = false;
+    std::string payload;     // the message to embed, or the one extracted
+    stegStatus status;
+    std::chrono::microseconds elapsed{0};
+};
+
+// Embeds into and extracts from many image files at once through an ioQueue (IO_URING or
+// THREADS): the header reads, pixel row reads and changed range writes of all open images are
+// queued together, and every image's next step (header parsing, the LSB kernels) runs on the
+// global thread pool as soon as its reads complete. At most maxOpenFiles images are open at once.
+// Only the rows the frame occupies are read, all of them with a key; P3 images and images that
+// would need more than bulkReadLimit bytes read go through embedInImageFile and
+// extractFromImageFile instead. Not available on Windows.
+static constexpr size_t bulkReadLimit = 64 * 1024 * 1024;
+void processBulk(std::span<bulkJob> jobs, const stegOptions& options, ioBackend backend, unsigned maxOpenFiles);
+
+#endif //BULKPIPELINE_HPP
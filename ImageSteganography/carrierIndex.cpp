@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <semaphore>
+#include <span>
+#include <unordered_map>
+#include <vector>
+#include "carrierIndex.hpp"
+#include "bmpProcessor.hpp"
+#include "ppmProcessor.hpp"
+#include "helpFunctions.hpp"
+#include "threadPool.hpp"
+#include "stegStats.hpp"
+
+static constexpr unsigned char indexMagic[4] = {'S', 't', 'g', 'I'};
+static constexpr uint32_t indexVersion = 1;
+static constexpr uint32_t claimedFlag = 1;
+static constexpr size_t claimedHintsOffset = 32;
+static_assert(claimedHintsOffset + 4 * maxBitsPerChannel <= carrierIndexHeaderSize);
+
+// An image found by the scan, with its encoded entry once it is known
+struct carrierRecord {
+    std::string path;   // relative to the directory, '/' separated
+    uint64_t fileSize = 0;
+    int64_t modified = 0;
+    bool known = false;
+    unsigned char entry[carrierEntrySize] = {};
+};
+
+static std::string indexPath(const std::string& directory) {
+    return (std::filesystem::path(directory) / carrierIndexName).string();
+}
+static int64_t modificationTime(const std::filesystem::file_time_type time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+static uint64_t entryCapacity(const unsigned char* entry, const unsigned bitsPerChannel) {
+    return loadLittleEndian<uint64_t>(entry + 64 + 8 * (bitsPerChannel - 1));
+}
+
+// Entry count of a mapped index, or false if it is damaged or of another version. Only the sizes
+// are checked here, so opening stays O(1); entries are checked as they are used.
+static bool checkIndex(const mappedFile& index, uint32_t& entryCount) {
+    const unsigned char* bytes = index.data();
+    if (index.size() < carrierIndexHeaderSize || std::memcmp(bytes, indexMagic, sizeof(indexMagic)) != 0
+        || loadLittleEndian<uint32_t>(bytes + 4) != indexVersion) {
+        return false;
+    }
+    entryCount = loadLittleEndian<uint32_t>(bytes + 8);
+    if (loadLittleEndian<uint32_t>(bytes + 12) > entryCount) {
+        return false;
+    }
+    const uint64_t stringsOffset = loadLittleEndian<uint64_t>(bytes + 16);
+    const uint64_t stringsSize = loadLittleEndian<uint64_t>(bytes + 24);
+    const uint64_t tablesEnd = carrierIndexHeaderSize + static_cast<uint64_t>(entryCount) * (carrierEntrySize + 4 * maxBitsPerChannel);
+    return stringsOffset >= tablesEnd && stringsOffset <= index.size() && stringsSize <= index.size() - stringsOffset;
+}
+static bool entryPath(const mappedFile& index, const unsigned char* entry, std::string& path) {
+    const uint64_t stringsSize = loadLittleEndian<uint64_t>(index.data() + 24);
+    const uint64_t pathOffset = loadLittleEndian<uint64_t>(entry);
+    const uint32_t pathLength = loadLittleEndian<uint32_t>(entry + 8);
+    if (pathOffset > stringsSize || pathLength > stringsSize - pathOffset) {
+        return false;
+    }
+    const unsigned char* strings = index.data() + loadLittleEndian<uint64_t>(index.data() + 16);
+    path.assign(reinterpret_cast<const char*>(strings + pathOffset), pathLength);
+    return true;
+}
+
+static void encodeEntry(const imageDescription& description, unsigned char* entry) {
+    const pixelLayout& layout = description.layout;
+    storeLittleEndian<uint64_t>(entry + 32, layout.dataOffset);
+    storeLittleEndian<uint64_t>(entry + 40, layout.rowStride);
+    storeLittleEndian<int32_t>(entry + 48, description.width);
+    storeLittleEndian<int32_t>(entry + 52, description.height);
+    storeLittleEndian<uint16_t>(entry + 56, static_cast<uint16_t>(description.bitsPerPixel));
+    entry[58] = static_cast<unsigned char>(description.format);
+    entry[59] = static_cast<unsigned char>(layout.packing);
+    storeLittleEndian<int32_t>(entry + 60, description.maxChannelValue);
+    for (unsigned bits = 1; bits <= maxBitsPerChannel; ++bits) {
+        storeLittleEndian<uint64_t>(entry + 64 + 8 * (bits - 1), description.capacityBytes(bits));
+    }
+}
+// Only the start of the image up to the pixel data is read
+static stegStatus describeCarrier(const std::string& filePath, const uint64_t fileSize, imageDescription& description) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    const size_t headerSize = detectFileType(filePath) == FileType::BMP ? bmpObject::headerBufferSize : ppmObject::headerBufferSize;
+    std::vector<unsigned char> header(static_cast<size_t>(std::min<uint64_t>(fileSize, headerSize)));
+    file.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    // open, read and close
+    STEG_COUNT(SYSCALLS, 3);
+    STEG_COUNT(BYTES_READ, file.gcount());
+    header.resize(static_cast<size_t>(file.gcount()));
+    if (stegStatus status = describeImage(std::as_bytes(std::span(header)), description); !status) {
+        return status;
+    }
+    // Samples equal to an even P3 max value carry nothing, which takes the whole body to count
+    if (description.format == imageFormat::P3 && description.maxChannelValue % 2 == 0) {
+        return describeImageFile(filePath, description);
+    }
+    const pixelLayout& layout = description.layout;
+    if (description.format != imageFormat::P3 && (layout.dataOffset > fileSize || layout.regionSize() > fileSize - layout.dataOffset)) {
+        return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+    }
+    return {};
+}
+
+static stegStatus writeIndex(const std::string& directory, const std::vector<carrierRecord>& records) {
+    const size_t count = records.size();
+    const size_t ordersOffset = carrierIndexHeaderSize + count * carrierEntrySize;
+    const size_t stringsOffset = ordersOffset + count * 4 * maxBitsPerChannel;
+    size_t stringsSize = 0;
+    for (const carrierRecord& record : records) stringsSize += record.path.size();
+
+    std::vector<unsigned char> bytes(stringsOffset + stringsSize);
+    std::memcpy(bytes.data(), indexMagic, sizeof(indexMagic));
+    storeLittleEndian<uint32_t>(bytes.data() + 4, indexVersion);
+    storeLittleEndian<uint32_t>(bytes.data() + 8, static_cast<uint32_t>(count));
+    storeLittleEndian<uint64_t>(bytes.data() + 16, stringsOffset);
+    storeLittleEndian<uint64_t>(bytes.data() + 24, stringsSize);
+    size_t pathOffset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char* entry = bytes.data() + carrierIndexHeaderSize + i * carrierEntrySize;
+        std::memcpy(entry, records[i].entry, carrierEntrySize);
+        storeLittleEndian<uint64_t>(entry, pathOffset);
+        storeLittleEndian<uint32_t>(entry + 8, static_cast<uint32_t>(records[i].path.size()));
+        storeLittleEndian<uint64_t>(entry + 16, records[i].fileSize);
+        storeLittleEndian<int64_t>(entry + 24, records[i].modified);
+        std::memcpy(bytes.data() + stringsOffset + pathOffset, records[i].path.data(), records[i].path.size());
+        pathOffset += records[i].path.size();
+    }
+    // Claimed entries go in front of the orders, so picks never walk past them
+    auto claimed = [&](const uint32_t number) {
+        return (loadLittleEndian<uint32_t>(records[number].entry + 12) & claimedFlag) != 0;
+    };
+    std::vector<uint32_t> order(count);
+    size_t claimedCount = 0;
+    for (unsigned bits = 1; bits <= maxBitsPerChannel; ++bits) {
+        std::iota(order.begin(), order.end(), 0u);
+        const auto unclaimed = std::stable_partition(order.begin(), order.end(), claimed);
+        claimedCount = static_cast<size_t>(unclaimed - order.begin());
+        std::stable_sort(unclaimed, order.end(), [&](const uint32_t a, const uint32_t b) {
+            return entryCapacity(records[a].entry, bits) < entryCapacity(records[b].entry, bits);
+        });
+        unsigned char* table = bytes.data() + ordersOffset + (bits - 1) * count * 4;
+        for (size_t i = 0; i < count; ++i) storeLittleEndian<uint32_t>(table + 4 * i, order[i]);
+        storeLittleEndian<uint32_t>(bytes.data() + claimedHintsOffset + 4 * (bits - 1), static_cast<uint32_t>(claimedCount));
+    }
+    storeLittleEndian<uint32_t>(bytes.data() + 12, static_cast<uint32_t>(claimedCount));
+
+    // Written next to the index and renamed over it, so readers never see half an index
+    const std::string target = indexPath(directory);
+    const std::string temporary = target + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        STEG_COUNT(SYSCALLS, 3);
+        STEG_COUNT(BYTES_WRITTEN, bytes.size());
+        if (!file.is_open() || !file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())).flush()) {
+            std::remove(temporary.c_str());
+            return {stegError::WRITE_FAILED, "Carrier index can't be written (" + temporary + ")."};
+        }
+    }
+    if (std::rename(temporary.c_str(), target.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return {stegError::WRITE_FAILED, "Carrier index can't be moved into place (" + target + ")."};
+    }
+    return {};
+}
+
+indexUpdate updateCarrierIndex(const std::string& directory, const unsigned maxOpenFiles) {
+    indexUpdate update;
+    std::vector<carrierRecord> records;
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator entries(directory, std::filesystem::directory_options::skip_permission_denied, error);
+    if (error) {
+        update.status = {stegError::CANT_OPEN_FILE, "Directory can't be read (" + directory + ")."};
+        return update;
+    }
+    for (; entries != std::filesystem::recursive_directory_iterator(); entries.increment(error)) {
+        const std::filesystem::directory_entry& entry = *entries;
+        std::error_code entryError;
+        // Hidden files include the index itself and the temporary copies of atomic writes
+        const std::string name = entry.path().filename().string();
+        if (name.empty() || name[0] == '.' || detectFileType(name) == FileType::UNKNOWN || !entry.is_regular_file(entryError)) {
+            continue;
+        }
+        carrierRecord record;
+        record.path = entry.path().lexically_relative(directory).generic_string();
+        record.fileSize = entry.file_size(entryError);
+        if (!entryError) record.modified = modificationTime(entry.last_write_time(entryError));
+        if (!entryError) records.push_back(std::move(record));
+    }
+    // A failed step leaves the iterator at the end
+    if (error) {
+        update.status = {stegError::READ_FAILED, "Directory can't be read (" + directory + ")."};
+        return update;
+    }
+    if (records.size() > UINT32_MAX) {
+        update.status = {stegError::INVALID_OPTION, "Too many images in " + directory + "."};
+        return update;
+    }
+
+    // Entries of images that didn't change since the last update are taken over, claims of all
+    mappedFile oldIndex;
+    uint32_t oldCount = 0;
+    if (oldIndex.open(indexPath(directory), false) && checkIndex(oldIndex, oldCount)) {
+        std::unordered_map<std::string, const unsigned char*> oldEntries;
+        std::string path;
+        for (uint32_t i = 0; i < oldCount; ++i) {
+            const unsigned char* entry = oldIndex.data() + carrierIndexHeaderSize + static_cast<size_t>(i) * carrierEntrySize;
+            if (entryPath(oldIndex, entry, path)) oldEntries.emplace(path, entry);
+        }
+        for (carrierRecord& record : records) {
+            const auto found = oldEntries.find(record.path);
+            if (found == oldEntries.end()) continue;
+            const unsigned char* entry = found->second;
+            if (loadLittleEndian<uint64_t>(entry + 16) == record.fileSize && loadLittleEndian<int64_t>(entry + 24) == record.modified) {
+                std::memcpy(record.entry, entry, carrierEntrySize);
+                record.known = true;
+                ++update.unchanged;
+            } else {
+                storeLittleEndian<uint32_t>(record.entry + 12, loadLittleEndian<uint32_t>(entry + 12));
+            }
+        }
+    }
+    oldIndex.close();
+
+    // The headers of new and changed images are read concurrently
+    std::counting_semaphore<> openFiles(std::max(1u, maxOpenFiles));
+    std::vector<char> valid(records.size(), 1);
+    globalThreadPool().parallelFor(records.size(), [&](const size_t i) {
+        if (records[i].known) return;
+        openFiles.acquire();
+        imageDescription description;
+        const std::string filePath = (std::filesystem::path(directory) / records[i].path).string();
+        valid[i] = describeCarrier(filePath, records[i].fileSize, description).ok();
+        openFiles.release();
+        if (valid[i]) encodeEntry(description, records[i].entry);
+    });
+    std::vector<carrierRecord> carriers;
+    carriers.reserve(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (valid[i]) carriers.push_back(std::move(records[i]));
+    }
+    update.carriers = carriers.size();
+    update.skipped = records.size() - carriers.size();
+    update.status = writeIndex(directory, carriers);
+    return update;
+}
+
+carrierPick pickCarrier(const std::string& directory, const size_t payloadBytes, const unsigned bitsPerChannel) {
+    carrierPick pick;
+    if (bitsPerChannel < 1 || bitsPerChannel > maxBitsPerChannel) {
+        pick.status = {stegError::INVALID_OPTION, "Bits per channel must be between 1 and " + std::to_string(maxBitsPerChannel) + "."};
+        return pick;
+    }
+    mappedFile index;
+    uint32_t count = 0;
+    if (!index.open(indexPath(directory), true)) {
+        pick.status = {stegError::CANT_OPEN_FILE, "No carrier index in " + directory + ", index it first."};
+        return pick;
+    }
+    if (!checkIndex(index, count)) {
+        pick.status = {stegError::INVALID_HEADER, "Carrier index of " + directory + " is damaged, index it again."};
+        return pick;
+    }
+    unsigned char* entries = index.data() + carrierIndexHeaderSize;
+    const unsigned char* order = entries + static_cast<size_t>(count) * carrierEntrySize + static_cast<size_t>(bitsPerChannel - 1) * count * 4;
+    // Null for a damaged entry number
+    auto entryAt = [&](const size_t position) -> unsigned char* {
+        const uint32_t number = loadLittleEndian<uint32_t>(order + 4 * position);
+        return number < count ? entries + static_cast<size_t>(number) * carrierEntrySize : nullptr;
+    };
+    // Every position before the hint is claimed. It only ever grows, by a compare-and-swap, so a
+    // hint that is stale or was overtaken by another process is still correct.
+    std::atomic_ref<uint32_t> claimedHint(*reinterpret_cast<uint32_t*>(index.data() + claimedHintsOffset + 4 * (bitsPerChannel - 1)));
+    const size_t sortedBegin = loadLittleEndian<uint32_t>(index.data() + 12);
+    const size_t hint = std::clamp<size_t>(claimedHint.load(std::memory_order_relaxed), sortedBegin, count);
+    auto advanceHint = [&](const size_t position) {
+        uint32_t current = claimedHint.load(std::memory_order_relaxed);
+        while (current < position && !claimedHint.compare_exchange_weak(current, static_cast<uint32_t>(position))) {}
+    };
+    // First carrier in capacity order that holds the payload, then on to the first one that's free
+    size_t low = sortedBegin;
+    size_t high = count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        const unsigned char* entry = entryAt(middle);
+        if (entry == nullptr || entryCapacity(entry, bitsPerChannel) < payloadBytes) low = middle + 1;
+        else high = middle;
+    }
+    // While the walk passed nothing but claimed entries since the hint, the hint follows it
+    bool fromHint = low <= hint;
+    for (size_t position = std::max(low, hint); position < count; ++position) {
+        unsigned char* entry = entryAt(position);
+        if (entry == nullptr) {
+            fromHint = false;
+            continue;
+        }
+        // Entries start 4-byte aligned in the mapping, the flags word is shared with other processes
+        std::atomic_ref<uint32_t> flags(*reinterpret_cast<uint32_t*>(entry + 12));
+        uint32_t expected = flags.load(std::memory_order_relaxed);
+        if ((expected & claimedFlag) != 0) {
+            if (fromHint) advanceHint(position + 1);
+            continue;
+        }
+        std::string relativePath;
+        std::error_code error;
+        std::string filePath;
+        bool usable = entryPath(index, entry, relativePath);
+        if (usable) {
+            filePath = (std::filesystem::path(directory) / relativePath).string();
+            const uint64_t fileSize = std::filesystem::file_size(filePath, error);
+            usable = !error && fileSize == loadLittleEndian<uint64_t>(entry + 16);
+        }
+        if (usable) {
+            const int64_t modified = modificationTime(std::filesystem::last_write_time(filePath, error));
+            usable = !error && modified == loadLittleEndian<int64_t>(entry + 24);
+        }
+        if (!usable) {
+            fromHint = false;
+            continue;
+        }
+        while ((expected & claimedFlag) == 0 && !flags.compare_exchange_weak(expected, expected | claimedFlag)) {}
+        // Claimed either way now, by this pick or by a concurrent one
+        if (fromHint) advanceHint(position + 1);
+        if ((expected & claimedFlag) != 0) {
+            continue;
+        }
+        pick.path = filePath;
+        pick.capacityBytes = static_cast<size_t>(entryCapacity(entry, bitsPerChannel));
+        return pick;
+    }
+    pick.status = {stegError::MESSAGE_TOO_LONG, "No unclaimed carrier in " + directory + " holds " + std::to_string(payloadBytes)
+                                                + " bytes at " + std::to_string(bitsPerChannel)
+                                                + (bitsPerChannel > 1 ? " bits" : " bit") + " per channel."};
+    return pick;
+}
@@ -0,0 +1,70 @@
+#ifndef CARRIERINDEX_HPP
+#define CARRIERINDEX_HPP
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "steganography.hpp"
+
+// Index of the carrier images in a directory (and its subdirectories), kept in a file in that
+// directory and mapped when queried, so choosing a carrier for a payload takes a binary search
+// instead of opening and parsing every image. All numbers are little-endian:
+//
+//   header (64 bytes)
+//        0     4   magic "StgI"
+//        4     4   version
+//        8     4   entry count
+//       12     4   entries claimed when the index was written, first in every order
+//       16     8   offset of the string table (image paths, relative to the directory)
+//       24     8   size of the string table
+//       32  4 * 4  for each bits per channel setting: the order position before which every
+//                  entry is claimed, advanced by picks
+//   entries (carrierEntrySize bytes each)
+//        0     8   path offset in the string table
+//        8     4   path length
+//       12     4   flags, bit 0: claimed by a pick
+//       16     8   file size
+//       24     8   modification time, nanoseconds of the file system clock
+//       32     8   data offset
+//       40     8   row stride
+//       48     4   width
+//       52     4   height (negative for a top-down BMP)
+//       56     2   bits per pixel
+//       58     1   format (imageFormat)
+//       59     1   packing (channelPacking)
+//       60     4   max channel value (Netpbm)
+//       64  8 * 4  capacity bytes at 1 to maxBitsPerChannel bits per channel
+//   for each bits per channel setting: the entry numbers (4 bytes each), the claimed ones
+//   first and the others after them sorted by capacity
+//   string table
+static constexpr const char* carrierIndexName = ".stegindex";
+static constexpr size_t carrierIndexHeaderSize = 64;
+static constexpr size_t carrierEntrySize = 64 + 8 * maxBitsPerChannel;
+
+struct indexUpdate {
+    stegStatus status;
+    size_t carriers = 0;    // images in the new index
+    size_t unchanged = 0;   // taken over from the old index without being opened
+    size_t skipped = 0;     // unsupported, invalid or truncated images
+};
+
+// Scans directory for BMP and Netpbm images and writes its index. An existing index is updated:
+// images whose size and modification time didn't change are taken over as they are, only new and
+// changed ones are opened (concurrently, at most maxOpenFiles at once) and their headers parsed.
+// Claims survive an update. The new index replaces the old one in a rename, so a pick in another
+// process still sees a complete index, although claims it makes during the update get lost.
+indexUpdate updateCarrierIndex(const std::string& directory, unsigned maxOpenFiles = 64);
+
+// Best fit query: the unclaimed carrier of the directory's index with the smallest capacity that
+// still holds payloadBytes at bitsPerChannel. It is claimed in the mapped index file with an
+// atomic compare-and-swap, so concurrent picks from any number of processes never get the same
+// carrier. Carriers that changed on disk since they were indexed are passed over. Claimed carriers
+// are skipped in O(1) from where the smallest ones start; a pick for a larger payload walks past
+// those claimed since the last update.
+struct carrierPick {
+    stegStatus status;
+    std::string path;           // directory joined with the indexed path
+    size_t capacityBytes = 0;
+};
+carrierPick pickCarrier(const std::string& directory, size_t payloadBytes, unsigned bitsPerChannel = 1);
+
+#endif //CARRIERINDEX_HPP
@@ -0,0 +1,120 @@
+#include <array>
+#include <cstring>
+#include "crc32c.hpp"
+#include "helpFunctions.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32C_TARGET_SSE42
+#else
+#define CRC32C_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+// Reflected Castagnoli polynomial
+static constexpr uint32_t castagnoli = 0x82F63B78;
+
+// Slicing-by-8 tables: tables[k][b] is the CRC of byte b followed by k zero bytes
+static constexpr std::array<std::array<uint32_t, 256>, 8> makeTables() {
+    std::array<std::array<uint32_t, 256>, 8> tables{};
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? castagnoli : 0);
+        }
+        tables[0][b] = crc;
+    }
+    for (size_t k = 1; k < 8; ++k) {
+        for (size_t b = 0; b < 256; ++b) {
+            tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+    }
+    return tables;
+}
+static constexpr std::array<std::array<uint32_t, 256>, 8> crcTables = makeTables();
+
+static uint32_t crc32cTable(const unsigned char* data, size_t size, uint32_t crc) {
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        const uint32_t low = loadLittleEndian<uint32_t>(data) ^ crc;
+        const uint32_t high = loadLittleEndian<uint32_t>(data + 4);
+        crc = crcTables[7][low & 0xFF] ^ crcTables[6][(low >> 8) & 0xFF] ^ crcTables[5][(low >> 16) & 0xFF] ^ crcTables[4][low >> 24]
+            ^ crcTables[3][high & 0xFF] ^ crcTables[2][(high >> 8) & 0xFF] ^ crcTables[1][(high >> 16) & 0xFF] ^ crcTables[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = crcTables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+CRC32C_TARGET_SSE42 static uint32_t crc32cSse42(const unsigned char* data, size_t size, const uint32_t crc) {
+    uint64_t value = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        value = _mm_crc32_u64(value, word);
+    }
+    uint32_t tail = static_cast<uint32_t>(value);
+    for (; size > 0; ++data, --size) {
+        tail = _mm_crc32_u8(tail, *data);
+    }
+    return ~tail;
+}
+static bool cpuHasSse42() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
+
+#ifdef CRC32C_ARM
+static uint32_t crc32cArm(const unsigned char* data, size_t size, uint32_t crc) {
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; ++data, --size) {
+        crc = __crc32cb(crc, *data);
+    }
+    return ~crc;
+}
+#endif
+
+using crc32cFunction = uint32_t (*)(const unsigned char* data, size_t size, uint32_t crc);
+struct crc32cImplementationEntry {
+    const char* name;
+    crc32cFunction function;
+};
+// Detected once on first use, like the LSB kernels
+static const crc32cImplementationEntry& selectCrc32c() {
+#if defined(CRC32C_X86)
+    static const crc32cImplementationEntry selected = cpuHasSse42() ? crc32cImplementationEntry{"sse4.2", crc32cSse42}
+                                                                    : crc32cImplementationEntry{"table", crc32cTable};
+#elif defined(CRC32C_ARM)
+    static const crc32cImplementationEntry selected{"armv8", crc32cArm};
+#else
+    static const crc32cImplementationEntry selected{"table", crc32cTable};
+#endif
+    return selected;
+}
+
+uint32_t crc32c(const void* data, const size_t size, const uint32_t crc) {
+    return selectCrc32c().function(static_cast<const unsigned char*>(data), size, crc);
+}
+const char* crc32cImplementation() {
+    return selectCrc32c().name;
+}
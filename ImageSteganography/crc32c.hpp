@@ -0,0 +1,13 @@
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli polynomial), the checksum of iSCSI, ext4 and the SSE4.2 crc32 instruction.
+// Pass the previous result as crc to continue over data split into several pieces.
+uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+// Implementation picked for the running CPU: "sse4.2", "armv8" or "table"
+const char* crc32cImplementation();
+
+#endif //CRC32C_HPP
@@ -1,15 +1,38 @@
 #ifndef HELPFUNCTIONS_HPP
 #define HELPFUNCTIONS_HPP
+#include <fstream>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <bit>
+#include <cstring>
 
-enum class EndianReadType {
-    USHORT,
-    UINT,
-    INT
-};
+// Decodes sizeof(T) little-endian bytes, a single load on little-endian targets
+template <typename T>
+constexpr T loadLittleEndian(const unsigned char* bytes) {
+    if constexpr (std::endian::native == std::endian::little) {
+        if (!std::is_constant_evaluated()) {
+            T value;
+            std::memcpy(&value, bytes, sizeof(T));
+            return value;
+        }
+    }
+    std::make_unsigned_t<T> value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<std::make_unsigned_t<T>>(static_cast<std::make_unsigned_t<T>>(bytes[i]) << (i * 8));
+    }
+    return static_cast<T>(value);
+}
+template <typename T>
+constexpr void storeLittleEndian(unsigned char* bytes, const T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        bytes[i] = static_cast<unsigned char>(static_cast<std::make_unsigned_t<T>>(value) >> (i * 8));
+    }
+}
 
-unsigned long long readLittleEndian(std::fstream& file, int NumberBytesToRead, EndianReadType type);
+enum class FileType { UNKNOWN, BMP, PPM };
 
-std::vector<bool> textToBits(std::string& secretMessageInText);
-std::string bitsToText(const std::vector<bool>& secretMessageInBit);
+std::string getFileExtension(const std::string& filename);
+FileType detectFileType(const std::string& path);
 
 #endif //HELPFUNCTIONS_HPP
@@ -0,0 +1,311 @@
+#include "ioQueue.hpp"
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <unistd.h>
+#include "stegStats.hpp"
+
+#if defined(__linux__) && defined(STEG_IO_URING) && __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define IO_QUEUE_URING
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#endif
+#endif
+
+// Largest single read or write handed to the kernel, larger ones complete in part
+static constexpr size_t maxTransfer = size_t(1) << 30;
+// Requests in flight at most, whatever the depth asked for
+static constexpr unsigned maxDepth = 4096;
+// Threads of the THREADS backend, most of them blocked in the kernel at any time
+static constexpr unsigned maxIoThreads = 16;
+
+struct ioQueue::threadBackend {
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable wakeWaiter;
+    std::deque<ioRequest> requests;
+    std::vector<ioCompletion> completions;
+    std::vector<std::thread> workers;
+    size_t pending = 0;
+    bool stopping = false;
+
+    explicit threadBackend(const unsigned threadCount) {
+        for (unsigned i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this] { serve(); });
+        }
+    }
+    ~threadBackend() {
+        {
+            const std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wakeWorkers.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+    void serve() {
+        while (true) {
+            ioRequest request;
+            {
+                std::unique_lock lock(mutex);
+                wakeWorkers.wait(lock, [&] { return stopping || !requests.empty(); });
+                if (requests.empty()) return;
+                request = requests.front();
+                requests.pop_front();
+            }
+            const size_t size = std::min(request.size, maxTransfer);
+            const off_t offset = static_cast<off_t>(request.offset);
+            const ssize_t done = request.write ? ::pwrite(request.file, request.buffer, size, offset)
+                                               : ::pread(request.file, request.buffer, size, offset);
+            STEG_COUNT(SYSCALLS, 1);
+            const long long result = done < 0 ? -static_cast<long long>(errno) : static_cast<long long>(done);
+            {
+                const std::lock_guard lock(mutex);
+                completions.push_back({request.tag, result});
+            }
+            wakeWaiter.notify_one();
+        }
+    }
+};
+
+#ifdef IO_QUEUE_URING
+// The rings are shared with the kernel, which reads the submission tail and the completion head
+// and writes the other two
+static unsigned loadShared(unsigned* word) {
+    return std::atomic_ref<unsigned>(*word).load(std::memory_order_acquire);
+}
+static void storeShared(unsigned* word, const unsigned value) {
+    std::atomic_ref<unsigned>(*word).store(value, std::memory_order_release);
+}
+
+// io_uring through its system calls, so no liburing is needed
+struct ioQueue::ringBackend {
+    int ringFile = -1;
+    unsigned entries = 0;
+    unsigned char* submissionRing = nullptr;
+    size_t submissionRingSize = 0;
+    unsigned char* completionRing = nullptr;
+    size_t completionRingSize = 0;
+    io_uring_sqe* submissions = nullptr;
+    size_t submissionsSize = 0;
+    unsigned* submissionHead = nullptr;
+    unsigned* submissionTail = nullptr;
+    unsigned* submissionMask = nullptr;
+    unsigned* submissionArray = nullptr;
+    unsigned* completionHead = nullptr;
+    unsigned* completionTail = nullptr;
+    unsigned* completionMask = nullptr;
+    io_uring_cqe* completions = nullptr;
+
+    std::deque<ioRequest> waiting;   // not in the ring yet
+    unsigned inRing = 0;             // placed in the ring and not completed
+    unsigned unsent = 0;             // placed in the ring and not handed to the kernel
+    std::unordered_multiset<uint64_t> ringTags;  // tags of the requests in the ring
+    int brokenWith = 0;              // errno of a failed io_uring_enter, after which the ring isn't used
+
+    ~ringBackend() {
+        if (submissions != nullptr) munmap(submissions, submissionsSize);
+        if (completionRing != nullptr && completionRing != submissionRing) munmap(completionRing, completionRingSize);
+        if (submissionRing != nullptr) munmap(submissionRing, submissionRingSize);
+        if (ringFile >= 0) ::close(ringFile);
+    }
+    // Fails on kernels without io_uring, or without plain reads and writes in it (before 5.6),
+    // and where it is forbidden (seccomp, io_uring_disabled)
+    bool open(const unsigned depth) {
+        io_uring_params parameters {};
+        ringFile = static_cast<int>(syscall(__NR_io_uring_setup, depth, &parameters));
+        if (ringFile < 0) {
+            return false;
+        }
+        std::vector<unsigned char> probeBytes(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeBytes.data());
+        if (syscall(__NR_io_uring_register, ringFile, IORING_REGISTER_PROBE, probe, 256) < 0 || probe->last_op < IORING_OP_WRITE
+            || (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) == 0
+            || (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED) == 0) {
+            return false;
+        }
+        entries = parameters.sq_entries;
+        submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+        completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMapping = (parameters.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping) {
+            submissionRingSize = completionRingSize = std::max(submissionRingSize, completionRingSize);
+        }
+        void* mapping = mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFile, IORING_OFF_SQ_RING);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        submissionRing = static_cast<unsigned char*>(mapping);
+        if (singleMapping) {
+            completionRing = submissionRing;
+        } else {
+            mapping = mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFile, IORING_OFF_CQ_RING);
+            if (mapping == MAP_FAILED) {
+                return false;
+            }
+            completionRing = static_cast<unsigned char*>(mapping);
+        }
+        submissionsSize = parameters.sq_entries * sizeof(io_uring_sqe);
+        mapping = mmap(nullptr, submissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFile, IORING_OFF_SQES);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        submissions = static_cast<io_uring_sqe*>(mapping);
+        submissionHead = reinterpret_cast<unsigned*>(submissionRing + parameters.sq_off.head);
+        submissionTail = reinterpret_cast<unsigned*>(submissionRing + parameters.sq_off.tail);
+        submissionMask = reinterpret_cast<unsigned*>(submissionRing + parameters.sq_off.ring_mask);
+        submissionArray = reinterpret_cast<unsigned*>(submissionRing + parameters.sq_off.array);
+        completionHead = reinterpret_cast<unsigned*>(completionRing + parameters.cq_off.head);
+        completionTail = reinterpret_cast<unsigned*>(completionRing + parameters.cq_off.tail);
+        completionMask = reinterpret_cast<unsigned*>(completionRing + parameters.cq_off.ring_mask);
+        completions = reinterpret_cast<io_uring_cqe*>(completionRing + parameters.cq_off.cqes);
+        return true;
+    }
+    // Moves waiting requests into free ring slots. The completion ring holds twice as many
+    // entries, so it can't overflow with at most entries requests in flight.
+    void fill() {
+        unsigned tail = *submissionTail;
+        while (!waiting.empty() && inRing < entries && tail - loadShared(submissionHead) < entries) {
+            const ioRequest& request = waiting.front();
+            const unsigned slot = tail & *submissionMask;
+            io_uring_sqe& entry = submissions[slot];
+            std::memset(&entry, 0, sizeof(entry));
+            entry.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+            entry.fd = request.file;
+            entry.off = request.offset;
+            entry.addr = reinterpret_cast<uint64_t>(request.buffer);
+            entry.len = static_cast<uint32_t>(std::min(request.size, maxTransfer));
+            entry.user_data = request.tag;
+            submissionArray[slot] = slot;
+            ringTags.insert(request.tag);
+            ++tail;
+            ++inRing;
+            ++unsent;
+            waiting.pop_front();
+        }
+        storeShared(submissionTail, tail);
+    }
+    // Completes every request with -error, in the ring or not
+    void failAll(const int error, std::vector<ioCompletion>& results) {
+        for (const uint64_t tag : ringTags) {
+            results.push_back({tag, -static_cast<long long>(error)});
+        }
+        for (const ioRequest& request : waiting) {
+            results.push_back({request.tag, -static_cast<long long>(error)});
+        }
+        ringTags.clear();
+        waiting.clear();
+        inRing = 0;
+        unsent = 0;
+    }
+    void wait(std::vector<ioCompletion>& results) {
+        if (brokenWith != 0) {
+            failAll(brokenWith, results);
+            return;
+        }
+        fill();
+        if (inRing == 0) {
+            return;
+        }
+        int error = 0;
+        while (true) {
+            const long sent = syscall(__NR_io_uring_enter, ringFile, unsent, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            STEG_COUNT(SYSCALLS, 1);
+            if (sent >= 0) {
+                unsent -= std::min(unsent, static_cast<unsigned>(sent));
+                break;
+            }
+            // EAGAIN and EBUSY: the kernel is short of memory or completion room, reap and retry
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                error = errno;
+                break;
+            }
+            if (errno != EINTR && loadShared(completionTail) != *completionHead) {
+                break;
+            }
+        }
+        unsigned head = *completionHead;
+        const unsigned tail = loadShared(completionTail);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& completion = completions[head & *completionMask];
+            results.push_back({completion.user_data, static_cast<long long>(completion.res)});
+            ringTags.erase(ringTags.find(completion.user_data));
+            --inRing;
+        }
+        storeShared(completionHead, head);
+        // Any other error leaves nothing to wait for (a bad ring or a ring being torn down), and
+        // returning without a completion would have the caller wait again forever. The requests
+        // still in the ring and all later ones fail instead, so their jobs end with an error.
+        if (error != 0) {
+            brokenWith = error;
+            failAll(error, results);
+        }
+    }
+};
+#else
+struct ioQueue::ringBackend {};
+#endif
+
+ioQueue::ioQueue(const ioBackend backend, unsigned depth) {
+    depth = std::clamp(depth, 1u, maxDepth);
+#ifdef IO_QUEUE_URING
+    if (backend == ioBackend::IO_URING) {
+        auto uring = std::make_unique<ringBackend>();
+        if (uring->open(depth)) {
+            ring = std::move(uring);
+            return;
+        }
+    }
+#else
+    (void)backend;
+#endif
+    threads = std::make_unique<threadBackend>(std::min(depth, maxIoThreads));
+}
+ioQueue::~ioQueue() = default;
+
+void ioQueue::submit(const ioRequest& request) {
+#ifdef IO_QUEUE_URING
+    if (ring) {
+        ring->waiting.push_back(request);
+        return;
+    }
+#endif
+    {
+        const std::lock_guard lock(threads->mutex);
+        threads->requests.push_back(request);
+        ++threads->pending;
+    }
+    threads->wakeWorkers.notify_one();
+}
+size_t ioQueue::pending() const {
+#ifdef IO_QUEUE_URING
+    if (ring) {
+        return ring->waiting.size() + ring->inRing;
+    }
+#endif
+    const std::lock_guard lock(threads->mutex);
+    return threads->pending;
+}
+void ioQueue::wait(std::vector<ioCompletion>& completions) {
+#ifdef IO_QUEUE_URING
+    if (ring) {
+        ring->wait(completions);
+        return;
+    }
+#endif
+    std::unique_lock lock(threads->mutex);
+    threads->wakeWaiter.wait(lock, [&] { return threads->pending == 0 || !threads->completions.empty(); });
+    threads->pending -= threads->completions.size();
+    completions.insert(completions.end(), threads->completions.begin(), threads->completions.end());
+    threads->completions.clear();
+}
+
+#endif
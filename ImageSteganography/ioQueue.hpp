@@ -0,0 +1,54 @@
+#ifndef IOQUEUE_HPP
+#define IOQUEUE_HPP
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// How image files are read and written in bulk (batches):
+//  - MAPPED: every image is mapped and processed by a thread of the pool (pixelAccess.hpp), the
+//    I/O happens in page faults on that thread
+//  - IO_URING: reads and writes of many images are queued to the kernel at once through an
+//    io_uring, so the device always has work; falls back to THREADS where the kernel refuses one
+//  - THREADS: the same queue, served by threads doing blocking pread and pwrite calls
+// The queued backends are only available on POSIX systems.
+enum class ioBackend { MAPPED, IO_URING, THREADS };
+
+struct ioRequest {
+    int file = -1;
+    uint64_t offset = 0;
+    unsigned char* buffer = nullptr;
+    size_t size = 0;           // may be served in part, the completion tells how much
+    bool write = false;
+    uint64_t tag = 0;          // handed back with the completion
+};
+struct ioCompletion {
+    uint64_t tag = 0;
+    long long result = 0;      // bytes transferred, or -errno
+};
+
+// Queue of positioned reads and writes served asynchronously, completions in any order.
+// Not thread-safe: one thread submits and waits, the buffers stay alive until completion.
+struct ioQueue {
+private:
+    struct ringBackend;
+    struct threadBackend;
+    std::unique_ptr<ringBackend> ring;
+    std::unique_ptr<threadBackend> threads;
+public:
+    // At most depth requests are in flight, the others wait in the queue. IO_URING falls back to
+    // THREADS when no io_uring can be set up; MAPPED isn't a queue and is taken as THREADS.
+    ioQueue(ioBackend backend, unsigned depth);
+    ~ioQueue();
+    ioQueue(const ioQueue&) = delete;
+    ioQueue& operator=(const ioQueue&) = delete;
+
+    ioBackend backend() const { return ring ? ioBackend::IO_URING : ioBackend::THREADS; }
+    void submit(const ioRequest& request);
+    // Requests submitted and not completed yet
+    size_t pending() const;
+    // Sends the submitted requests and appends at least one completion, unless none is pending
+    void wait(std::vector<ioCompletion>& completions);
+};
+
+#endif //IOQUEUE_HPP
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <atomic>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <string>
+#include <vector>
+#include "keyedScatter.hpp"
+#include "threadPool.hpp"
+
+// Below this many channels per band the work isn't worth handing to other threads
+static constexpr size_t minimumScatterBand = 64 * 1024;
+// Average bucket size when sorting the positions of a frame
+static constexpr size_t positionsPerBucket = 16;
+
+static uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// High and low half of the 128-bit product folded together, the round function of wyhash
+static uint64_t foldedProduct(const uint64_t a, const uint64_t b) {
+#ifdef _MSC_VER
+    return __umulh(a, b) ^ (a * b);
+#else
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product >> 64) ^ static_cast<uint64_t>(product);
+#endif
+}
+static uint64_t lowMask(const unsigned bits) {
+    return (uint64_t(1) << bits) - 1;
+}
+
+scatterPermutation::scatterPermutation(const std::string& key, const uint64_t count) : channelCount(count) {
+    // The smallest power of two holding every channel, so cycle walking takes fewer than 2 steps
+    // on average
+    unsigned bits = 2;
+    while (bits < 64 && (uint64_t(1) << bits) < channelCount) {
+        ++bits;
+    }
+    lowBits = bits / 2;
+    highBits = bits - lowBits;
+    // FNV-1a spreads the key text over 64 bits, SplitMix64 derives the round keys from it
+    uint64_t state = 0xCBF29CE484222325ull;
+    for (const char c : key) {
+        state = (state ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+    }
+    state ^= channelCount;
+    for (unsigned round = 0; round < scatterRounds; ++round) {
+        roundKeys[round] = splitMix64(state);
+        roundMultipliers[round] = splitMix64(state);
+        roundMasks[round] = lowMask(round % 2 == 0 ? highBits : lowBits);
+    }
+}
+// Every round replaces one half with itself xor a hash of the other and swaps them. With
+// unbalanced halves the widths swap as well; an even round count restores them.
+uint64_t scatterPermutation::permute(const uint64_t value) const {
+    uint64_t left = value >> lowBits;
+    uint64_t right = value & lowMask(lowBits);
+    for (unsigned round = 0; round < scatterRounds; ++round) {
+        const uint64_t next = (left ^ foldedProduct(right ^ roundKeys[round], roundMultipliers[round])) & roundMasks[round];
+        left = right;
+        right = next;
+    }
+    return (left << lowBits) | right;
+}
+uint64_t scatterPermutation::unpermute(const uint64_t value) const {
+    uint64_t left = value >> lowBits;
+    uint64_t right = value & lowMask(lowBits);
+    for (unsigned round = scatterRounds; round-- > 0;) {
+        const uint64_t previous = (right ^ foldedProduct(left ^ roundKeys[round], roundMultipliers[round])) & roundMasks[round];
+        right = left;
+        left = previous;
+    }
+    return (left << lowBits) | right;
+}
+// Values past the channel count are permuted again until one lands inside; following the cycle of
+// the power of two permutation keeps the result a permutation of the channels. All values take a
+// first step in a loop without branches, so independent steps overlap; the few left outside are
+// collected and stepped again, instead of a hard to predict branch per value.
+template <bool backwards>
+void scatterPermutation::walk(uint64_t* values, const size_t count) const {
+    uint16_t pending[scatterBatch];
+    size_t pendingCount = 0;
+    for (size_t k = 0; k < count; ++k) {
+        values[k] = backwards ? unpermute(values[k]) : permute(values[k]);
+        pending[pendingCount] = static_cast<uint16_t>(k);
+        pendingCount += values[k] >= channelCount;
+    }
+    while (pendingCount > 0) {
+        size_t stillPending = 0;
+        for (size_t j = 0; j < pendingCount; ++j) {
+            uint64_t& value = values[pending[j]];
+            value = backwards ? unpermute(value) : permute(value);
+            pending[stillPending] = pending[j];
+            stillPending += value >= channelCount;
+        }
+        pendingCount = stillPending;
+    }
+}
+void scatterPermutation::forward(const uint64_t first, const size_t count, uint64_t* positions) const {
+    for (size_t k = 0; k < count; ++k) {
+        positions[k] = first + k;
+    }
+    walk<false>(positions, count);
+}
+void scatterPermutation::inverse(const uint64_t* positions, const size_t count, uint64_t* indices) const {
+    std::copy(positions, positions + count, indices);
+    walk<true>(indices, count);
+}
+
+scatterPlan::scatterPlan(const scatterPermutation& framePermutation, const size_t channels)
+    : permutation(framePermutation), frameChannels(channels), visitsAll(channels > framePermutation.channels() / scatterListShare) {
+    if (visitsAll || frameChannels == 0) {
+        return;
+    }
+    threadPool& pool = globalThreadPool();
+    const size_t bandCount = std::max<size_t>(1, std::min<size_t>(pool.size() * 4, frameChannels / minimumScatterBand));
+    std::vector<uint64_t> unsorted(frameChannels);
+    const size_t bandSize = (frameChannels + bandCount - 1) / bandCount;
+    pool.parallelFor(bandCount, [&](const size_t band) {
+        const size_t end = std::min(frameChannels, (band + 1) * bandSize);
+        for (size_t i = band * bandSize; i < end; i += scatterBatch) {
+            permutation.forward(i, std::min(scatterBatch, end - i), unsorted.data() + i);
+        }
+    });
+    // Positions are spread evenly over the channels, so bucketing them by their high bits leaves
+    // a handful per bucket to sort
+    unsigned bucketShift = 0;
+    while (((permutation.channels() - 1) >> bucketShift) >= frameChannels / positionsPerBucket) {
+        ++bucketShift;
+    }
+    const size_t bucketCount = static_cast<size_t>((permutation.channels() - 1) >> bucketShift) + 1;
+    std::vector<size_t> bucketStart(bucketCount + 1, 0);
+    for (const uint64_t position : unsorted) {
+        ++bucketStart[(position >> bucketShift) + 1];
+    }
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+        bucketStart[bucket + 1] += bucketStart[bucket];
+    }
+    positions.resize(frameChannels);
+    std::vector<size_t> bucketEnd(bucketStart.begin(), bucketStart.end() - 1);
+    for (const uint64_t position : unsorted) {
+        positions[bucketEnd[position >> bucketShift]++] = position;
+    }
+    const size_t bandBuckets = (bucketCount + bandCount - 1) / bandCount;
+    pool.parallelFor((bucketCount + bandBuckets - 1) / bandBuckets, [&](const size_t band) {
+        const size_t end = std::min(bucketCount, (band + 1) * bandBuckets);
+        for (size_t bucket = band * bandBuckets; bucket < end; ++bucket) {
+            std::sort(positions.begin() + static_cast<std::ptrdiff_t>(bucketStart[bucket]),
+                      positions.begin() + static_cast<std::ptrdiff_t>(bucketStart[bucket + 1]));
+        }
+    });
+}
+std::vector<rowRun> scatterPlan::rowRuns(const size_t rowChannels, const size_t rows, const size_t gapRows, const size_t maxRows) const {
+    std::vector<rowRun> runs;
+    if (rowChannels == 0 || frameChannels == 0) {
+        return runs;
+    }
+    if (visitsAll) {
+        for (size_t row = 0; row < rows; row += maxRows) {
+            runs.push_back({row, std::min(maxRows, rows - row)});
+        }
+        return runs;
+    }
+    for (const uint64_t position : positions) {
+        const size_t row = static_cast<size_t>(position / rowChannels);
+        if (!runs.empty() && row < runs.back().firstRow + runs.back().rows) {
+            continue;
+        }
+        if (!runs.empty() && row - (runs.back().firstRow + runs.back().rows) <= gapRows && row - runs.back().firstRow < maxRows) {
+            runs.back().rows = row + 1 - runs.back().firstRow;
+        } else {
+            runs.push_back({row, 1});
+        }
+    }
+    return runs;
+}
+
+// Calls visit(channel, frame channel index) for every frame channel inside window, in ascending
+// position order within a band, bands in parallel. Returns the sum of what visit returned.
+template <typename visitor>
+static size_t visitScatteredChannels(const pixelView& window, const size_t firstRow, const scatterPlan& plan, visitor&& visit) {
+    const size_t rowChannels = window.rowChannels();
+    if (window.rows == 0 || rowChannels == 0 || plan.frameChannels == 0) {
+        return 0;
+    }
+    const uint64_t windowBegin = static_cast<uint64_t>(firstRow) * rowChannels;
+    const uint64_t windowEnd = windowBegin + static_cast<uint64_t>(window.rows) * rowChannels;
+    threadPool& pool = globalThreadPool();
+
+    if (!plan.visitsAll) {
+        const size_t first = static_cast<size_t>(std::lower_bound(plan.positions.begin(), plan.positions.end(), windowBegin) - plan.positions.begin());
+        const size_t last = static_cast<size_t>(std::lower_bound(plan.positions.begin(), plan.positions.end(), windowEnd) - plan.positions.begin());
+        auto visitRange = [&](const size_t begin, const size_t end) {
+            uint64_t indices[scatterBatch];
+            size_t sum = 0;
+            for (size_t k = begin; k < end; k += scatterBatch) {
+                const size_t count = std::min(scatterBatch, end - k);
+                plan.permutation.inverse(plan.positions.data() + k, count, indices);
+                for (size_t j = 0; j < count; ++j) {
+                    const uint64_t offset = plan.positions[k + j] - windowBegin;
+                    sum += visit(window.row(static_cast<size_t>(offset / rowChannels))[window.channelOffset(static_cast<size_t>(offset % rowChannels))], indices[j]);
+                }
+            }
+            return sum;
+        };
+        const size_t bandCount = std::min<size_t>(pool.size() * 4, (last - first) / minimumScatterBand);
+        if (bandCount < 2) {
+            return visitRange(first, last);
+        }
+        const size_t bandSize = (last - first + bandCount - 1) / bandCount;
+        std::vector<size_t> sums(bandCount, 0);
+        pool.parallelFor(bandCount, [&](const size_t band) {
+            sums[band] = visitRange(std::min(last, first + band * bandSize), std::min(last, first + (band + 1) * bandSize));
+        });
+        size_t sum = 0;
+        for (const size_t bandSum : sums) sum += bandSum;
+        return sum;
+    }
+
+    auto visitRows = [&](const size_t beginRow, const size_t endRow) {
+        uint64_t positions[scatterBatch];
+        uint64_t indices[scatterBatch];
+        uint16_t inFrame[scatterBatch];
+        size_t sum = 0;
+        for (size_t y = beginRow; y < endRow; ++y) {
+            unsigned char* row = window.row(y);
+            const uint64_t rowStart = windowBegin + static_cast<uint64_t>(y) * rowChannels;
+            for (size_t x = 0; x < rowChannels; x += scatterBatch) {
+                const size_t count = std::min(scatterBatch, rowChannels - x);
+                for (size_t j = 0; j < count; ++j) {
+                    positions[j] = rowStart + x + j;
+                }
+                plan.permutation.inverse(positions, count, indices);
+                // Collected first: whether a channel belongs to the frame is a coin flip to the
+                // branch predictor
+                size_t frameCount = 0;
+                for (size_t j = 0; j < count; ++j) {
+                    inFrame[frameCount] = static_cast<uint16_t>(j);
+                    frameCount += indices[j] < plan.frameChannels;
+                }
+                for (size_t j = 0; j < frameCount; ++j) {
+                    sum += visit(row[window.channelOffset(x + inFrame[j])], indices[inFrame[j]]);
+                }
+            }
+        }
+        return sum;
+    };
+    const size_t bandCount = std::min<size_t>(pool.size() * 4, window.rows * rowChannels / minimumScatterBand);
+    if (bandCount < 2) {
+        return visitRows(0, window.rows);
+    }
+    const size_t bandRows = (window.rows + bandCount - 1) / bandCount;
+    const size_t bands = (window.rows + bandRows - 1) / bandRows;
+    std::vector<size_t> sums(bands, 0);
+    pool.parallelFor(bands, [&](const size_t band) {
+        sums[band] = visitRows(band * bandRows, std::min(window.rows, (band + 1) * bandRows));
+    });
+    size_t sum = 0;
+    for (const size_t bandSum : sums) sum += bandSum;
+    return sum;
+}
+
+size_t embedScatteredRows(const pixelView& window, const size_t firstRow, const std::string& frame, const unsigned bitsPerChannel,
+                          const scatterPlan& plan, const bool deltaWrite) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(frame.data());
+    const size_t totalBits = frame.size() * 8;
+    const unsigned mask = (1u << bitsPerChannel) - 1;
+    return visitScatteredChannels(window, firstRow, plan, [&](unsigned char& channel, const uint64_t index) -> size_t {
+        const size_t bit = static_cast<size_t>(index) * bitsPerChannel;
+        const size_t byte = bit >> 3;
+        // At most 11 bits from the first payload byte on, bits past the end of the frame read as 0
+        const unsigned word = (static_cast<unsigned>(bytes[byte]) << 8) | (byte + 1 < frame.size() ? bytes[byte + 1] : 0);
+        const unsigned value = (word >> (16 - (bit & 7) - bitsPerChannel)) & mask;
+        // The last channel may get fewer bits than it can hold, its remaining low bits are kept
+        const unsigned unused = static_cast<unsigned>(bitsPerChannel - std::min<size_t>(bitsPerChannel, totalBits - bit));
+        const unsigned fieldMask = mask >> unused << unused;
+        const unsigned char updated = static_cast<unsigned char>((channel & ~fieldMask) | (value & fieldMask));
+        if (deltaWrite && updated == channel) {
+            return 0;
+        }
+        channel = updated;
+        return 1;
+    });
+}
+void extractScatteredRows(const pixelView& window, const size_t firstRow, std::string& frame, const unsigned bitsPerChannel,
+                          const scatterPlan& plan) {
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(frame.data());
+    const size_t totalBits = frame.size() * 8;
+    visitScatteredChannels(window, firstRow, plan, [&](unsigned char& channel, const uint64_t index) -> size_t {
+        const size_t bit = static_cast<size_t>(index) * bitsPerChannel;
+        const unsigned count = static_cast<unsigned>(std::min<size_t>(bitsPerChannel, totalBits - bit));
+        const unsigned value = (channel & ((1u << bitsPerChannel) - 1)) >> (bitsPerChannel - count);
+        // Channels of other bands may share the payload byte, bits are only ever set
+        const unsigned word = value << (16 - (bit & 7) - count);
+        std::atomic_ref<unsigned char>(bytes[bit >> 3]).fetch_or(static_cast<unsigned char>(word >> 8), std::memory_order_relaxed);
+        if ((word & 0xFF) != 0) {
+            std::atomic_ref<unsigned char>(bytes[(bit >> 3) + 1]).fetch_or(static_cast<unsigned char>(word & 0xFF), std::memory_order_relaxed);
+        }
+        return 0;
+    });
+}
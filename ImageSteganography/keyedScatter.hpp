@@ -0,0 +1,73 @@
+#ifndef KEYEDSCATTER_HPP
+#define KEYEDSCATTER_HPP
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "pixelAccess.hpp"
+
+// With a key, a frame isn't embedded from the first channel on but spread over the whole image:
+// frame channel i goes to image channel forward(i). The permutation is a keyed Feistel network
+// over the bits of the channel numbers, with multiply-fold rounds keyed through SplitMix64 and
+// cycle-walked down to the channel count, so any position is computed in O(1) in either direction and no table is ever built.
+// It hides where the payload is; it doesn't encrypt it.
+static constexpr unsigned scatterRounds = 4;   // even
+// Most positions are computed this many at a time
+static constexpr size_t scatterBatch = 256;
+
+struct scatterPermutation {
+private:
+    uint64_t channelCount;
+    unsigned highBits;   // Feistel halves, unbalanced for an odd bit count
+    unsigned lowBits;
+    uint64_t roundKeys[scatterRounds];
+    uint64_t roundMultipliers[scatterRounds];
+    uint64_t roundMasks[scatterRounds];
+
+    uint64_t permute(uint64_t value) const;
+    uint64_t unpermute(uint64_t value) const;
+    template <bool backwards>
+    void walk(uint64_t* values, size_t count) const;
+public:
+    // The same key gives unrelated orders for images with different channel counts
+    scatterPermutation(const std::string& key, uint64_t channelCount);
+    uint64_t channels() const { return channelCount; }
+    // Image channels of frame channels first to first + count - 1, count up to scatterBatch
+    void forward(uint64_t first, size_t count, uint64_t* positions) const;
+    // Frame channels stored in the image channels at positions, count up to scatterBatch
+    void inverse(const uint64_t* positions, size_t count, uint64_t* indices) const;
+};
+
+struct rowRun {
+    size_t firstRow;
+    size_t rows;
+};
+
+// The image channels a frame occupies, visited in ascending order so mapped pages are faulted in
+// and file blocks are read front to back. Frames up to 1/scatterListShare of the image keep the
+// sorted positions of their channels; larger ones visit every channel and keep those the inverse
+// permutation maps into the frame, which needs no memory at all.
+static constexpr uint64_t scatterListShare = 8;
+
+struct scatterPlan {
+    scatterPermutation permutation;
+    size_t frameChannels;
+    bool visitsAll;
+    std::vector<uint64_t> positions;   // sorted, empty when visitsAll
+
+    scatterPlan(const scatterPermutation& permutation, size_t frameChannels);
+    // Runs of the rows (rowChannels channels each, rows in total) holding frame channels. Runs at
+    // most gapRows apart are merged; none is longer than maxRows.
+    std::vector<rowRun> rowRuns(size_t rowChannels, size_t rows, size_t gapRows, size_t maxRows) const;
+};
+
+// Embeds the frame channels of plan that lie in window, a view over the image rows from firstRow
+// on, with bitsPerChannel bits each. With deltaWrite a channel is only stored to when its value
+// changes. Returns the number of channels stored to.
+size_t embedScatteredRows(const pixelView& window, size_t firstRow, const std::string& frame, unsigned bitsPerChannel,
+                          const scatterPlan& plan, bool deltaWrite);
+// Reads them back into frame, which the caller sizes and fills with zeros
+void extractScatteredRows(const pixelView& window, size_t firstRow, std::string& frame, unsigned bitsPerChannel,
+                          const scatterPlan& plan);
+
+#endif //KEYEDSCATTER_HPP
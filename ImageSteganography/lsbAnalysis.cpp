@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include "lsbAnalysis.hpp"
+#include "lsbKernels.hpp"
+#include "ppmProcessor.hpp"
+#include "steganography.hpp"
+#include "stegStats.hpp"
+
+// Pixel bytes read from a file at a time
+static constexpr size_t analysisBlockSize = 1024 * 1024;
+// Colors told apart; pixels with more values are analyzed as one run of channels
+static constexpr unsigned maxColorChannels = 4;
+// Value pairs counted fewer times than this say too little for the chi-square test
+static constexpr uint64_t minPairCount = 10;
+// Consecutive values are counted in different tables, so runs of equal values don't wait on one counter
+static constexpr size_t histogramTables = 4;
+
+// Regularized upper incomplete gamma function Q(a, x): series below a + 1, continued fraction above
+static double upperGamma(const double a, const double x) {
+    if (x <= 0) {
+        return 1.0;
+    }
+    const double scale = std::exp(-x + a * std::log(x) - std::lgamma(a));
+    if (x < a + 1) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < 1000 && term > sum * 1e-15; ++n) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return std::clamp(1.0 - sum * scale, 0.0, 1.0);
+    }
+    constexpr double tiny = 1e-300;
+    double b = x + 1 - a;
+    double c = 1.0 / tiny;
+    double d = 1.0 / b;
+    double fraction = d;
+    for (int n = 1; n < 1000; ++n) {
+        const double an = -n * (n - a);
+        b += 2;
+        d = an * d + b;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        const double step = d * c;
+        fraction *= step;
+        if (std::fabs(step - 1.0) < 1e-15) break;
+    }
+    return std::clamp(scale * fraction, 0.0, 1.0);
+}
+
+// Chi-square statistic of value pair counts, summed over several histograms
+struct chiSquareSum {
+    double chiSquare = 0;
+    double degreesOfFreedom = 0;
+
+    void add(const uint64_t* histogram) {
+        double sum = 0;
+        size_t pairs = 0;
+        for (size_t value = 0; value < 256; value += 2) {
+            const uint64_t count = histogram[value] + histogram[value + 1];
+            if (count < minPairCount) continue;
+            const double expected = static_cast<double>(count) / 2;
+            const double deviation = static_cast<double>(histogram[value]) - expected;
+            sum += deviation * deviation / expected;
+            ++pairs;
+        }
+        if (pairs > 1) {
+            chiSquare += sum;
+            degreesOfFreedom += static_cast<double>(pairs - 1);
+        }
+    }
+    // Probability of pairs at least this even by chance
+    double probability() const {
+        return degreesOfFreedom > 0 ? upperGamma(degreesOfFreedom / 2, chiSquare / 2) : 0.0;
+    }
+};
+
+// Share of changed LSBs from the RS counts: with d the regular minus the singular groups, the
+// counts for the image (d0, dn0 for the shifted flip) and for it with every LSB flipped (d1, dn1)
+// give 2(d1 + d0)z^2 + (dn0 - dn1 - d1 - 3d0)z + d0 - dn0 = 0, and the share is z / (z - 1/2)
+// for the root z of smaller magnitude.
+static double rsEstimate(const uint64_t* counts) {
+    const double d0 = static_cast<double>(counts[0]) - static_cast<double>(counts[1]);
+    const double dn0 = static_cast<double>(counts[2]) - static_cast<double>(counts[3]);
+    const double d1 = static_cast<double>(counts[4]) - static_cast<double>(counts[5]);
+    const double dn1 = static_cast<double>(counts[6]) - static_cast<double>(counts[7]);
+    const double a = 2 * (d1 + d0);
+    const double b = dn0 - dn1 - d1 - 3 * d0;
+    const double c = d0 - dn0;
+    double z;
+    if (a == 0) {
+        if (b == 0) return 0.0;
+        z = -c / b;
+    } else {
+        const double root = std::sqrt(std::max(0.0, b * b - 4 * a * c));
+        const double z1 = (-b + root) / (2 * a);
+        const double z2 = (-b - root) / (2 * a);
+        z = std::fabs(z1) < std::fabs(z2) ? z1 : z2;
+    }
+    const double share = z / (z - 0.5);
+    return std::isfinite(share) ? std::clamp(share, 0.0, 1.0) : 0.0;
+}
+
+struct bandCounts {
+    uint64_t histogram[maxColorChannels][256] = {};
+    uint64_t rs[maxColorChannels][rsCounters] = {};
+};
+
+// Collects the counts of the rows handed to it, in storage order
+struct analysisScan {
+private:
+    const lsbKernels& kernels;
+    size_t rows;
+    unsigned colors;
+    size_t pixelBytes;    // distance between two values of one color
+    size_t sampleBytes;   // of which the last one is analyzed
+    size_t pixels;
+    std::vector<bandCounts> bands;
+    std::vector<unsigned char> plane;
+    // Value counts of the band being scanned, histogramTables tables per color
+    std::vector<uint64_t> tables;
+    size_t tableBand = 0;
+
+    void flushTables() {
+        for (unsigned color = 0; color < colors; ++color) {
+            uint64_t* histogram = bands[tableBand].histogram[color];
+            for (size_t table = 0; table < histogramTables; ++table) {
+                uint64_t* counts = tables.data() + (color * histogramTables + table) * 256;
+                for (size_t value = 0; value < 256; ++value) histogram[value] += counts[value];
+                std::fill(counts, counts + 256, 0);
+            }
+        }
+    }
+public:
+    analysisScan(const pixelLayout& layout, unsigned colorChannels) : kernels(selectLsbKernels()), rows(layout.rows) {
+        // The alpha byte of BGRA pixels carries no payload
+        if (layout.packing == channelPacking::BGRA) colorChannels = 3;
+        colors = colorChannels >= 1 && colorChannels <= maxColorChannels ? colorChannels : 1;
+        sampleBytes = layout.packing == channelPacking::SAMPLE16 ? 2 : 1;
+        pixelBytes = layout.packing == channelPacking::BGRA ? 4 : colors * sampleBytes;
+        pixels = layout.rowBytes / pixelBytes;
+        bands.resize(std::max<size_t>(1, std::min(analysisBands, rows)));
+        plane.resize(pixels);
+        tables.assign(colors * histogramTables * 256, 0);
+    }
+
+    void addRow(const unsigned char* row, const size_t y) {
+        const size_t band = y * bands.size() / rows;
+        if (band != tableBand) {
+            flushTables();
+            tableBand = band;
+        }
+        for (unsigned color = 0; color < colors; ++color) {
+            const unsigned char* values = row + color * sampleBytes + sampleBytes - 1;
+            for (size_t i = 0; i < pixels; ++i) {
+                plane[i] = values[i * pixelBytes];
+            }
+            uint64_t* counts = tables.data() + color * histogramTables * 256;
+            size_t i = 0;
+            for (; i + histogramTables <= pixels; i += histogramTables) {
+                ++counts[plane[i]];
+                ++counts[256 + plane[i + 1]];
+                ++counts[512 + plane[i + 2]];
+                ++counts[768 + plane[i + 3]];
+            }
+            for (; i < pixels; ++i) ++counts[plane[i]];
+            kernels.rsCount(plane.data(), pixels / rsGroupSize, bands[band].rs[color]);
+        }
+    }
+
+    analysisResult finish() {
+        flushTables();
+        analysisResult result;
+        result.colorChannels = colors;
+        chiSquareSum overallChiSquare;
+        uint64_t overallRs[rsCounters] = {};
+        for (unsigned color = 0; color < colors; ++color) {
+            uint64_t histogram[256] = {};
+            uint64_t rs[rsCounters] = {};
+            for (const bandCounts& band : bands) {
+                for (size_t value = 0; value < 256; ++value) histogram[value] += band.histogram[color][value];
+                for (size_t j = 0; j < rsCounters; ++j) rs[j] += band.rs[color][j];
+            }
+            chiSquareSum chiSquare;
+            chiSquare.add(histogram);
+            result.channels.push_back({chiSquare.probability(), rsEstimate(rs)});
+            overallChiSquare.chiSquare += chiSquare.chiSquare;
+            overallChiSquare.degreesOfFreedom += chiSquare.degreesOfFreedom;
+            for (size_t j = 0; j < rsCounters; ++j) overallRs[j] += rs[j];
+        }
+        result.overall = {overallChiSquare.probability(), rsEstimate(overallRs)};
+
+        for (const bandCounts& band : bands) {
+            chiSquareSum chiSquare;
+            uint64_t rs[rsCounters] = {};
+            for (unsigned color = 0; color < colors; ++color) {
+                chiSquare.add(band.histogram[color]);
+                for (size_t j = 0; j < rsCounters; ++j) rs[j] += band.rs[color][j];
+            }
+            result.bands.push_back({chiSquare.probability(), rsEstimate(rs)});
+        }
+        // Leading bands both tests find full, plus the part of the next one RS finds used. The
+        // chi-square test alone also passes bands of images with smooth histograms.
+        double sequentialRows = 0;
+        for (size_t band = 0; band < bands.size(); ++band) {
+            const lsbStatistics& statistics = result.bands[band];
+            // Band b starts at row ceil(b * rows / bands)
+            const size_t firstRow = (band * rows + bands.size() - 1) / bands.size();
+            const size_t bandRows = ((band + 1) * rows + bands.size() - 1) / bands.size() - firstRow;
+            if (statistics.chiSquareP <= 0.5 || statistics.rsEstimate <= 0.5) {
+                sequentialRows += statistics.rsEstimate * static_cast<double>(bandRows);
+                break;
+            }
+            sequentialRows += static_cast<double>(bandRows);
+        }
+        result.sequentialShare = rows == 0 ? 0.0 : sequentialRows / static_cast<double>(rows);
+        result.score = std::max(result.sequentialShare, result.overall.rsEstimate);
+        return result;
+    }
+};
+
+// Interleaved values per pixel of a described image
+static unsigned colorChannelsOf(const imageDescription& description) {
+    return description.bitsPerPixel / (description.layout.packing == channelPacking::SAMPLE16 ? 16 : 8);
+}
+
+analysisResult analyzePixels(const std::span<const std::byte> pixels, const pixelLayout& layout, const unsigned colorChannels) {
+    if (layout.rows == 0 || pixels.size() < layout.dataOffset || pixels.size() - layout.dataOffset < layout.regionSize()) {
+        analysisResult result;
+        result.status = {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        return result;
+    }
+    analysisScan scan(layout, colorChannels);
+    const unsigned char* rows = reinterpret_cast<const unsigned char*>(pixels.data()) + layout.dataOffset;
+    for (size_t y = 0; y < layout.rows; ++y) {
+        scan.addRow(rows + y * layout.rowStride, y);
+    }
+    return scan.finish();
+}
+analysisResult analyzeImage(const std::span<const std::byte> image) {
+    imageDescription description;
+    analysisResult result;
+    if (result.status = describeImage(image, description); !result.status) {
+        return result;
+    }
+    if (description.format == imageFormat::P3) {
+        result.status = {stegError::UNSUPPORTED_FORMAT, "P3 images can't be analyzed."};
+        return result;
+    }
+    return analyzePixels(image, description.layout, colorChannelsOf(description));
+}
+analysisResult analyzeImageFile(const std::string& filePath) {
+    analysisResult result;
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        result.status = {stegError::CANT_OPEN_FILE, "File can't be opened."};
+        return result;
+    }
+    // Large enough for the headers of every supported format
+    std::vector<unsigned char> header(ppmObject::headerBufferSize);
+    file.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    // open, read and close
+    STEG_COUNT(SYSCALLS, 3);
+    STEG_COUNT(BYTES_READ, file.gcount());
+    header.resize(static_cast<size_t>(file.gcount()));
+    imageDescription description;
+    if (result.status = describeImage(std::as_bytes(std::span(header)), description); !result.status) {
+        return result;
+    }
+    if (description.format == imageFormat::P3) {
+        result.status = {stegError::UNSUPPORTED_FORMAT, "P3 images can't be analyzed."};
+        return result;
+    }
+
+    const pixelLayout& layout = description.layout;
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(layout.dataOffset));
+    STEG_COUNT(SEEKS, 1);
+    STEG_COUNT(SYSCALLS, 1);
+    analysisScan scan(layout, colorChannelsOf(description));
+    const size_t rowsPerBlock = std::max<size_t>(1, analysisBlockSize / std::max<size_t>(1, layout.rowStride));
+    std::vector<unsigned char> block(rowsPerBlock * layout.rowStride);
+    for (size_t y = 0; y < layout.rows; y += rowsPerBlock) {
+        const size_t rows = std::min(rowsPerBlock, layout.rows - y);
+        // The last row may be stored without its padding
+        const size_t bytes = y + rows == layout.rows ? (rows - 1) * layout.rowStride + layout.rowBytes : rows * layout.rowStride;
+        file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(bytes));
+        STEG_COUNT(SYSCALLS, 1);
+        STEG_COUNT(BYTES_READ, file.gcount());
+        if (static_cast<size_t>(file.gcount()) != bytes) {
+            result.status = {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+            return result;
+        }
+        for (size_t row = 0; row < rows; ++row) {
+            scan.addRow(block.data() + row * layout.rowStride, y + row);
+        }
+    }
+    return scan.finish();
+}
@@ -0,0 +1,46 @@
+#ifndef LSBANALYSIS_HPP
+#define LSBANALYSIS_HPP
+#include <span>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "pixelAccess.hpp"
+#include "stegStatus.hpp"
+
+// Steganalysis for LSB payloads in images this tool didn't necessarily write. Two classic
+// statistics are taken per color channel and per band of rows:
+//  - chi-square: embedding evens out the counts of each pair of values 2k, 2k+1. The result is
+//    the probability that the pairs are as even as they are by chance, near 1 over embedded rows.
+//  - RS: how flipping LSBs changes the noise of small groups of pixels, which estimates the share
+//    of the channels that carry a payload, also when it is scattered over the image.
+// Images are read row block by row block, so memory use doesn't depend on the image size.
+// 2-byte samples are analyzed by their low bytes.
+static constexpr size_t analysisBands = 16;
+
+struct lsbStatistics {
+    double chiSquareP = 0;     // 0 (pairs uneven, clean) to 1 (pairs even, embedded)
+    double rsEstimate = 0;     // estimated share of the channels carrying a payload, 0 to 1
+};
+
+struct analysisResult {
+    stegStatus status;
+    unsigned colorChannels = 0;
+    lsbStatistics overall;
+    std::vector<lsbStatistics> channels;   // per color channel in storage order (e.g. B, G, R)
+    std::vector<lsbStatistics> bands;      // per band of rows in storage order, up to analysisBands
+    // Share of the rows, from the first one stored, that carry a payload by both tests. This tool
+    // embeds from the first stored row on unless a key scatters the payload.
+    double sequentialShare = 0;
+    // The larger of sequentialShare and the overall RS estimate: 0 for a clean image, towards 1 the
+    // more of it carries a payload
+    double score = 0;
+};
+
+// Pixel rows at layout.dataOffset inside pixels, colorChannels interleaved values per pixel
+analysisResult analyzePixels(std::span<const std::byte> pixels, const pixelLayout& layout, unsigned colorChannels);
+// Complete BMP or binary Netpbm images, in memory or in a file. The format follows from the
+// image header, not from the file extension. P3 images are not supported.
+analysisResult analyzeImage(std::span<const std::byte> image);
+analysisResult analyzeImageFile(const std::string& filePath);
+
+#endif //LSBANALYSIS_HPP
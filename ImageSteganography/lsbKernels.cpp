@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "lsbKernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LSB_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LSB_TARGET_AVX2
+#define LSB_TARGET_BMI2
+#else
+#include <cpuid.h>
+#define LSB_TARGET_AVX2 __attribute__((target("avx2")))
+#define LSB_TARGET_BMI2 __attribute__((target("bmi2")))
+#endif
+#endif
+
+// A group of 8 channels carries bitsPerChannel payload bytes, read as one big-endian value
+// whose top bitsPerChannel bits go to the first channel. The depth is a template parameter,
+// so every depth compiles to its own fully unrolled, branch-free loop.
+template <unsigned bitsPerChannel>
+static void embedScalar(unsigned char* channels, const unsigned char* payload, const size_t groups) {
+    constexpr unsigned mask = (1u << bitsPerChannel) - 1;
+    for (size_t i = 0; i < groups; ++i) {
+        uint32_t bits = 0;
+        for (unsigned j = 0; j < bitsPerChannel; ++j) {
+            bits = (bits << 8) | payload[j];
+        }
+        for (unsigned j = 0; j < 8; ++j) {
+            channels[j] = static_cast<unsigned char>((channels[j] & ~mask) | ((bits >> (bitsPerChannel * (7 - j))) & mask));
+        }
+        channels += 8;
+        payload += bitsPerChannel;
+    }
+}
+template <unsigned bitsPerChannel>
+static void extractScalar(const unsigned char* channels, unsigned char* payload, const size_t groups) {
+    constexpr unsigned mask = (1u << bitsPerChannel) - 1;
+    for (size_t i = 0; i < groups; ++i) {
+        uint32_t bits = 0;
+        for (unsigned j = 0; j < 8; ++j) {
+            bits = (bits << bitsPerChannel) | (channels[j] & mask);
+        }
+        for (unsigned j = 0; j < bitsPerChannel; ++j) {
+            payload[j] = static_cast<unsigned char>(bits >> (8 * (bitsPerChannel - 1 - j)));
+        }
+        channels += 8;
+        payload += bitsPerChannel;
+    }
+}
+
+// Byte of channel c (0 to 23) within a group of 8 BGRA pixels
+static constexpr unsigned bgraOffset(const unsigned channel) {
+    return channel / 3 * 4 + channel % 3;
+}
+// A group of 8 BGRA pixels holds three runs of 8 channels, each filled like a group of embedScalar
+template <unsigned bitsPerChannel>
+static void embedBgraScalar(unsigned char* pixels, const unsigned char* payload, const size_t groups) {
+    constexpr unsigned mask = (1u << bitsPerChannel) - 1;
+    for (size_t i = 0; i < groups; ++i) {
+        for (unsigned run = 0; run < 3; ++run) {
+            uint32_t bits = 0;
+            for (unsigned j = 0; j < bitsPerChannel; ++j) {
+                bits = (bits << 8) | payload[run * bitsPerChannel + j];
+            }
+            for (unsigned j = 0; j < 8; ++j) {
+                unsigned char& channel = pixels[bgraOffset(run * 8 + j)];
+                channel = static_cast<unsigned char>((channel & ~mask) | ((bits >> (bitsPerChannel * (7 - j))) & mask));
+            }
+        }
+        pixels += bgraGroupPixels * 4;
+        payload += 3 * bitsPerChannel;
+    }
+}
+template <unsigned bitsPerChannel>
+static void extractBgraScalar(const unsigned char* pixels, unsigned char* payload, const size_t groups) {
+    constexpr unsigned mask = (1u << bitsPerChannel) - 1;
+    for (size_t i = 0; i < groups; ++i) {
+        for (unsigned run = 0; run < 3; ++run) {
+            uint32_t bits = 0;
+            for (unsigned j = 0; j < 8; ++j) {
+                bits = (bits << bitsPerChannel) | (pixels[bgraOffset(run * 8 + j)] & mask);
+            }
+            for (unsigned j = 0; j < bitsPerChannel; ++j) {
+                payload[run * bitsPerChannel + j] = static_cast<unsigned char>(bits >> (8 * (bitsPerChannel - 1 - j)));
+            }
+        }
+        pixels += bgraGroupPixels * 4;
+        payload += 3 * bitsPerChannel;
+    }
+}
+
+// 2-byte samples are filled like a group of embedScalar, their channel is the second (low) byte
+template <unsigned bitsPerChannel>
+static void embedSample16Scalar(unsigned char* samples, const unsigned char* payload, const size_t groups) {
+    constexpr unsigned mask = (1u << bitsPerChannel) - 1;
+    for (size_t i = 0; i < groups; ++i) {
+        uint32_t bits = 0;
+        for (unsigned j = 0; j < bitsPerChannel; ++j) {
+            bits = (bits << 8) | payload[j];
+        }
+        for (unsigned j = 0; j < 8; ++j) {
+            unsigned char& channel = samples[j * 2 + 1];
+            channel = static_cast<unsigned char>((channel & ~mask) | ((bits >> (bitsPerChannel * (7 - j))) & mask));
+        }
+        samples += 16;
+        payload += bitsPerChannel;
+    }
+}
+template <unsigned bitsPerChannel>
+static void extractSample16Scalar(const unsigned char* samples, unsigned char* payload, const size_t groups) {
+    constexpr unsigned mask = (1u << bitsPerChannel) - 1;
+    for (size_t i = 0; i < groups; ++i) {
+        uint32_t bits = 0;
+        for (unsigned j = 0; j < 8; ++j) {
+            bits = (bits << bitsPerChannel) | (samples[j * 2 + 1] & mask);
+        }
+        for (unsigned j = 0; j < bitsPerChannel; ++j) {
+            payload[j] = static_cast<unsigned char>(bits >> (8 * (bitsPerChannel - 1 - j)));
+        }
+        samples += 16;
+        payload += bitsPerChannel;
+    }
+}
+
+// Noise of a group: how much neighbouring values differ
+static inline int rsNoise(const int x0, const int x1, const int x2, const int x3) {
+    return std::abs(x1 - x0) + std::abs(x2 - x1) + std::abs(x3 - x2);
+}
+// The shifted LSB flip: -1 <-> 0, 1 <-> 2, 3 <-> 4, ...
+static inline int shiftedFlip(const int value) {
+    return ((value + 1) ^ 1) - 1;
+}
+static void rsCountScalar(const unsigned char* values, const size_t groups, uint64_t* counts) {
+    for (size_t i = 0; i < groups; ++i) {
+        for (int flip = 0; flip < 2; ++flip) {
+            const int x0 = values[0] ^ flip, x1 = values[1] ^ flip, x2 = values[2] ^ flip, x3 = values[3] ^ flip;
+            const int noise = rsNoise(x0, x1, x2, x3);
+            const int flipped = rsNoise(x0, x1 ^ 1, x2 ^ 1, x3);
+            const int shifted = rsNoise(x0, shiftedFlip(x1), shiftedFlip(x2), x3);
+            uint64_t* tally = counts + flip * 4;
+            tally[0] += flipped > noise;
+            tally[1] += flipped < noise;
+            tally[2] += shifted > noise;
+            tally[3] += shifted < noise;
+        }
+        values += rsGroupSize;
+    }
+}
+
+#ifdef LSB_KERNELS_X86
+// 16 channels (2 payload bytes) per step: every byte is broadcast over 8 lanes, each lane
+// tests its own bit and the resulting 0/1 replaces the channel LSB.
+static void embedSse2(unsigned char* channels, const unsigned char* payload, const size_t payloadBytes) {
+    const __m128i bitSelect = _mm_setr_epi8(static_cast<char>(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                            static_cast<char>(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i clearLsb = _mm_set1_epi8(static_cast<char>(0xFE));
+    size_t i = 0;
+    for (; i + 2 <= payloadBytes; i += 2) {
+        __m128i spread = _mm_cvtsi32_si128(payload[i] | (payload[i + 1] << 8));
+        spread = _mm_unpacklo_epi8(spread, spread);
+        spread = _mm_unpacklo_epi16(spread, spread);
+        spread = _mm_unpacklo_epi32(spread, spread);
+        const __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bitSelect), bitSelect), one);
+        __m128i* target = reinterpret_cast<__m128i*>(channels + i * 8);
+        _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(target), clearLsb), bits));
+    }
+    embedScalar<1>(channels + i * 8, payload + i, payloadBytes - i);
+}
+// Reverses the channel order inside every group of 8 so the first channel lands in the most
+// significant bit, then moves each LSB to the sign bit and collects them with movemask.
+static void extractSse2(const unsigned char* channels, unsigned char* payload, const size_t payloadBytes) {
+    size_t i = 0;
+    for (; i + 2 <= payloadBytes; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(channels + i * 8));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        const int mask = _mm_movemask_epi8(_mm_slli_epi16(v, 7));
+        payload[i] = static_cast<unsigned char>(mask);
+        payload[i + 1] = static_cast<unsigned char>(mask >> 8);
+    }
+    extractScalar<1>(channels + i * 8, payload + i, payloadBytes - i);
+}
+
+// 8 samples (one payload byte) per step, 16-bit lanes: the byte is broadcast and each lane tests
+// its bit in its low byte, while the high bytes of the samples keep their value
+static void embedSample16Sse2(unsigned char* samples, const unsigned char* payload, const size_t groups) {
+    const __m128i bitSelect = _mm_setr_epi8(0, static_cast<char>(0x80), 0, 0x40, 0, 0x20, 0, 0x10, 0, 0x08, 0, 0x04, 0, 0x02, 0, 0x01);
+    const __m128i lowOne = _mm_set1_epi16(0x0100);
+    const __m128i keepBits = _mm_set1_epi16(static_cast<short>(0xFEFF));
+    for (size_t i = 0; i < groups; ++i) {
+        const __m128i spread = _mm_set1_epi8(static_cast<char>(payload[i]));
+        const __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bitSelect), bitSelect), lowOne);
+        __m128i* target = reinterpret_cast<__m128i*>(samples + i * 16);
+        _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(target), keepBits), bits));
+    }
+}
+// 16 samples (two payload bytes) per step: the lanes are reversed so the first sample lands in
+// the most significant bit, the LSB of every low byte is moved to the sign of its lane and the
+// lanes are narrowed to bytes with signed saturation, which keeps the sign, for movemask.
+static void extractSample16Sse2(const unsigned char* samples, unsigned char* payload, const size_t groups) {
+    auto reverseLanes = [](__m128i v) {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    };
+    size_t i = 0;
+    for (; i + 2 <= groups; i += 2) {
+        const __m128i first = reverseLanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i * 16)));
+        const __m128i second = reverseLanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i * 16 + 16)));
+        const int mask = _mm_movemask_epi8(_mm_packs_epi16(_mm_slli_epi16(first, 7), _mm_slli_epi16(second, 7)));
+        payload[i] = static_cast<unsigned char>(mask);
+        payload[i + 1] = static_cast<unsigned char>(mask >> 8);
+    }
+    extractSample16Scalar<1>(samples + i * 16, payload + i, groups - i);
+}
+
+// Same scheme as the SSE2 kernels with 32 channels (4 payload bytes) per step
+LSB_TARGET_AVX2 static void embedAvx2(unsigned char* channels, const unsigned char* payload, const size_t payloadBytes) {
+    const __m256i broadcast = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                               2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bitSelect = _mm256_set1_epi64x(0x0102040810204080LL);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i clearLsb = _mm256_set1_epi8(static_cast<char>(0xFE));
+    size_t i = 0;
+    for (; i + 4 <= payloadBytes; i += 4) {
+        uint32_t word;
+        std::memcpy(&word, payload + i, sizeof(word));
+        const __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(word)), broadcast);
+        const __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(spread, bitSelect), bitSelect), one);
+        __m256i* target = reinterpret_cast<__m256i*>(channels + i * 8);
+        _mm256_storeu_si256(target, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(target), clearLsb), bits));
+    }
+    embedSse2(channels + i * 8, payload + i, payloadBytes - i);
+}
+LSB_TARGET_AVX2 static void extractAvx2(const unsigned char* channels, unsigned char* payload, const size_t payloadBytes) {
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t i = 0;
+    for (; i + 4 <= payloadBytes; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(channels + i * 8));
+        v = _mm256_shuffle_epi8(v, reverse);
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_slli_epi16(v, 7)));
+        std::memcpy(payload + i, &mask, sizeof(mask));
+    }
+    extractSse2(channels + i * 8, payload + i, payloadBytes - i);
+}
+
+// Shuffle and mask tables of the AVX2 BGRA kernels, one entry per byte of a group of 8 pixels.
+// Shuffles work within 128-bit lanes, which hold 4 pixels each.
+struct bgraTables {
+    alignas(32) unsigned char payloadByte[32];  // payload byte holding the bit of each channel, 0x80 for alpha
+    alignas(32) unsigned char bitSelect[32];    // that bit, 0 for alpha
+    alignas(32) unsigned char channelBit[32];   // 1 for channels, 0 for alpha
+    alignas(32) unsigned char keepBits[32];     // 0xFE for channels, 0xFF for alpha
+    alignas(32) unsigned char compact[32];      // the 12 channels of each lane moved to its first 12 bytes
+};
+static constexpr bgraTables makeBgraTables() {
+    bgraTables tables{};
+    for (unsigned byte = 0; byte < 32; ++byte) {
+        const unsigned channel = byte / 4 * 3 + byte % 4;
+        const bool isAlpha = byte % 4 == 3;
+        tables.payloadByte[byte] = isAlpha ? 0x80 : static_cast<unsigned char>(channel / 8);
+        tables.bitSelect[byte] = isAlpha ? 0 : static_cast<unsigned char>(0x80 >> (channel % 8));
+        tables.channelBit[byte] = isAlpha ? 0 : 1;
+        tables.keepBits[byte] = isAlpha ? 0xFF : 0xFE;
+        const unsigned laneChannel = byte % 16;
+        tables.compact[byte] = laneChannel < 12 ? static_cast<unsigned char>(bgraOffset(laneChannel)) : 0x80;
+    }
+    return tables;
+}
+static constexpr bgraTables bgraAvx2Tables = makeBgraTables();
+
+// Every lane gets the payload byte holding its bit and tests that bit, as in embedAvx2, while
+// the alpha bytes keep their value
+LSB_TARGET_AVX2 static void embedBgraAvx2(unsigned char* pixels, const unsigned char* payload, const size_t groups) {
+    const __m256i payloadByte = _mm256_load_si256(reinterpret_cast<const __m256i*>(bgraAvx2Tables.payloadByte));
+    const __m256i bitSelect = _mm256_load_si256(reinterpret_cast<const __m256i*>(bgraAvx2Tables.bitSelect));
+    const __m256i channelBit = _mm256_load_si256(reinterpret_cast<const __m256i*>(bgraAvx2Tables.channelBit));
+    const __m256i keepBits = _mm256_load_si256(reinterpret_cast<const __m256i*>(bgraAvx2Tables.keepBits));
+    for (size_t i = 0; i < groups; ++i) {
+        // Assembled in a register: a 3 byte copy into memory would stall the broadcast load
+        const uint32_t word = payload[i * 3] | (payload[i * 3 + 1] << 8) | (payload[i * 3 + 2] << 16);
+        const __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(word)), payloadByte);
+        const __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(spread, bitSelect), bitSelect), channelBit);
+        __m256i* target = reinterpret_cast<__m256i*>(pixels + i * bgraGroupPixels * 4);
+        _mm256_storeu_si256(target, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(target), keepBits), bits));
+    }
+}
+// The channels of each lane are moved to its first 12 bytes, the lanes are joined so all 24
+// channels are in order, and every run of 8 is reversed as in extractAvx2 so movemask yields the
+// payload bytes directly
+LSB_TARGET_AVX2 static void extractBgraAvx2(const unsigned char* pixels, unsigned char* payload, const size_t groups) {
+    const __m256i compact = _mm256_load_si256(reinterpret_cast<const __m256i*>(bgraAvx2Tables.compact));
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    for (size_t i = 0; i < groups; ++i) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i * bgraGroupPixels * 4));
+        v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, compact), join), reverse);
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_slli_epi16(v, 7)));
+        // The fourth byte is garbage, written over by the next group
+        if (i + 1 < groups) {
+            std::memcpy(payload + i * 3, &mask, sizeof(mask));
+        } else {
+            std::memcpy(payload + i * 3, &mask, 3);
+        }
+    }
+}
+
+// 16 groups per step in 16-bit lanes: the 64 values are transposed so that x[0] holds the first
+// value of every group, x[1] the second and so on. The lane tallies are summed up before they can overflow.
+static constexpr size_t rsFlushSteps = 16384;
+LSB_TARGET_AVX2 static inline __m256i rsNoiseAvx2(const __m256i x0, const __m256i x1, const __m256i x2, const __m256i x3) {
+    return _mm256_add_epi16(_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(x1, x0)), _mm256_abs_epi16(_mm256_sub_epi16(x2, x1))),
+                            _mm256_abs_epi16(_mm256_sub_epi16(x3, x2)));
+}
+LSB_TARGET_AVX2 static void rsCountAvx2(const unsigned char* values, const size_t groups, uint64_t* counts) {
+    const __m256i transpose = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                                               0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m256i join = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i one = _mm256_set1_epi16(1);
+    size_t i = 0;
+    while (groups - i >= 16) {
+        __m256i tally[rsCounters];
+        for (__m256i& lane : tally) lane = _mm256_setzero_si256();
+        const size_t end = i + std::min((groups - i) / 16, rsFlushSteps) * 16;
+        for (; i < end; i += 16) {
+            // The first, second, third and fourth values of 8 groups each
+            const __m256i a = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i * rsGroupSize)), transpose), join);
+            const __m256i b = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i * rsGroupSize + 32)), transpose), join);
+            const __m256i even = _mm256_unpacklo_epi64(a, b);
+            const __m256i odd = _mm256_unpackhi_epi64(a, b);
+            __m256i x[4] = {_mm256_cvtepu8_epi16(_mm256_castsi256_si128(even)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(odd)),
+                            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(even, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(odd, 1))};
+            for (int flip = 0; flip < 2; ++flip) {
+                if (flip) {
+                    for (__m256i& value : x) value = _mm256_xor_si256(value, one);
+                }
+                const __m256i noise = rsNoiseAvx2(x[0], x[1], x[2], x[3]);
+                const __m256i flipped = rsNoiseAvx2(x[0], _mm256_xor_si256(x[1], one), _mm256_xor_si256(x[2], one), x[3]);
+                const __m256i shifted1 = _mm256_sub_epi16(_mm256_xor_si256(_mm256_add_epi16(x[1], one), one), one);
+                const __m256i shifted2 = _mm256_sub_epi16(_mm256_xor_si256(_mm256_add_epi16(x[2], one), one), one);
+                const __m256i shifted = rsNoiseAvx2(x[0], shifted1, shifted2, x[3]);
+                // Comparisons give -1 for true
+                __m256i* lanes = tally + flip * 4;
+                lanes[0] = _mm256_sub_epi16(lanes[0], _mm256_cmpgt_epi16(flipped, noise));
+                lanes[1] = _mm256_sub_epi16(lanes[1], _mm256_cmpgt_epi16(noise, flipped));
+                lanes[2] = _mm256_sub_epi16(lanes[2], _mm256_cmpgt_epi16(shifted, noise));
+                lanes[3] = _mm256_sub_epi16(lanes[3], _mm256_cmpgt_epi16(noise, shifted));
+            }
+        }
+        for (size_t j = 0; j < rsCounters; ++j) {
+            alignas(32) int32_t sums[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(sums), _mm256_madd_epi16(tally[j], one));
+            for (const int32_t sum : sums) counts[j] += static_cast<uint64_t>(sum);
+        }
+    }
+    rsCountScalar(values + i * rsGroupSize, groups - i, counts);
+}
+
+// With BMI2, pdep/pext move the bits of a whole group at once. The 8 channels are handled
+// as one 64-bit word, byte swapped so the first channel lines up with the top payload bits.
+static inline uint64_t swapBytes(const uint64_t word) {
+#ifdef _MSC_VER
+    return _byteswap_uint64(word);
+#else
+    return __builtin_bswap64(word);
+#endif
+}
+template <unsigned bitsPerChannel>
+LSB_TARGET_BMI2 static void embedBmi2(unsigned char* channels, const unsigned char* payload, const size_t groups) {
+    constexpr uint64_t lowBits = 0x0101010101010101ULL * ((1u << bitsPerChannel) - 1);
+    for (size_t i = 0; i < groups; ++i) {
+        uint64_t bits = 0;
+        for (unsigned j = 0; j < bitsPerChannel; ++j) {
+            bits = (bits << 8) | payload[j];
+        }
+        uint64_t word;
+        std::memcpy(&word, channels, sizeof(word));
+        word = (word & ~lowBits) | swapBytes(_pdep_u64(bits, lowBits));
+        std::memcpy(channels, &word, sizeof(word));
+        channels += 8;
+        payload += bitsPerChannel;
+    }
+}
+template <unsigned bitsPerChannel>
+LSB_TARGET_BMI2 static void extractBmi2(const unsigned char* channels, unsigned char* payload, const size_t groups) {
+    constexpr uint64_t lowBits = 0x0101010101010101ULL * ((1u << bitsPerChannel) - 1);
+    for (size_t i = 0; i < groups; ++i) {
+        uint64_t word;
+        std::memcpy(&word, channels, sizeof(word));
+        const uint64_t bits = _pext_u64(swapBytes(word), lowBits);
+        for (unsigned j = 0; j < bitsPerChannel; ++j) {
+            payload[j] = static_cast<unsigned char>(bits >> (8 * (bitsPerChannel - 1 - j)));
+        }
+        channels += 8;
+        payload += bitsPerChannel;
+    }
+}
+
+static bool cpuHasAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    // AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+// CPUID leaf into eax, ebx, ecx, edx
+static void cpuidLeaf(const unsigned leaf, unsigned registers[4]) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), 0);
+    for (int i = 0; i < 4; ++i) registers[i] = static_cast<unsigned>(info[i]);
+#else
+    if (!__get_cpuid_count(leaf, 0, &registers[0], &registers[1], &registers[2], &registers[3])) {
+        registers[0] = registers[1] = registers[2] = registers[3] = 0;
+    }
+#endif
+}
+// pdep/pext are microcoded on AMD before Zen 3 (family 19h) and on Hygon, taking hundreds of
+// cycles depending on the mask, so those CPUs are better off with the scalar kernels
+static bool cpuHasFastBmi2() {
+    unsigned registers[4];
+    cpuidLeaf(0, registers);
+    const unsigned maxLeaf = registers[0];
+    char vendor[13] = {};
+    std::memcpy(vendor, &registers[1], 4);
+    std::memcpy(vendor + 4, &registers[3], 4);
+    std::memcpy(vendor + 8, &registers[2], 4);
+    if (maxLeaf < 7) return false;
+    cpuidLeaf(7, registers);
+    if ((registers[1] & (1u << 8)) == 0) return false;
+    if (std::strcmp(vendor, "HygonGenuine") == 0) return false;
+    if (std::strcmp(vendor, "AuthenticAMD") == 0) {
+        cpuidLeaf(1, registers);
+        const unsigned baseFamily = (registers[0] >> 8) & 0xf;
+        const unsigned family = baseFamily == 0xf ? baseFamily + ((registers[0] >> 20) & 0xff) : baseFamily;
+        return family >= 0x19;
+    }
+    return true;
+}
+#endif
+
+// Deeper embedding uses BMI2 where it is fast and the scalar templates otherwise
+#define LSB_DEEP_EMBED embedScalar<2>, embedScalar<3>, embedScalar<4>
+#define LSB_DEEP_EXTRACT extractScalar<2>, extractScalar<3>, extractScalar<4>
+#define LSB_DEEP_EMBED_BMI2 embedBmi2<2>, embedBmi2<3>, embedBmi2<4>
+#define LSB_DEEP_EXTRACT_BMI2 extractBmi2<2>, extractBmi2<3>, extractBmi2<4>
+// BGRA pixels only have an AVX2 kernel for one bit per channel
+#define LSB_DEEP_EMBED_BGRA embedBgraScalar<2>, embedBgraScalar<3>, embedBgraScalar<4>
+#define LSB_DEEP_EXTRACT_BGRA extractBgraScalar<2>, extractBgraScalar<3>, extractBgraScalar<4>
+#define LSB_SCALAR_BGRA {embedBgraScalar<1>, LSB_DEEP_EMBED_BGRA}, {extractBgraScalar<1>, LSB_DEEP_EXTRACT_BGRA}
+#define LSB_AVX2_BGRA {embedBgraAvx2, LSB_DEEP_EMBED_BGRA}, {extractBgraAvx2, LSB_DEEP_EXTRACT_BGRA}
+// 2-byte samples have an SSE2 kernel for one bit per channel
+#define LSB_DEEP_EMBED_16 embedSample16Scalar<2>, embedSample16Scalar<3>, embedSample16Scalar<4>
+#define LSB_DEEP_EXTRACT_16 extractSample16Scalar<2>, extractSample16Scalar<3>, extractSample16Scalar<4>
+#define LSB_SCALAR_16 {embedSample16Scalar<1>, LSB_DEEP_EMBED_16}, {extractSample16Scalar<1>, LSB_DEEP_EXTRACT_16}
+#define LSB_SSE2_16 {embedSample16Sse2, LSB_DEEP_EMBED_16}, {extractSample16Sse2, LSB_DEEP_EXTRACT_16}
+
+const lsbKernels& scalarLsbKernels() {
+    static const lsbKernels kernels{"scalar", {embedScalar<1>, LSB_DEEP_EMBED}, {extractScalar<1>, LSB_DEEP_EXTRACT}, LSB_SCALAR_BGRA, LSB_SCALAR_16, rsCountScalar};
+    return kernels;
+}
+const lsbKernels& selectLsbKernels() {
+#ifdef LSB_KERNELS_X86
+    static const lsbKernels sse2{"sse2", {embedSse2, LSB_DEEP_EMBED}, {extractSse2, LSB_DEEP_EXTRACT}, LSB_SCALAR_BGRA, LSB_SSE2_16, rsCountScalar};
+    static const lsbKernels avx2{"avx2", {embedAvx2, LSB_DEEP_EMBED}, {extractAvx2, LSB_DEEP_EXTRACT}, LSB_AVX2_BGRA, LSB_SSE2_16, rsCountAvx2};
+    static const lsbKernels avx2Bmi2{"avx2+bmi2", {embedAvx2, LSB_DEEP_EMBED_BMI2}, {extractAvx2, LSB_DEEP_EXTRACT_BMI2}, LSB_AVX2_BGRA, LSB_SSE2_16, rsCountAvx2};
+    static const lsbKernels& selected = !cpuHasAvx2() ? sse2 : cpuHasFastBmi2() ? avx2Bmi2 : avx2;
+    return selected;
+#else
+    return scalarLsbKernels();
+#endif
+}
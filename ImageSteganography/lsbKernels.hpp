@@ -0,0 +1,48 @@
+#ifndef LSBKERNELS_HPP
+#define LSBKERNELS_HPP
+#include <cstddef>
+#include <cstdint>
+
+// Payload bits are stored most significant first, bitsPerChannel of them in the low bits of
+// every channel byte. Kernels work on groups of 8 channel bytes, each carrying bitsPerChannel
+// payload bytes (with one bit per channel: one payload byte per 8 channels).
+static constexpr unsigned maxBitsPerChannel = 4;
+
+// Writes groups * bitsPerChannel payload bytes into groups * 8 channel bytes
+using embedKernel = void (*)(unsigned char* channels, const unsigned char* payload, size_t groups);
+// Gathers them back from groups * 8 channel bytes
+using extractKernel = void (*)(const unsigned char* channels, unsigned char* payload, size_t groups);
+
+// 4-byte BGRA pixels only carry bits in their first three bytes, so their kernels work on groups
+// of 8 pixels: 32 bytes, 24 channels and 3 * bitsPerChannel payload bytes. Rows of 4-byte pixels
+// never need padding, so those groups can run across whole images.
+static constexpr size_t bgraGroupPixels = 8;
+// Kernels for 2-byte big-endian samples work on groups of 8 samples (16 bytes, bitsPerChannel
+// payload bytes) and only ever change the low byte of a sample.
+
+// Counts for RS steganalysis (lsbAnalysis.hpp) over groups of 4 consecutive values of one color.
+// For the values as they are (counts 0-3) and with every LSB flipped (counts 4-7): the groups that
+// flipping the LSBs of their middle values makes noisier and smoother, then the same for the
+// shifted flip (-1 <-> 0, 1 <-> 2, ...). Adds to counts.
+static constexpr size_t rsGroupSize = 4;
+static constexpr size_t rsCounters = 8;
+using rsKernel = void (*)(const unsigned char* values, size_t groups, uint64_t* counts);
+
+struct lsbKernels {
+    const char* name;
+    // Indexed by bitsPerChannel - 1
+    embedKernel embed[maxBitsPerChannel];
+    extractKernel extract[maxBitsPerChannel];
+    // Same for groups of BGRA pixels and of 2-byte samples
+    embedKernel embedBgra[maxBitsPerChannel];
+    extractKernel extractBgra[maxBitsPerChannel];
+    embedKernel embed16[maxBitsPerChannel];
+    extractKernel extract16[maxBitsPerChannel];
+    rsKernel rsCount;
+};
+
+// Fastest kernel set supported by the running CPU, detected once on first use
+const lsbKernels& selectLsbKernels();
+const lsbKernels& scalarLsbKernels();
+
+#endif //LSBKERNELS_HPP
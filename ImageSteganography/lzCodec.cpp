@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "lzCodec.hpp"
+#include "helpFunctions.hpp"
+
+static constexpr size_t minMatch = 4;
+static constexpr size_t maxOffset = 65535;
+static constexpr unsigned hashBits = 14;
+// Every stream byte expands to at most this many output bytes, which bounds the declared size
+static constexpr uint64_t maxExpansion = 255;
+
+static uint32_t hashOf(const unsigned char* bytes) {
+    return (loadLittleEndian<uint32_t>(bytes) * 2654435761u) >> (32 - hashBits);
+}
+
+// Bytes at a and b that are equal, counted up to end (a < b <= end)
+static size_t commonLength(const unsigned char* a, const unsigned char* b, const unsigned char* const end) {
+    const unsigned char* const start = b;
+    while (end - b >= 8) {
+        const uint64_t difference = loadLittleEndian<uint64_t>(a) ^ loadLittleEndian<uint64_t>(b);
+        if (difference != 0) {
+            return static_cast<size_t>(b - start) + std::countr_zero(difference) / 8;
+        }
+        a += 8;
+        b += 8;
+    }
+    while (b < end && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return static_cast<size_t>(b - start);
+}
+
+static void appendLength(std::string& output, size_t length) {
+    for (; length >= 255; length -= 255) {
+        output.push_back(static_cast<char>(255));
+    }
+    output.push_back(static_cast<char>(length));
+}
+// matchLength 0 ends the stream with the literals
+static void appendSequence(std::string& output, const unsigned char* literals, const size_t literalCount,
+                           const size_t offset, const size_t matchLength) {
+    const size_t matchCode = matchLength == 0 ? 0 : matchLength - minMatch;
+    output.push_back(static_cast<char>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalCount >= 15) {
+        appendLength(output, literalCount - 15);
+    }
+    output.append(reinterpret_cast<const char*>(literals), literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    output.push_back(static_cast<char>(offset & 0xFF));
+    output.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15) {
+        appendLength(output, matchCode - 15);
+    }
+}
+
+std::string lzCompress(const std::string& input) {
+    std::string output;
+    output.reserve(input.size() / 2 + 16);
+    for (uint64_t size = input.size(); ; size >>= 7) {
+        output.push_back(static_cast<char>((size & 0x7F) | (size >= 0x80 ? 0x80 : 0)));
+        if (size < 0x80) break;
+    }
+
+    const unsigned char* const begin = reinterpret_cast<const unsigned char*>(input.data());
+    const unsigned char* const end = begin + input.size();
+    const unsigned char* anchor = begin;
+    if (input.size() > minMatch) {
+        // Positions of the last 4-byte sequence seen with each hash
+        std::vector<uint32_t> table(size_t(1) << hashBits, 0);
+        const unsigned char* const lastMatchStart = end - minMatch;
+        const unsigned char* position = begin + 1;
+        size_t misses = 0;
+        while (position <= lastMatchStart) {
+            const uint32_t hash = hashOf(position);
+            const unsigned char* candidate = begin + table[hash];
+            table[hash] = static_cast<uint32_t>(position - begin);
+            if (position - candidate > static_cast<ptrdiff_t>(maxOffset)
+                || loadLittleEndian<uint32_t>(candidate) != loadLittleEndian<uint32_t>(position)) {
+                // Incompressible input is skipped over faster and faster
+                position += 1 + (misses++ >> 5);
+                continue;
+            }
+            while (position > anchor && candidate > begin && position[-1] == candidate[-1]) {
+                --position;
+                --candidate;
+            }
+            const size_t length = minMatch + commonLength(candidate + minMatch, position + minMatch, end);
+            appendSequence(output, anchor, static_cast<size_t>(position - anchor), static_cast<size_t>(position - candidate), length);
+            position += length;
+            anchor = position;
+            misses = 0;
+            if (position - 2 <= lastMatchStart) {
+                table[hashOf(position - 2)] = static_cast<uint32_t>(position - 2 - begin);
+            }
+        }
+    }
+    appendSequence(output, anchor, static_cast<size_t>(end - anchor), 0, 0);
+    return output;
+}
+
+static bool readLength(const unsigned char*& position, const unsigned char* const end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (position == end) {
+            return false;
+        }
+        byte = *position++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lzDecompress(const std::string& input, std::string& output) {
+    const unsigned char* position = reinterpret_cast<const unsigned char*>(input.data());
+    const unsigned char* const end = position + input.size();
+    uint64_t size = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        if (position == end || shift > 63) {
+            return false;
+        }
+        const unsigned char byte = *position++;
+        size |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) break;
+    }
+    if (size > static_cast<uint64_t>(end - position) * maxExpansion) {
+        return false;
+    }
+
+    output.assign(static_cast<size_t>(size), '\0');
+    unsigned char* const outputBegin = reinterpret_cast<unsigned char*>(output.data());
+    unsigned char* const outputEnd = outputBegin + output.size();
+    unsigned char* out = outputBegin;
+    while (position < end) {
+        const unsigned token = *position++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(position, end, literalCount)) {
+            return false;
+        }
+        if (literalCount > static_cast<size_t>(end - position) || literalCount > static_cast<size_t>(outputEnd - out)) {
+            return false;
+        }
+        std::memcpy(out, position, literalCount);
+        out += literalCount;
+        position += literalCount;
+        if (position == end) {
+            return out == outputEnd;
+        }
+
+        if (end - position < 2) {
+            return false;
+        }
+        const size_t offset = loadLittleEndian<uint16_t>(position);
+        position += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(position, end, length)) {
+            return false;
+        }
+        length += minMatch;
+        if (offset == 0 || offset > static_cast<size_t>(out - outputBegin) || length > static_cast<size_t>(outputEnd - out)) {
+            return false;
+        }
+        const unsigned char* match = out - offset;
+        if (offset >= length) {
+            std::memcpy(out, match, length);
+            out += length;
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < length; ++i) {
+                *out++ = *match++;
+            }
+        }
+    }
+    return false;
+}
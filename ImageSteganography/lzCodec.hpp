@@ -0,0 +1,13 @@
+#ifndef LZCODEC_HPP
+#define LZCODEC_HPP
+#include <string>
+
+// Byte oriented LZ77 in the style of LZ4, small and fast rather than tight. The stream starts
+// with the original size as a varint, followed by sequences of a token byte (literal count and
+// match length in 4 bits each, 15 meaning more length bytes follow), the literals, a 16-bit
+// little-endian match offset and the extra match length bytes. The last sequence has no match.
+std::string lzCompress(const std::string& input);
+// False if input isn't a valid stream; never reads or writes out of bounds on bad input
+bool lzDecompress(const std::string& input, std::string& output);
+
+#endif //LZCODEC_HPP
@@ -1,13 +1,27 @@
 #include <string>
-#include "bmpProcessor.hpp"
-#include "ppmProcessor.hpp"
+#include "steganography.hpp"
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include "threadPool.hpp"
+#include "batchProcessor.hpp"
+#include "streamPipeline.hpp"
+#include "shardedPayload.hpp"
+#include "carrierIndex.hpp"
+#include "stegStats.hpp"
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 void printHelp() {
     std::cout << "Image Steganography - Help\n"
           << "---------------------------------------------\n"
           << "This program allows you to hide and read messages\n"
-          << "in image files of type .bmp and .ppm\n\n"
+          << "in image files of type .bmp, .ppm, .pgm and .pam\n\n"
           << "Usage:\n"
           << "  program [flag] [arguments...]\n\n"
           << "Available flags:\n"
@@ -17,10 +31,64 @@ void printHelp() {
           << "  -d, --decrypt [file]       Read a hidden message from the image\n"
           << "  -c, --check [file] [\"message\"]\n"
           << "                             Check if the message can be stored in the image\n"
+          << "  -s, --shard [files...]     Hide the --encrypt-file payload split over all the images,\n"
+          << "                             for payloads larger than any one of them\n"
+          << "  -u, --unshard [files...]   Read a payload split with --shard back from all its images\n"
+          << "  -a, --analyze [files...]   Score how likely each image is to carry an LSB payload (not\n"
+          << "                             only one of this program), \"-\" reads the paths from standard input\n"
+          << "  -x, --index [dir]          Index the images of the directory for --pick; run again to take\n"
+          << "                             in new and changed images\n"
+          << "  -p, --pick [bytes] [dir]   Print and claim the indexed image with the least capacity that\n"
+          << "                             still holds a payload of that many bytes\n"
+          << "  -b, --batch [manifest]     Process every \"path<TAB>message\" (encrypt) or \"path\" (decrypt)\n"
+          << "                             line of the manifest, \"-\" reads it from standard input\n"
           << "  -h, --help                 Display this help screen\n\n"
+          << "Options:\n"
+          << "  --bits-per-channel [K]     Low bits of every color channel that carry the message, 1 to 4\n"
+          << "                             (default: 1). Decryption detects the value on its own.\n"
+          << "  --compress                 Compress the message before hiding it, for -e, -c, -b and -s; it is\n"
+          << "                             stored uncompressed when that doesn't make it smaller\n"
+          << "  --delta                    Only write the image bytes that change, for -e and -b on files;\n"
+          << "                             fast when re-embedding into an image that holds a similar payload\n"
+          << "  --key [text]               Scatter the message over the whole image in an order derived\n"
+          << "                             from the key, for -e, -d, -b, -s and -u; decryption needs\n"
+          << "                             the same key\n"
+          << "  --encrypt-file [file]      Hide the contents of the file (any binary data) instead of a\n"
+          << "                             message argument, for -e, -c and -s\n"
+          << "  --decrypt-to [file]        Write the extracted payload to the file instead of printing it,\n"
+          << "                             \"-\" for standard output\n"
+          << "  --threads [N]              Threads used for large images and batches (default: all cores)\n"
+          << "  --max-open [N]             Images open at the same time in batch, shard, analyze and index mode\n"
+          << "                             (default: 64)\n"
+          << "  --in [file]                Input image instead of the file argument, \"-\" for standard input\n"
+          << "  --out [file]               Write the encrypted image there instead of modifying the input,\n"
+          << "                             \"-\" for standard output. A file is replaced as with --atomic\n"
+          << "  --atomic                   Embed into a copy of the image and rename it over the original\n"
+          << "                             once it is on disk, so a crash never leaves a half written\n"
+          << "                             image (-e, -b and -s; batches and shards flush their copies together)\n"
+          << "  --io-backend [name]        How -b reads and writes the images: mapped (default, every image\n"
+          << "                             mapped on a thread of its own), io_uring (the reads and writes\n"
+          << "                             of many images queued to the kernel at once, Linux) or threads\n"
+          << "                             (the same queue served by threads doing pread and pwrite)\n"
+          << "  --stats                    Print the time spent per phase (header parse, frame build, pixel\n"
+          << "                             I/O, final write) and I/O counters to standard error when done\n"
+          << "  --trace [file]             Write the phases as Chrome trace JSON (chrome://tracing, Perfetto)\n\n"
           << "Notes:\n"
           << "  - The message for -e and -c should be enclosed in quotation marks.\n"
-          << "  - Supported formats: .bmp, .ppm\n"
+          << "  - A file argument of \"-\" reads a BMP or binary Netpbm (P5/P6/P7) image from standard input;\n"
+          << "    the encrypted image then goes to standard output unless --out is given.\n"
+          << "  - P3 (text) PPM images only support 1 bit per channel and no --key.\n"
+          << "  - 8-bit (paletted) BMP images only support 1 bit per channel; their palette is reordered\n"
+          << "    (the image looks the same) and needs an even number of colors.\n"
+          << "  - Binary Netpbm images take as many bits per channel as their max value has low bits set\n"
+          << "    (4 for 255), and none with an even max value.\n"
+          << "  - -a prints \"path ok score chi-square-p rs-estimate sequential-share\" per image, with\n"
+          << "    values from 0 (clean) to 1; the score is the larger of the last two.\n"
+          << "  - -p only prints the path of the image, which is claimed and never picked again; images\n"
+          << "    that changed since -x indexed them are passed over.\n"
+          << "  - -u needs every image -s wrote to, in any order; --key and --bits-per-channel apply to\n"
+          << "    every image of the set.\n"
+          << "  - Supported formats: .bmp, .ppm, .pgm, .pam (.pnm), with 8 or 16-bit samples\n"
           << "  - Formats like .jpg and .png are not supported without additional libraries\n"
           << "  - In case of syntax errors or missing arguments,\n"
           << "    this help screen will be displayed.\n"
@@ -28,143 +96,386 @@ void printHelp() {
 
 }
 
-std::string getFileExtension(const std::string& filename) {
-    size_t dotPos = filename.find_last_of('.');
-    if (dotPos == std::string::npos) return "";
-    return filename.substr(dotPos + 1);
+void printError(const stegStatus& status) {
+    std::cerr << "Error: " << status.detail << std::endl;
 }
-enum class FileType { UNKNOWN, BMP, PPM };
 
-FileType detectFileType(const std::string& path) {
-    std::string ext = getFileExtension(path);
-    if (ext == "bmp") return FileType::BMP;
-    if (ext == "ppm") return FileType::PPM;
-    return FileType::UNKNOWN;
+void printInfo(const imageDescription& description) {
+    const pixelLayout& layout = description.layout;
+    if (description.format == imageFormat::BMP) {
+        std::cout << "--- BMP Header Info ---" << std::endl;
+        std::cout << "File Size: " << description.fileSize << " bytes" << std::endl;
+        std::cout << "Data Offset: " << layout.dataOffset << " bytes" << std::endl;
+        std::cout << "Header Size: " << description.headerSize << " bytes" << std::endl;
+        std::cout << "Width: " << description.width << " pixels" << std::endl;
+        std::cout << "Height: " << description.height << " pixels" << (layout.topDown ? " (top-down)" : "") << std::endl;
+        std::cout << "Bits Per Pixel: " << description.bitsPerPixel << std::endl;
+        std::cout << "Compression: " << (description.compression == 0 ? "None" : std::to_string(description.compression)) << std::endl;
+        std::cout << "Image Size: " << layout.rowStride * layout.rows << " bytes" << std::endl;
+    } else {
+        static constexpr const char* netpbmFormats[] = {"", "P3", "P6", "P5", "P7"};
+        std::cout << "--- PPM Header Info ---" << std::endl;
+        std::cout << "Format: " << netpbmFormats[static_cast<int>(description.format)] << std::endl;
+        std::cout << "Width: " << description.width << " pixels" << std::endl;
+        std::cout << "Height: " << description.height << " pixels" << std::endl;
+        std::cout << "Max Channel Value: " << description.maxChannelValue << std::endl;
+        std::cout << "Bits Per Pixel: " << description.bitsPerPixel << std::endl;
+        std::cout << "Image Size: " << layout.rowStride * layout.rows << " bytes" << std::endl;
+    }
+    std::cout << "-----------------------" << std::endl;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        printHelp();
-        return 1;
+bool readPayloadFile(const std::string& filePath, std::string& payload) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
     }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    payload = contents.str();
+    return !file.bad();
+}
 
-    std::string flag = argv[1];
+// Writes an extracted payload as is, "-" stands for standard output
+bool writePayloadFile(const std::string& filePath, const std::string& payload) {
+    if (filePath == "-") {
+        return static_cast<bool>(std::cout.write(payload.data(), static_cast<std::streamsize>(payload.size())).flush());
+    }
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    return file.is_open() && file.write(payload.data(), static_cast<std::streamsize>(payload.size())).flush();
+}
 
-    if (flag == "-h" || flag == "--help") {
-        printHelp();
+// Prints an extracted payload or writes it to extractPath, and the outcome of the decryption
+int reportDecrypted(const stegStatus& status, const std::string& message, const std::string& extractPath) {
+    if (status && !extractPath.empty()) {
+        if (!writePayloadFile(extractPath, message)) {
+            std::cerr << "Error: Payload file can't be written (" << extractPath << ").\n";
+            return 1;
+        }
+        // The payload itself may be going to standard output
+        std::ostream& report = extractPath == "-" ? std::cerr : std::cout;
+        report << "Payload written to " << (extractPath == "-" ? "standard output" : extractPath) << " (" << message.size() << " bytes)\n";
+        report << "Message decrypted successfully\n";
+        return 0;
+    }
+    if (status) {
+        std::cout << "Extracted message: " << message << std::endl;
+        std::cout << "Message decrypted successfully\n";
         return 0;
     }
+    printError(status);
+    std::cerr << "Error: message decrypted unsuccessfully\n";
+    return 1;
+}
 
-    if ((flag == "-i" || flag == "--info") && argc == 3) {
-        std::string filePath = argv[2];
-        FileType type = detectFileType(filePath);
+#ifdef STEG_STATS
+// Reports the statistics once main returns, whichever command ran
+struct statsReport {
+    bool print = false;
+    std::string tracePath;
 
-        switch (type) {
-            case FileType::BMP: {
-                bmpObject bmp(filePath);
-                if (!bmp.isHeaderCorrect()) return std::cerr << "Invalid BMP header\n", 1;
-                bmp.printInfo();
-                return 0;
-            }
-            case FileType::PPM: {
-                ppmObject ppm(filePath);
-                if (!ppm.isHeaderCorrect()) return std::cerr << "Invalid PPM header\n", 1;
-                ppm.printInfo();
-                return 0;
-            }
-            default:
-                std::cerr << "Unsupported file format.\n";
-                return 1;
+    ~statsReport() {
+        if (print) {
+            printStats(std::cerr);
+        }
+        if (!tracePath.empty() && !writeTrace(tracePath)) {
+            std::cerr << "Error: Trace file can't be written (" << tracePath << ").\n";
         }
     }
+};
+#endif
 
-    if ((flag == "-e" || flag == "--encrypt") && argc == 4) {
-        std::string filePath = argv[2];
-        std::string message = argv[3];
-        FileType type = detectFileType(filePath);
+// Encryption through a forward-only stream, "-" stands for standard input/output
+int encryptThroughStream(const std::string& inputPath, const std::string& outputPath, const std::string& message, const stegOptions& options) {
+    std::ifstream inputFile;
+    std::ofstream outputFile;
+    std::istream* input = &std::cin;
+    std::ostream* output = &std::cout;
+    if (inputPath != "-") {
+        inputFile.open(inputPath, std::ios::binary);
+        if (!inputFile.is_open()) {
+            std::cerr << "Error: File can't be opened.\n";
+            return 1;
+        }
+        input = &inputFile;
+    }
+    if (!outputPath.empty() && outputPath != "-") {
+        outputFile.open(outputPath, std::ios::binary | std::ios::trunc);
+        if (!outputFile.is_open()) {
+            std::cerr << "Error: Output file can't be opened.\n";
+            return 1;
+        }
+        output = &outputFile;
+    }
+    // The image itself may be going to standard output
+    std::ostream& status = output == &std::cout ? std::cerr : std::cout;
+    const stegStatus result = encryptStream(*input, *output, message, options);
+    if (result) {
+        status << "Message encrypted successfully\n";
+        return 0;
+    }
+    printError(result);
+    std::cerr << "Error: message encrypted unsuccessfully\n";
+    return 1;
+}
 
-        switch (type) {
-            case FileType::BMP: {
-                bmpObject bmp(filePath);
-                if (bmp.isHeaderCorrect() && bmp.isEncryptPossible(message) && bmp.encryption(message)) {
-                    std::cout << "Message encrypted successfully\n";
-                    return 0;
-                }
-                std::cerr << "Error: message encrypted unsuccessfully\n";
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+    // Images piped through standard input/output must not get newline translation
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::vector<std::string> args(argv + 1, argv + argc);
+    unsigned maxOpenFiles = 64;
+    stegOptions options;
+    bool atomicWrites = false;
+    ioBackend backend = ioBackend::MAPPED;
+    std::string inputPath, outputPath, payloadPath, extractPath;
+#ifdef STEG_STATS
+    statsReport report;
+#endif
+    // Options may follow the command and its arguments
+    for (size_t i = 0; i < args.size();) {
+        if ((args[i] == "--in" || args[i] == "--out") && i + 1 < args.size()) {
+            (args[i] == "--in" ? inputPath : outputPath) = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (args[i] == "--key" && i + 1 < args.size()) {
+            options.key = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if ((args[i] == "--encrypt-file" || args[i] == "--decrypt-to") && i + 1 < args.size()) {
+            (args[i] == "--encrypt-file" ? payloadPath : extractPath) = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (args[i] == "--compress") {
+            options.codec = payloadCodec::LZ;
+            args.erase(args.begin() + i);
+        } else if (args[i] == "--delta") {
+            options.deltaWrite = true;
+            args.erase(args.begin() + i);
+        } else if (args[i] == "--atomic") {
+            atomicWrites = true;
+            args.erase(args.begin() + i);
+        } else if (args[i] == "--io-backend" && i + 1 < args.size()) {
+            const std::string& name = args[i + 1];
+            if (name == "mapped") {
+                backend = ioBackend::MAPPED;
+            } else if (name == "io_uring" || name == "threads") {
+#ifdef _WIN32
+                std::cerr << "Error: --io-backend " << name << " isn't available on Windows.\n";
+                return 1;
+#endif
+                backend = name == "io_uring" ? ioBackend::IO_URING : ioBackend::THREADS;
+            } else {
+                std::cerr << "Error: Invalid value for --io-backend (" << name << ").\n";
                 return 1;
             }
-            case FileType::PPM: {
-                ppmObject ppm(filePath);
-                if (ppm.isHeaderCorrect() && ppm.isEncryptPossible(message) && ppm.encryption(message)) {
-                    std::cout << "Message encrypted successfully\n";
-                    return 0;
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else if (args[i] == "--stats" || (args[i] == "--trace" && i + 1 < args.size())) {
+#ifdef STEG_STATS
+            if (args[i] == "--stats") report.print = true;
+            else report.tracePath = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + (args[i] == "--stats" ? 1 : 2));
+#else
+            std::cerr << "Error: " << args[i] << " isn't available, the program was built with STEG_STATS=OFF.\n";
+            return 1;
+#endif
+        } else if ((args[i] == "--threads" || args[i] == "--max-open" || args[i] == "--bits-per-channel") && i + 1 < args.size()) {
+            unsigned value;
+            try {
+                value = static_cast<unsigned>(std::stoul(args[i + 1]));
+                if (args[i] == "--bits-per-channel" && (value < 1 || value > maxBitsPerChannel)) {
+                    throw std::out_of_range(args[i]);
                 }
-                std::cerr << "Error: message encrypted unsuccessfully\n";
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid value for " << args[i] << " (" << args[i + 1] << ").\n";
                 return 1;
             }
-            default:
-                std::cerr << "Unsupported file format.\n";
-                return 1;
+            if (args[i] == "--threads") setThreadCount(value);
+            else if (args[i] == "--bits-per-channel") options.bitsPerChannel = value;
+            else maxOpenFiles = value;
+            args.erase(args.begin() + i, args.begin() + i + 2);
+        } else {
+            ++i;
         }
     }
+    if (args.empty()) {
+        printHelp();
+        return 1;
+    }
+#ifdef STEG_STATS
+    if (report.print || !report.tracePath.empty()) {
+        enableStats(!report.tracePath.empty());
+    }
+#endif
+    // --in stands in for the file argument of the command
+    if (!inputPath.empty()) {
+        args.insert(args.begin() + 1, inputPath);
+    }
 
-    if ((flag == "-d" || flag == "--decrypt") && argc == 3) {
-        std::string filePath = argv[2];
-        FileType type = detectFileType(filePath);
+    std::string flag = args[0];
+    // --encrypt-file stands in for the message argument
+    std::string messageLabel;
+    if (!payloadPath.empty() && args.size() == 2 && (flag == "-e" || flag == "--encrypt" || flag == "-c" || flag == "--check")) {
+        std::string payload;
+        if (!readPayloadFile(payloadPath, payload)) {
+            std::cerr << "Error: Payload file can't be read (" << payloadPath << ").\n";
+            return 1;
+        }
+        args.push_back(std::move(payload));
+        messageLabel = "the contents of " + payloadPath;
+    } else if (args.size() == 3) {
+        messageLabel = "\"" + args[2] + "\"";
+    }
 
-        switch (type) {
-            case FileType::BMP: {
-                bmpObject bmp(filePath);
-                if (bmp.isHeaderCorrect() && bmp.decryption()) {
-                    std::cout << "Message decrypted successfully\n";
-                    return 0;
-                }
-                std::cerr << "Error: message decrypted unsuccessfully\n";
-                return 1;
-            }
-            case FileType::PPM: {
-                ppmObject ppm(filePath);
-                if (ppm.isHeaderCorrect() && ppm.decryption()) {
-                    std::cout << "Message decrypted successfully\n";
-                    return 0;
-                }
-                std::cerr << "Error: message decrypted unsuccessfully\n";
-                return 1;
+    if (flag == "-h" || flag == "--help") {
+        printHelp();
+        return 0;
+    }
+
+    if ((flag == "-i" || flag == "--info") && args.size() == 2) {
+        imageDescription description;
+        const stegStatus status = describeImageFile(args[1], description);
+        if (!status) {
+            printError(status);
+            return 1;
+        }
+        printInfo(description);
+        return 0;
+    }
+
+    if ((flag == "-e" || flag == "--encrypt") && args.size() == 3) {
+        std::string filePath = args[1];
+        std::string message = args[2];
+        if (filePath == "-" || outputPath == "-") {
+            return encryptThroughStream(filePath, outputPath, message, options);
+        }
+        // A copy of the input replaces the output in one rename, the input itself is left alone
+        const embedResult result = outputPath.empty() && !atomicWrites
+                                 ? embedInImageFile(filePath, asBytes(message), options)
+                                 : embedInImageFileAtomic(filePath, outputPath.empty() ? filePath : outputPath, asBytes(message), options);
+        if (result.status) {
+            if (options.deltaWrite) {
+                std::cout << "Pixel bytes written: " << result.bytesWritten << "\n";
             }
-            default:
-                std::cerr << "Unsupported file format.\n";
-                return 1;
+            std::cout << "Message encrypted successfully\n";
+            return 0;
+        }
+        printError(result.status);
+        std::cerr << "Error: message encrypted unsuccessfully\n";
+        return 1;
+    }
+
+    if ((flag == "-d" || flag == "--decrypt") && args.size() == 2) {
+        std::string filePath = args[1];
+        std::string message;
+        stegStatus status;
+        if (filePath == "-") {
+            status = decryptStream(std::cin, message, options);
+        } else {
+            const extractResult result = extractFromImageFile(filePath, options);
+            status = result.status;
+            message = asText(result.payload);
         }
+        return reportDecrypted(status, message, extractPath);
     }
 
-    if ((flag == "-c" || flag == "--check") && argc == 4) {
-        std::string filePath = argv[2];
-        std::string message = argv[3];
-        FileType type = detectFileType(filePath);
+    if ((flag == "-s" || flag == "--shard") && args.size() >= 2 && !payloadPath.empty()) {
+        std::string payload;
+        if (!readPayloadFile(payloadPath, payload)) {
+            std::cerr << "Error: Payload file can't be read (" << payloadPath << ").\n";
+            return 1;
+        }
+        const std::vector<std::string> carriers(args.begin() + 1, args.end());
+        const stegStatus status = embedSharded(carriers, asBytes(payload), options, maxOpenFiles, atomicWrites);
+        if (status) {
+            std::cout << "Payload of " << payload.size() << " bytes split over " << carriers.size() << " images\n";
+            std::cout << "Message encrypted successfully\n";
+            return 0;
+        }
+        printError(status);
+        std::cerr << "Error: message encrypted unsuccessfully\n";
+        return 1;
+    }
 
-        switch (type) {
-            case FileType::BMP: {
-                bmpObject bmp(filePath);
-                if (bmp.isEncryptPossible(message)) {
-                    std::cout << "Encrypting following message: \"" + message + "\" is possible\n";
-                    return 0;
-                }
-                std::cerr << "Encrypting following message: \"" + message + "\" is impossible\n";
-                return 1;
+    if ((flag == "-u" || flag == "--unshard") && args.size() >= 2) {
+        const extractResult result = extractSharded(std::vector<std::string>(args.begin() + 1, args.end()), options, maxOpenFiles);
+        return reportDecrypted(result.status, asText(result.payload), extractPath);
+    }
+
+    if ((flag == "-c" || flag == "--check") && args.size() == 3) {
+        std::string message = args[2];
+        imageDescription description;
+        const stegStatus status = describeImageFile(args[1], description);
+        if (!status) {
+            printError(status);
+        } else {
+            const unsigned maxBits = std::max(1u, description.bitsPerChannelLimit());
+            std::cout << "Capacity:";
+            for (unsigned bits = 1; bits <= maxBits; ++bits) {
+                std::cout << (bits > 1 ? ", " : " ") << description.capacityBytes(bits) << " bytes at " << bits
+                          << (bits > 1 ? " bits" : " bit") << " per channel";
             }
-            case FileType::PPM: {
-                ppmObject ppm(filePath);
-                if (ppm.isEncryptPossible(message)) {
-                    std::cout << "Encrypting following message: \"" + message + "\" is possible\n";
-                    return 0;
-                }
-                std::cerr << "Encrypting following message: \"" + message + "\" is impossible\n";
-                return 1;
+            std::cout << std::endl;
+            const size_t embeddedBytes = embeddedPayloadBytes(asBytes(message), options);
+            if (options.codec != payloadCodec::RAW) {
+                std::cout << "Compressed size: " << embeddedBytes << " of " << message.size() << " bytes"
+                          << (embeddedBytes < message.size() ? "" : " (stored uncompressed)") << std::endl;
             }
-            default:
-                std::cerr << "Unsupported file format.\n";
-                return 1;
+            if (embeddedBytes <= description.capacityBytes(options.bitsPerChannel)) {
+                std::cout << "Encrypting following message: " + messageLabel + " is possible\n";
+                return 0;
+            }
+        }
+        std::cerr << "Encrypting following message: " + messageLabel + " is impossible\n";
+        return 1;
+    }
+
+    if ((flag == "-a" || flag == "--analyze") && args.size() >= 2) {
+        if (args.size() == 2 && args[1] == "-") {
+            return runAnalysis(std::cin, std::cout, maxOpenFiles) == 0 ? 0 : 1;
+        }
+        std::stringstream paths;
+        for (size_t i = 1; i < args.size(); ++i) paths << args[i] << '\n';
+        return runAnalysis(paths, std::cout, maxOpenFiles) == 0 ? 0 : 1;
+    }
+
+    if ((flag == "-x" || flag == "--index") && args.size() == 2) {
+        const indexUpdate update = updateCarrierIndex(args[1], maxOpenFiles);
+        if (!update.status) {
+            printError(update.status);
+            return 1;
+        }
+        std::cout << "Indexed " << update.carriers << " images in " << args[1] << " (" << update.unchanged << " unchanged, "
+                  << update.skipped << " skipped)\n";
+        return 0;
+    }
+
+    if ((flag == "-p" || flag == "--pick") && args.size() == 3) {
+        size_t payloadBytes;
+        try {
+            payloadBytes = static_cast<size_t>(std::stoull(args[1]));
+        } catch (const std::exception&) {
+            std::cerr << "Error: Invalid payload size (" << args[1] << ").\n";
+            return 1;
+        }
+        const carrierPick pick = pickCarrier(args[2], payloadBytes, options.bitsPerChannel);
+        if (!pick.status) {
+            printError(pick.status);
+            return 1;
+        }
+        std::cout << pick.path << "\n";
+        return 0;
+    }
+
+    if ((flag == "-b" || flag == "--batch") && args.size() == 2) {
+        if (args[1] == "-") {
+            return runBatch(std::cin, std::cout, maxOpenFiles, options, atomicWrites, backend) == 0 ? 0 : 1;
+        }
+        std::ifstream manifest(args[1]);
+        if (!manifest.is_open()) {
+            std::cerr << "Error: Manifest can't be opened.\n";
+            return 1;
         }
+        return runBatch(manifest, std::cout, maxOpenFiles, options, atomicWrites, backend) == 0 ? 0 : 1;
     }
 
     std::cerr << "Invalid usage.\n";
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "paletteOrder.hpp"
+#include "helpFunctions.hpp"
+
+// Squared color distance, the channels weighted roughly by how much the eye notices them
+static uint32_t colorDistance(const unsigned char* a, const unsigned char* b) {
+    const int blue = a[0] - b[0];
+    const int green = a[1] - b[1];
+    const int red = a[2] - b[2];
+    return static_cast<uint32_t>(3 * blue * blue + 4 * green * green + 2 * red * red);
+}
+
+paletteOrder pairPalette(const unsigned char* palette, const size_t colors) {
+    paletteOrder order;
+    for (unsigned i = 0; i < 256; ++i) order.newIndex[i] = static_cast<unsigned char>(i);
+    std::vector<uint32_t> entries(colors);
+    for (size_t i = 0; i < colors; ++i) entries[i] = loadLittleEndian<uint32_t>(palette + 4 * i);
+
+    // Closest pairs first. Ties go by the entries themselves and only then by their indices, which
+    // just tells identical entries apart, so the pairs don't depend on where the colors sit.
+    struct candidate {
+        uint32_t distance;
+        uint32_t low;
+        uint32_t high;
+        unsigned char first;
+        unsigned char second;
+    };
+    std::vector<candidate> candidates;
+    candidates.reserve(colors * (colors - 1) / 2);
+    for (size_t i = 0; i < colors; ++i) {
+        for (size_t j = i + 1; j < colors; ++j) {
+            candidates.push_back({colorDistance(palette + 4 * i, palette + 4 * j), std::min(entries[i], entries[j]),
+                                  std::max(entries[i], entries[j]), static_cast<unsigned char>(i), static_cast<unsigned char>(j)});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b) {
+        return a.distance != b.distance ? a.distance < b.distance : a.low != b.low ? a.low < b.low : a.high != b.high ? a.high < b.high
+             : a.first != b.first ? a.first < b.first : a.second < b.second;
+    });
+    std::vector<char> paired(colors, 0);
+    std::vector<std::pair<unsigned char, unsigned char>> pairs;
+    for (const candidate& pair : candidates) {
+        if (paired[pair.first] || paired[pair.second]) continue;
+        paired[pair.first] = paired[pair.second] = 1;
+        // The smaller entry first, identical ones in index order
+        const bool swap = entries[pair.second] < entries[pair.first];
+        pairs.emplace_back(swap ? pair.second : pair.first, swap ? pair.first : pair.second);
+    }
+    std::stable_sort(pairs.begin(), pairs.end(), [&](const auto& a, const auto& b) {
+        return entries[a.first] != entries[b.first] ? entries[a.first] < entries[b.first] : entries[a.second] < entries[b.second];
+    });
+
+    for (size_t k = 0; k < pairs.size(); ++k) {
+        order.newIndex[pairs[k].first] = static_cast<unsigned char>(2 * k);
+        order.newIndex[pairs[k].second] = static_cast<unsigned char>(2 * k + 1);
+    }
+    // Moving identical entries around changes nothing worth rewriting the image for
+    for (size_t i = 0; i < colors && !order.changes; ++i) {
+        order.changes = entries[i] != entries[order.newIndex[i]];
+    }
+    return order;
+}
+void reorderPalette(unsigned char* palette, const size_t colors, const paletteOrder& order) {
+    std::vector<unsigned char> original(palette, palette + 4 * colors);
+    for (size_t i = 0; i < colors; ++i) {
+        std::memcpy(palette + 4 * order.newIndex[i], original.data() + 4 * i, 4);
+    }
+}
+void remapIndices(const pixelView& view, const paletteOrder& order) {
+    for (size_t y = 0; y < view.rows; ++y) {
+        unsigned char* row = view.row(y);
+        for (size_t x = 0; x < view.rowBytes; ++x) row[x] = order.newIndex[row[x]];
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef PALETTEORDER_HPP
+#define PALETTEORDER_HPP
+#include <cstddef>
+#include "pixelAccess.hpp"
+
+// 8-bit BMPs carry the payload in the lowest bit of their palette indices, so embedding turns
+// index 2k into 2k + 1 and back. That only goes unseen when the two entries hold near-identical
+// colors, which an arbitrary palette doesn't guarantee. Before embedding, the palette is put in
+// pair order (as EZStego does): entries are paired greedily, closest colors first, and every pair
+// takes two neighbouring indices. The pixel indices are rewritten to match, so the image looks
+// the same, and extraction, which only reads the index bits, is unchanged.
+struct paletteOrder {
+    unsigned char newIndex[256];   // where every index moves to; indices past the palette stay
+    bool changes = false;          // false when the palette already is in pair order
+};
+
+// Order for a palette of colors entries of 4 bytes (blue, green, red, reserved), an even number.
+// It only depends on the colors, not on where they are, so a palette in pair order stays as it is.
+paletteOrder pairPalette(const unsigned char* palette, size_t colors);
+// Moves the palette entries to their new indices
+void reorderPalette(unsigned char* palette, size_t colors, const paletteOrder& order);
+// Rewrites the pixel indices of the view's rows, padding left alone
+void remapIndices(const pixelView& view, const paletteOrder& order);
+
+#endif //PALETTEORDER_HPP
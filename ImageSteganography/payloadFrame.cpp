@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "payloadFrame.hpp"
+#include "crc32c.hpp"
+#include "lzCodec.hpp"
+#include "helpFunctions.hpp"
+#include "lsbKernels.hpp"
+#include "keyedScatter.hpp"
+#include "stegStats.hpp"
+
+static constexpr unsigned char frameMagic[4] = {'S', 't', 'g', 'F'};
+// The checksum covers everything in the header before the checksum itself
+static constexpr size_t checkedHeaderBytes = 16;
+
+std::string buildFrame(const std::string& payload, const unsigned bitsPerChannel, payloadCodec codec) {
+    STEG_PHASE(FRAME_BUILD);
+    std::string compressed;
+    if (codec == payloadCodec::LZ) {
+        compressed = lzCompress(payload);
+        if (compressed.size() >= payload.size()) {
+            codec = payloadCodec::RAW;
+        }
+    }
+    const std::string& stored = codec == payloadCodec::RAW ? payload : compressed;
+
+    unsigned char header[frameHeaderSize] = {};
+    std::memcpy(header, frameMagic, sizeof(frameMagic));
+    header[4] = static_cast<unsigned char>(frameVersion);
+    header[5] = static_cast<unsigned char>(bitsPerChannel);
+    header[6] = static_cast<unsigned char>(codec);
+    storeLittleEndian<uint64_t>(header + 8, stored.size());
+    const uint32_t checksum = crc32c(stored.data(), stored.size(), crc32c(header, checkedHeaderBytes));
+    storeLittleEndian<uint32_t>(header + 16, checksum);
+
+    std::string frame;
+    frame.reserve(frameHeaderSize + stored.size());
+    frame.append(reinterpret_cast<const char*>(header), frameHeaderSize);
+    frame += stored;
+    return frame;
+}
+size_t storedPayloadSize(const std::string& payload, const payloadCodec codec) {
+    if (codec == payloadCodec::RAW) {
+        return payload.size();
+    }
+    return std::min(payload.size(), lzCompress(payload).size());
+}
+bool parseFrameHeader(const unsigned char* bytes, frameHeader& header) {
+    if (std::memcmp(bytes, frameMagic, sizeof(frameMagic)) != 0 || bytes[4] != frameVersion
+        || bytes[5] < 1 || bytes[5] > maxBitsPerChannel || bytes[6] > static_cast<unsigned char>(payloadCodec::LZ) || bytes[7] != 0) {
+        return false;
+    }
+    header.bitsPerChannel = bytes[5];
+    header.codec = static_cast<payloadCodec>(bytes[6]);
+    header.payloadBytes = loadLittleEndian<uint64_t>(bytes + 8);
+    header.checksum = loadLittleEndian<uint32_t>(bytes + 16);
+    return true;
+}
+stegStatus unpackFrame(const frameHeader& header, std::string& frame) {
+    const uint32_t checksum = crc32c(frame.data() + frameHeaderSize, frame.size() - frameHeaderSize,
+                                     crc32c(frame.data(), checkedHeaderBytes));
+    if (checksum != header.checksum) {
+        return {stegError::CORRUPT_PAYLOAD, "Hidden payload is corrupt (checksum mismatch)."};
+    }
+    frame.erase(0, frameHeaderSize);
+    if (header.codec == payloadCodec::LZ) {
+        std::string payload;
+        if (!lzDecompress(frame, payload)) {
+            return {stegError::CORRUPT_PAYLOAD, "Hidden payload can't be decompressed."};
+        }
+        frame = std::move(payload);
+    }
+    return {};
+}
+
+// A header found at the wrong depth is a coincidence, as is a length the image can't hold
+static bool isPlausibleHeader(const unsigned char* bytes, const unsigned bitsPerChannel, const size_t channelCount, frameHeader& header) {
+    return parseFrameHeader(bytes, header) && header.bitsPerChannel == bitsPerChannel
+           && header.payloadBytes <= channelCount * bitsPerChannel / 8 && header.frameBits() <= channelCount * bitsPerChannel;
+}
+stegStatus findFrameHeader(const pixelView& view, const size_t channelCount, frameHeader& header) {
+    std::string bytes(frameHeaderSize, '\0');
+    for (unsigned bitsPerChannel = 1; bitsPerChannel <= maxBitsPerChannel; ++bitsPerChannel) {
+        if (view.channelCount() * bitsPerChannel < frameHeaderSize * 8) {
+            continue;
+        }
+        size_t bitIndex = 0;
+        extractPayloadFromView(view, bytes, bitIndex, bitsPerChannel);
+        if (isPlausibleHeader(reinterpret_cast<const unsigned char*>(bytes.data()), bitsPerChannel, channelCount, header)) {
+            return {};
+        }
+    }
+    return {stegError::NO_PAYLOAD, "No hidden payload found in this image."};
+}
+stegStatus extractFrameFromView(const pixelView& view, std::string& payload) {
+    frameHeader header;
+    if (stegStatus status = findFrameHeader(view, view.channelCount(), header); !status) {
+        return status;
+    }
+    std::string frame(header.frameBits() / 8, '\0');
+    size_t bitIndex = 0;
+    extractPayloadFromView(view, frame, bitIndex, header.bitsPerChannel);
+    if (stegStatus status = unpackFrame(header, frame); !status) {
+        return status;
+    }
+    payload = std::move(frame);
+    return {};
+}
+
+stegStatus extractFrameFromRows(const pixelLayout& layout, const std::function<size_t(unsigned char*, size_t)>& read,
+                                const size_t blockSize, std::string& payload) {
+    if (layout.channelCount() == 0) {
+        return {stegError::NO_PAYLOAD, "No hidden payload found in this image."};
+    }
+    std::vector<unsigned char> block;
+    auto readRows = [&](const size_t firstRow, const size_t rows) {
+        pixelLayout blockLayout = layout;
+        blockLayout.rows = rows;
+        block.resize(rows * layout.rowStride);
+        if (read(block.data(), block.size()) < blockLayout.regionSize()) {
+            return stegStatus(stegError::READ_FAILED, "Pixel data can't be read at row " + std::to_string(firstRow) + ".");
+        }
+        return stegStatus();
+    };
+
+    // The header sits in the first rows, enough of them for one bit per channel
+    const size_t rowChannels = layout.rowChannels();
+    const size_t headerRows = std::min(layout.rows, (frameHeaderSize * 8 + rowChannels - 1) / rowChannels);
+    if (stegStatus status = readRows(0, headerRows); !status) {
+        return status;
+    }
+    frameHeader header;
+    const pixelView headerView = layout.view(block.data(), headerRows);
+    if (stegStatus status = findFrameHeader(headerView, layout.channelCount(), header); !status) {
+        return status;
+    }
+    std::string frame(header.frameBits() / 8, '\0');
+    size_t bitIndex = 0;
+    extractPayloadFromView(headerView, frame, bitIndex, header.bitsPerChannel);
+
+    const size_t rowsNeeded = std::min(layout.rows, (header.frameChannels() + rowChannels - 1) / rowChannels);
+    const size_t rowsPerBlock = std::max<size_t>(1, blockSize / layout.rowStride);
+    for (size_t blockRow = headerRows; blockRow < rowsNeeded; blockRow += rowsPerBlock) {
+        const size_t rows = std::min(rowsPerBlock, rowsNeeded - blockRow);
+        if (stegStatus status = readRows(blockRow, rows); !status) {
+            return status;
+        }
+        extractPayloadFromView(layout.view(block.data(), rows), frame, bitIndex, header.bitsPerChannel);
+    }
+    if (stegStatus status = unpackFrame(header, frame); !status) {
+        return status;
+    }
+    payload = std::move(frame);
+    return {};
+}
+
+stegStatus extractScatteredFrame(const pixelLayout& layout, const std::string& key, const size_t blockSize,
+                                 const rowFetcher& fetch, std::string& payload) {
+    const scatterPermutation permutation(key, layout.channelCount());
+    // Rows less than a sixteenth of a block apart are cheaper to fetch along than to skip
+    const size_t maxRows = std::max<size_t>(1, blockSize / std::max<size_t>(1, layout.rowStride));
+    auto readFrameChannels = [&](const scatterPlan& plan, std::string& frame, const unsigned bitsPerChannel) {
+        for (const rowRun& run : plan.rowRuns(layout.rowChannels(), layout.rows, maxRows / 16, maxRows)) {
+            pixelView window;
+            if (stegStatus status = fetch(run.firstRow, run.rows, window); !status) {
+                return status;
+            }
+            extractScatteredRows(window, run.firstRow, frame, bitsPerChannel, plan);
+        }
+        return stegStatus();
+    };
+
+    // The first frameHeaderSize * 8 channels hold the header at any bits per channel: read all
+    // of their low maxBitsPerChannel bits once and try every setting on them
+    const size_t headerChannels = std::min(frameHeaderSize * 8, layout.channelCount());
+    std::string headerBits((headerChannels * maxBitsPerChannel + 7) / 8, '\0');
+    if (stegStatus status = readFrameChannels(scatterPlan(permutation, headerChannels), headerBits, maxBitsPerChannel); !status) {
+        return status;
+    }
+    frameHeader header;
+    bool found = false;
+    unsigned char bytes[frameHeaderSize];
+    for (unsigned bitsPerChannel = 1; bitsPerChannel <= maxBitsPerChannel && !found; ++bitsPerChannel) {
+        if (headerChannels * bitsPerChannel < frameHeaderSize * 8) {
+            continue;
+        }
+        std::memset(bytes, 0, sizeof(bytes));
+        // Every channel left maxBitsPerChannel bits in headerBits, most significant first, of which
+        // this setting uses the low bitsPerChannel ones
+        for (size_t bit = 0; bit < frameHeaderSize * 8; ++bit) {
+            const size_t channel = bit / bitsPerChannel;
+            const size_t sourceBit = channel * maxBitsPerChannel + (maxBitsPerChannel - bitsPerChannel) + bit % bitsPerChannel;
+            const unsigned value = (static_cast<unsigned char>(headerBits[sourceBit >> 3]) >> (7 - (sourceBit & 7))) & 1;
+            bytes[bit >> 3] |= static_cast<unsigned char>(value << (7 - (bit & 7)));
+        }
+        found = isPlausibleHeader(bytes, bitsPerChannel, layout.channelCount(), header);
+    }
+    if (!found) {
+        return {stegError::NO_PAYLOAD, "No hidden payload found in this image for this key."};
+    }
+
+    std::string frame(header.frameBits() / 8, '\0');
+    if (stegStatus status = readFrameChannels(scatterPlan(permutation, header.frameChannels()), frame, header.bitsPerChannel); !status) {
+        return status;
+    }
+    if (stegStatus status = unpackFrame(header, frame); !status) {
+        return status;
+    }
+    payload = std::move(frame);
+    return {};
+}
+stegStatus extractScatteredFrameFromView(const pixelView& view, const std::string& key, std::string& payload) {
+    pixelLayout layout;
+    layout.rowBytes = view.rowBytes;
+    layout.rowStride = view.rowStride;
+    layout.rows = view.rows;
+    layout.packing = view.packing;
+    return extractScatteredFrame(layout, key, SIZE_MAX, [&](const size_t firstRow, const size_t rows, pixelView& window) {
+        window = view.subView(firstRow, rows);
+        return stegStatus();
+    }, payload);
+}
+
+frameDecoder::frameDecoder(const size_t capacityBytes) : maxPayloadBytes(capacityBytes), frame(frameHeaderSize, '\0') {}
+bool frameDecoder::pushBit(const bool bit) {
+    if (bit) {
+        frame[bitIndex >> 3] = static_cast<char>(frame[bitIndex >> 3] | (0x80 >> (bitIndex & 7)));
+    }
+    ++bitIndex;
+    if (bitIndex == frameHeaderSize * 8) {
+        if (!parseFrameHeader(reinterpret_cast<const unsigned char*>(frame.data()), header) || header.bitsPerChannel != 1
+            || header.payloadBytes > maxPayloadBytes) {
+            status = {stegError::NO_PAYLOAD, "No hidden payload found in this image."};
+            return true;
+        }
+        frame.resize(frameHeaderSize + static_cast<size_t>(header.payloadBytes));
+    }
+    return bitIndex == frame.size() * 8;
+}
+stegStatus frameDecoder::finish(std::string& payload) {
+    if (!status) {
+        return status;
+    }
+    if (bitIndex < frameHeaderSize * 8) {
+        return {stegError::NO_PAYLOAD, "No hidden payload found in this image."};
+    }
+    if (bitIndex < frame.size() * 8) {
+        return {stegError::TRUNCATED_PIXEL_DATA, "Hidden payload is cut off by the end of the pixel data."};
+    }
+    if (stegStatus result = unpackFrame(header, frame); !result) {
+        return result;
+    }
+    payload = std::move(frame);
+    return {};
+}
@@ -0,0 +1,92 @@
+#ifndef PAYLOADFRAME_HPP
+#define PAYLOADFRAME_HPP
+#include <string>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include "pixelAccess.hpp"
+#include "stegStatus.hpp"
+
+// Every hidden payload is stored as a frame: a fixed size header followed by the payload bytes,
+// embedded in one piece with the same bits per channel. The header tells the extractor how many
+// channels to read, so it never scans past the payload and the payload may contain any byte.
+//
+//   offset  size
+//        0     4   magic "StgF"
+//        4     1   format version
+//        5     1   bits per channel the frame is embedded with
+//        6     1   payload codec (payloadCodec)
+//        7     1   reserved, 0
+//        8     8   stored payload length in bytes, little-endian
+//       16     4   CRC-32C of header bytes 0-15 and the stored payload, little-endian
+static constexpr size_t frameHeaderSize = 20;
+static constexpr unsigned frameVersion = 1;
+
+// How the payload bytes are stored in the frame
+enum class payloadCodec : unsigned char {
+    RAW = 0,
+    LZ = 1,     // lzCodec.hpp, only used when it makes the payload smaller
+};
+
+struct frameHeader {
+    unsigned bitsPerChannel = 1;
+    payloadCodec codec = payloadCodec::RAW;
+    uint64_t payloadBytes = 0;     // as stored
+    uint32_t checksum = 0;
+
+    size_t frameBits() const { return (frameHeaderSize + static_cast<size_t>(payloadBytes)) * 8; }
+    // Channels the whole frame occupies
+    size_t frameChannels() const { return (frameBits() + bitsPerChannel - 1) / bitsPerChannel; }
+};
+
+// Header followed by the payload, ready to be embedded. A codec other than RAW compresses the
+// payload, which is stored raw anyway when compression doesn't make it smaller.
+std::string buildFrame(const std::string& payload, unsigned bitsPerChannel, payloadCodec codec = payloadCodec::RAW);
+// Bytes the payload takes inside a frame built with codec, header excluded
+size_t storedPayloadSize(const std::string& payload, payloadCodec codec);
+// False unless bytes start with a header of a known version
+bool parseFrameHeader(const unsigned char* bytes, frameHeader& header);
+// Checks the payload of a complete frame against its header, strips the header off and
+// decompresses what is left
+stegStatus unpackFrame(const frameHeader& header, std::string& frame);
+
+// Looks for a frame header at the start of view, trying every bits per channel setting.
+// view has to cover the first frameHeaderSize * 8 channels of the image (or all of it);
+// channelCount is the channel count of the whole image, used to reject impossible lengths.
+stegStatus findFrameHeader(const pixelView& view, size_t channelCount, frameHeader& header);
+// Finds and reads a whole frame from a view over all pixel rows
+stegStatus extractFrameFromView(const pixelView& view, std::string& payload);
+// Same for pixel rows arriving in order (an unmapped file, a pipe). read fills the buffer with the
+// next rows, whole strides except for the image's last row, and returns the bytes it got. Only
+// the rows holding the frame are read, at most blockSize bytes at a time.
+stegStatus extractFrameFromRows(const pixelLayout& layout, const std::function<size_t(unsigned char*, size_t)>& read,
+                                size_t blockSize, std::string& payload);
+
+// Frames embedded with a key (keyedScatter.hpp) keep their header in their first channels too,
+// wherever the key puts them. fetch provides a view over rows firstRow to firstRow + rows - 1 and
+// is asked for the rows holding the header, then for those holding the frame, each in ascending
+// order and at most blockSize bytes at a time.
+using rowFetcher = std::function<stegStatus(size_t firstRow, size_t rows, pixelView& window)>;
+stegStatus extractScatteredFrame(const pixelLayout& layout, const std::string& key, size_t blockSize,
+                                 const rowFetcher& fetch, std::string& payload);
+// Same over a view of all pixel rows
+stegStatus extractScatteredFrameFromView(const pixelView& view, const std::string& key, std::string& payload);
+
+// Rebuilds a frame one bit at a time, for P3 bodies that store one bit per sample
+struct frameDecoder {
+private:
+    frameHeader header;
+    size_t maxPayloadBytes;
+public:
+    std::string frame;
+    size_t bitIndex = 0;
+    stegStatus status;
+
+    explicit frameDecoder(size_t capacityBytes);
+    // Returns true once the frame is complete or turned out not to be one
+    bool pushBit(bool bit);
+    // Verifies the frame and leaves the payload in payload
+    stegStatus finish(std::string& payload);
+};
+
+#endif //PAYLOADFRAME_HPP
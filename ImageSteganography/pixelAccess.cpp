@@ -0,0 +1,874 @@
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <charconv>
+#include <bit>
+#include <cstdint>
+#include "pixelAccess.hpp"
+#include "helpFunctions.hpp"
+#include "payloadFrame.hpp"
+#include "keyedScatter.hpp"
+#include "paletteOrder.hpp"
+#include "lsbKernels.hpp"
+#include "threadPool.hpp"
+#include "stegStats.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Upper bound for the pixel block read and rewritten at once when the file can't be mapped
+static constexpr size_t streamBlockSize = 4 * 1024 * 1024;
+static constexpr size_t streamFirstExtractBlockSize = 64 * 1024;
+// Below this many channel bytes per band the work isn't worth handing to other threads
+static constexpr size_t minimumBandChannels = 1024 * 1024;
+
+mappedFile::mappedFile() {
+    mapping = nullptr;
+    mappedSize = 0;
+    writable = false;
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#else
+    fileDescriptor = -1;
+#endif
+}
+mappedFile::~mappedFile() {
+    close();
+}
+bool mappedFile::open(const std::string& filePath, const bool openWritable) {
+    close();
+    writable = openWritable;
+#ifdef _WIN32
+    STEG_COUNT(SYSCALLS, 4);
+    fileHandle = CreateFileA(filePath.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                             FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        close();
+        return false;
+    }
+    void* view = MapViewOfFile(mappingHandle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        close();
+        return false;
+    }
+    mapping = static_cast<unsigned char*>(view);
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+    // open, fstat and mmap
+    STEG_COUNT(SYSCALLS, 3);
+    fileDescriptor = ::open(filePath.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fileDescriptor < 0) {
+        return false;
+    }
+    struct stat fileStat {};
+    // Pipes, devices and empty files can't be mapped
+    if (fstat(fileDescriptor, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size == 0) {
+        close();
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fileDescriptor, 0);
+    if (view == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapping = static_cast<unsigned char*>(view);
+    mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+    STEG_COUNT(BYTES_MAPPED, mappedSize);
+    return true;
+}
+void mappedFile::close() {
+#ifdef _WIN32
+    STEG_COUNT(SYSCALLS, (mapping != nullptr) + (mappingHandle != nullptr) + (fileHandle != INVALID_HANDLE_VALUE));
+    if (mapping != nullptr) UnmapViewOfFile(mapping);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    STEG_COUNT(SYSCALLS, (mapping != nullptr) + (fileDescriptor >= 0));
+    if (mapping != nullptr) munmap(mapping, mappedSize);
+    if (fileDescriptor >= 0) ::close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+    mapping = nullptr;
+    mappedSize = 0;
+}
+pixelView mappedFile::pixels(const pixelLayout& layout) const {
+    pixelView view;
+    if (mapping == nullptr || layout.dataOffset > mappedSize || layout.regionSize() > mappedSize - layout.dataOffset) {
+        return view;
+    }
+    return layout.view(mapping + layout.dataOffset, layout.rows);
+}
+
+// Rows without padding are contiguous, so they are handled as one long row and kernel groups
+// run across row ends
+static pixelView joinRows(const pixelView& view) {
+    if (view.rows < 2 || view.rowStride != view.rowBytes) {
+        return view;
+    }
+    return {view.data, view.rowBytes * view.rows, view.rowBytes * view.rows, 1, view.packing};
+}
+// Kernels get channels in groups: 8 of a packed row, 8 BGRA pixels of 3 channels each, or 8
+// two-byte samples. A group starts at its first pixel or sample, so BGRA groups start on a pixel.
+template <channelPacking packing>
+static constexpr size_t groupChannels = packing == channelPacking::BGRA ? bgraGroupPixels * 3 : 8;
+template <channelPacking packing>
+static constexpr size_t groupStart(const size_t x) {
+    return packing == channelPacking::SAMPLE16 ? x * 2 : packedChannelOffset(packing, x);
+}
+template <channelPacking packing>
+static bool startsGroup(const size_t x) {
+    return packing != channelPacking::BGRA || x % 3 == 0;
+}
+template <channelPacking packing>
+static embedKernel embedKernelFor(const lsbKernels& kernels, const unsigned bitsPerChannel) {
+    if constexpr (packing == channelPacking::BGRA) return kernels.embedBgra[bitsPerChannel - 1];
+    else if constexpr (packing == channelPacking::SAMPLE16) return kernels.embed16[bitsPerChannel - 1];
+    else return kernels.embed[bitsPerChannel - 1];
+}
+template <channelPacking packing>
+static extractKernel extractKernelFor(const lsbKernels& kernels, const unsigned bitsPerChannel) {
+    if constexpr (packing == channelPacking::BGRA) return kernels.extractBgra[bitsPerChannel - 1];
+    else if constexpr (packing == channelPacking::SAMPLE16) return kernels.extract16[bitsPerChannel - 1];
+    else return kernels.extract[bitsPerChannel - 1];
+}
+
+// Serial embed over the rows of the view
+template <unsigned bitsPerChannel, channelPacking packing>
+static size_t embedRows(const pixelView& rows, const unsigned char* bytes, const size_t totalBits, size_t& bitIndex) {
+    const embedKernel kernel = embedKernelFor<packing>(selectLsbKernels(), bitsPerChannel);
+    constexpr size_t group = groupChannels<packing>;
+    const pixelView view = joinRows(rows);
+    // The last channel may get fewer bits than it can hold, its remaining low bits are kept
+    auto embedChannel = [&](unsigned char& channel) {
+        for (unsigned bit = bitsPerChannel; bit-- > 0 && bitIndex < totalBits; ++bitIndex) {
+            const unsigned value = (bytes[bitIndex >> 3] >> (7 - (bitIndex & 7))) & 1;
+            channel = static_cast<unsigned char>((channel & ~(1u << bit)) | (value << bit));
+        }
+    };
+    size_t touchedBytes = 0;
+    for (size_t y = 0; y < view.rows && bitIndex < totalBits; ++y) {
+        unsigned char* row = view.row(y);
+        const size_t count = std::min(view.rowChannels(), (totalBits - bitIndex + bitsPerChannel - 1) / bitsPerChannel);
+        size_t x = 0;
+        // Rows rarely end on a payload byte boundary: finish the current byte channel by channel
+        // (and the current pixel, for BGRA), hand whole groups to the kernel and leave the
+        // remainder for the next row.
+        while (x < count && ((bitIndex & 7) != 0 || !startsGroup<packing>(x))) {
+            embedChannel(row[packedChannelOffset(packing, x++)]);
+        }
+        const size_t groups = std::min((count - x) / group, (totalBits - bitIndex) / (group * bitsPerChannel));
+        kernel(row + groupStart<packing>(x), bytes + (bitIndex >> 3), groups);
+        x += groups * group;
+        bitIndex += groups * group * bitsPerChannel;
+        while (x < count) {
+            embedChannel(row[packedChannelOffset(packing, x++)]);
+        }
+        touchedBytes = y * view.rowStride + packedChannelOffset(packing, count - 1) + 1;
+    }
+    return touchedBytes;
+}
+template <unsigned bitsPerChannel, channelPacking packing>
+static size_t embedBands(const pixelView& view, const std::string& payload, size_t& bitIndex) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(payload.data());
+    const size_t totalBits = payload.size() * 8;
+    const size_t rowChannels = view.rowChannels();
+    if (bitIndex >= totalBits || view.rows == 0 || rowChannels == 0) {
+        return 0;
+    }
+    const size_t rowBits = rowChannels * bitsPerChannel;
+    const size_t rowsNeeded = std::min(view.rows, (totalBits - bitIndex + rowBits - 1) / rowBits);
+    threadPool& pool = globalThreadPool();
+    // A few bands per thread so work stealing can even out uneven page-fault costs
+    const size_t bandCount = std::min<size_t>(pool.size() * 4, rowsNeeded * rowChannels / minimumBandChannels);
+    if (bandCount < 2) {
+        return embedRows<bitsPerChannel, packing>(view, bytes, totalBits, bitIndex);
+    }
+
+    // The payload bits of every channel follow from its row, so bands are independent
+    const size_t bandRows = (rowsNeeded + bandCount - 1) / bandCount;
+    const size_t firstBit = bitIndex;
+    pool.parallelFor((rowsNeeded + bandRows - 1) / bandRows, [&](const size_t band) {
+        size_t bandBit = firstBit + band * bandRows * rowBits;
+        embedRows<bitsPerChannel, packing>(view.subView(band * bandRows, std::min(bandRows, rowsNeeded - band * bandRows)), bytes, totalBits, bandBit);
+    });
+    bitIndex = std::min(totalBits, firstBit + rowsNeeded * rowBits);
+    const size_t channels = (bitIndex - firstBit + bitsPerChannel - 1) / bitsPerChannel;
+    return (rowsNeeded - 1) * view.rowStride + packedChannelOffset(packing, channels - (rowsNeeded - 1) * rowChannels - 1) + 1;
+}
+template <channelPacking packing>
+static size_t embedWithPacking(const pixelView& view, const std::string& payload, size_t& bitIndex, const unsigned bitsPerChannel) {
+    switch (bitsPerChannel) {
+        case 2: return embedBands<2, packing>(view, payload, bitIndex);
+        case 3: return embedBands<3, packing>(view, payload, bitIndex);
+        case 4: return embedBands<4, packing>(view, payload, bitIndex);
+        default: return embedBands<1, packing>(view, payload, bitIndex);
+    }
+}
+size_t embedPayloadInView(const pixelView& view, const std::string& payload, size_t& bitIndex, const unsigned bitsPerChannel) {
+    switch (view.packing) {
+        case channelPacking::BGRA: return embedWithPacking<channelPacking::BGRA>(view, payload, bitIndex, bitsPerChannel);
+        case channelPacking::SAMPLE16: return embedWithPacking<channelPacking::SAMPLE16>(view, payload, bitIndex, bitsPerChannel);
+        default: return embedWithPacking<channelPacking::PACKED>(view, payload, bitIndex, bitsPerChannel);
+    }
+}
+// Serial extract over the rows of the view, the counterpart of embedRows
+template <unsigned bitsPerChannel, channelPacking packing>
+static void extractRows(const pixelView& rows, unsigned char* bytes, const size_t totalBits, size_t& bitIndex) {
+    const extractKernel kernel = extractKernelFor<packing>(selectLsbKernels(), bitsPerChannel);
+    constexpr size_t group = groupChannels<packing>;
+    const pixelView view = joinRows(rows);
+    auto extractChannel = [&](const unsigned char channel) {
+        for (unsigned bit = bitsPerChannel; bit-- > 0 && bitIndex < totalBits; ++bitIndex) {
+            const unsigned char mask = static_cast<unsigned char>(0x80 >> (bitIndex & 7));
+            unsigned char& byte = bytes[bitIndex >> 3];
+            byte = static_cast<unsigned char>((channel >> bit) & 1 ? byte | mask : byte & ~mask);
+        }
+    };
+    for (size_t y = 0; y < view.rows && bitIndex < totalBits; ++y) {
+        const unsigned char* row = view.row(y);
+        const size_t count = std::min(view.rowChannels(), (totalBits - bitIndex + bitsPerChannel - 1) / bitsPerChannel);
+        size_t x = 0;
+        while (x < count && ((bitIndex & 7) != 0 || !startsGroup<packing>(x))) {
+            extractChannel(row[packedChannelOffset(packing, x++)]);
+        }
+        const size_t groups = std::min((count - x) / group, (totalBits - bitIndex) / (group * bitsPerChannel));
+        kernel(row + groupStart<packing>(x), bytes + (bitIndex >> 3), groups);
+        x += groups * group;
+        bitIndex += groups * group * bitsPerChannel;
+        while (x < count) {
+            extractChannel(row[packedChannelOffset(packing, x++)]);
+        }
+    }
+}
+template <unsigned bitsPerChannel, channelPacking packing>
+static void extractBands(const pixelView& view, std::string& payload, size_t& bitIndex) {
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(payload.data());
+    const size_t totalBits = payload.size() * 8;
+    const size_t rowChannels = view.rowChannels();
+    if (bitIndex >= totalBits || view.rows == 0 || rowChannels == 0) {
+        return;
+    }
+    const size_t rowBits = rowChannels * bitsPerChannel;
+    const size_t rowsNeeded = std::min(view.rows, (totalBits - bitIndex + rowBits - 1) / rowBits);
+    // Bands write whole payload bytes only if each one starts on a byte boundary. Views start
+    // at a row, so a few leading rows are enough to get there; bands of 8 rows stay there.
+    size_t y = 0;
+    while (y < rowsNeeded && y < 8 && (bitIndex & 7) != 0) {
+        extractRows<bitsPerChannel, packing>(view.subView(y, 1), bytes, totalBits, bitIndex);
+        ++y;
+    }
+    threadPool& pool = globalThreadPool();
+    const size_t bandCount = std::min<size_t>(pool.size() * 4, (rowsNeeded - y) * rowChannels / minimumBandChannels);
+    const pixelView rest = view.subView(y, rowsNeeded - y);
+    if (bandCount < 2 || (bitIndex & 7) != 0) {
+        extractRows<bitsPerChannel, packing>(rest, bytes, totalBits, bitIndex);
+        return;
+    }
+
+    const size_t bandRows = ((rest.rows + bandCount - 1) / bandCount + 7) / 8 * 8;
+    const size_t firstBit = bitIndex;
+    pool.parallelFor((rest.rows + bandRows - 1) / bandRows, [&](const size_t band) {
+        size_t bandBit = firstBit + band * bandRows * rowBits;
+        extractRows<bitsPerChannel, packing>(rest.subView(band * bandRows, std::min(bandRows, rest.rows - band * bandRows)), bytes, totalBits, bandBit);
+    });
+    bitIndex = std::min(totalBits, firstBit + rest.rows * rowBits);
+}
+template <channelPacking packing>
+static void extractWithPacking(const pixelView& view, std::string& payload, size_t& bitIndex, const unsigned bitsPerChannel) {
+    switch (bitsPerChannel) {
+        case 2: return extractBands<2, packing>(view, payload, bitIndex);
+        case 3: return extractBands<3, packing>(view, payload, bitIndex);
+        case 4: return extractBands<4, packing>(view, payload, bitIndex);
+        default: return extractBands<1, packing>(view, payload, bitIndex);
+    }
+}
+void extractPayloadFromView(const pixelView& view, std::string& payload, size_t& bitIndex, const unsigned bitsPerChannel) {
+    switch (view.packing) {
+        case channelPacking::BGRA: return extractWithPacking<channelPacking::BGRA>(view, payload, bitIndex, bitsPerChannel);
+        case channelPacking::SAMPLE16: return extractWithPacking<channelPacking::SAMPLE16>(view, payload, bitIndex, bitsPerChannel);
+        default: return extractWithPacking<channelPacking::PACKED>(view, payload, bitIndex, bitsPerChannel);
+    }
+}
+
+static bool isSampleSeparator(const unsigned char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+// Finds the next sample token in [pos, end). Returns false when no complete token is left,
+// leaving pos at the start of the incomplete one (or at end).
+static bool nextAsciiSample(const unsigned char*& pos, const unsigned char* end, const bool atEnd,
+                            const unsigned char*& tokenEnd) {
+    while (pos < end) {
+        if (isSampleSeparator(*pos)) {
+            ++pos;
+        } else if (*pos == '#') {
+            const void* lineEnd = std::memchr(pos, '\n', static_cast<size_t>(end - pos));
+            if (lineEnd == nullptr) {
+                if (atEnd) pos = end;
+                return false;
+            }
+            pos = static_cast<const unsigned char*>(lineEnd) + 1;
+        } else {
+            break;
+        }
+    }
+    tokenEnd = pos;
+    while (tokenEnd < end && !isSampleSeparator(*tokenEnd)) ++tokenEnd;
+    return pos < end && (tokenEnd < end || atEnd);
+}
+static stegStatus parseAsciiSample(const unsigned char* begin, const unsigned char* end, int& value) {
+    const auto [parsedEnd, error] = std::from_chars(reinterpret_cast<const char*>(begin), reinterpret_cast<const char*>(end), value);
+    if (error != std::errc() || parsedEnd != reinterpret_cast<const char*>(end) || value < 0) {
+        return {stegError::INVALID_SAMPLE, "Invalid sample value (" + std::string(begin, end) + ")."};
+    }
+    return {};
+}
+// Samples whose LSB can't be flipped without exceeding maxValue
+static bool isFixedSample(const int value, const int maxValue) {
+    return value == maxValue && (maxValue & 1) == 0;
+}
+stegStatus embedPayloadInAsciiSamples(unsigned char* text, const size_t size, const bool atEnd, const int maxValue, const std::string& payload,
+                                      size_t& bitIndex, size_t& consumed, size_t& touchedBytes, size_t& changedBytes) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(payload.data());
+    const size_t totalBits = payload.size() * 8;
+    const unsigned char* pos = text;
+    const unsigned char* end = text + size;
+    const unsigned char* tokenEnd;
+    touchedBytes = 0;
+    changedBytes = 0;
+    while (bitIndex < totalBits && nextAsciiSample(pos, end, atEnd, tokenEnd)) {
+        int value;
+        if (stegStatus status = parseAsciiSample(pos, tokenEnd, value); !status) {
+            return status;
+        }
+        if (isFixedSample(value, maxValue)) {
+            pos = tokenEnd;
+            continue;
+        }
+        unsigned char& lastDigit = text[tokenEnd - 1 - text];
+        const unsigned char digit = static_cast<unsigned char>((lastDigit & ~1) | ((bytes[bitIndex >> 3] >> (7 - (bitIndex & 7))) & 1));
+        if (digit != lastDigit) {
+            lastDigit = digit;
+            ++changedBytes;
+        }
+        ++bitIndex;
+        touchedBytes = static_cast<size_t>(tokenEnd - text);
+        pos = tokenEnd;
+    }
+    consumed = static_cast<size_t>(pos - text);
+    return {};
+}
+stegStatus extractFrameFromAsciiSamples(const unsigned char* text, const size_t size, const bool atEnd, const int maxValue, frameDecoder& decoder,
+                                        size_t& consumed, bool& finished) {
+    const unsigned char* pos = text;
+    const unsigned char* end = text + size;
+    const unsigned char* tokenEnd;
+    finished = false;
+    while (!finished && nextAsciiSample(pos, end, atEnd, tokenEnd)) {
+        int value;
+        if (stegStatus status = parseAsciiSample(pos, tokenEnd, value); !status) {
+            return status;
+        }
+        if (!isFixedSample(value, maxValue)) {
+            finished = decoder.pushBit(value & 1);
+        }
+        pos = tokenEnd;
+    }
+    consumed = static_cast<size_t>(pos - text);
+    return {};
+}
+stegStatus countAsciiCarriers(const unsigned char* text, const size_t size, const bool atEnd, const int maxValue, const size_t carrierLimit,
+                              size_t& carriers, size_t& fixedSamples, size_t& consumed) {
+    const unsigned char* pos = text;
+    const unsigned char* end = text + size;
+    const unsigned char* tokenEnd;
+    while (carriers < carrierLimit && nextAsciiSample(pos, end, atEnd, tokenEnd)) {
+        int value;
+        if (stegStatus status = parseAsciiSample(pos, tokenEnd, value); !status) {
+            return status;
+        }
+        if (isFixedSample(value, maxValue)) {
+            ++fixedSamples;
+        } else {
+            ++carriers;
+        }
+        pos = tokenEnd;
+    }
+    consumed = static_cast<size_t>(pos - text);
+    return {};
+}
+
+void collectChangedRanges(const unsigned char* before, const unsigned char* after, const size_t size,
+                          const size_t mergeGap, std::vector<byteRange>& ranges) {
+    ranges.clear();
+    auto addRange = [&](const size_t begin, const size_t end) {
+        if (!ranges.empty() && begin - ranges.back().end <= mergeGap) {
+            ranges.back().end = end;
+        } else {
+            ranges.push_back({begin, end});
+        }
+    };
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        const uint64_t difference = loadLittleEndian<uint64_t>(before + i) ^ loadLittleEndian<uint64_t>(after + i);
+        if (difference != 0) {
+            addRange(i + std::countr_zero(difference) / 8, i + 8 - std::countl_zero(difference) / 8);
+        }
+    }
+    for (; i < size; ++i) {
+        if (before[i] != after[i]) {
+            addRange(i, i + 1);
+        }
+    }
+}
+// Writes the ranges of block to the file, block starting at blockPos
+static stegStatus writeRanges(std::fstream& file, const size_t blockPos, const unsigned char* block,
+                              const std::vector<byteRange>& ranges, size_t& bytesWritten) {
+    for (const byteRange& range : ranges) {
+        STEG_COUNT(SEEKS, 1);
+        STEG_COUNT(SYSCALLS, 2);
+        STEG_COUNT(BYTES_WRITTEN, range.end - range.begin);
+        file.seekp(static_cast<std::streamoff>(blockPos + range.begin), std::ios::beg);
+        if (!file.write(reinterpret_cast<const char*>(block + range.begin), static_cast<std::streamsize>(range.end - range.begin))) {
+            return {stegError::WRITE_FAILED, "Pixel data can't be written at byte " + std::to_string(blockPos + range.begin) + "."};
+        }
+        bytesWritten += range.end - range.begin;
+    }
+    return {};
+}
+
+stegStatus imageFile::open(const std::string& inputFilePath) {
+    filePath = inputFilePath;
+    // Prefer a writable mapping so embedding can reuse it, read-only files still get mapped
+    if (mapped.open(filePath, true) || mapped.open(filePath, false) || std::ifstream(filePath, std::ios::binary).is_open()) {
+        return {};
+    }
+    return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+}
+size_t imageFile::readHeader(unsigned char* buffer, const size_t size) const {
+    if (mapped.isOpen()) {
+        const size_t available = std::min(size, mapped.size());
+        std::memcpy(buffer, mapped.data(), available);
+        return available;
+    }
+    std::ifstream file(filePath, std::ios::binary);
+    file.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size));
+    // open, read and close
+    STEG_COUNT(SYSCALLS, 3);
+    STEG_COUNT(BYTES_READ, file.gcount());
+    return static_cast<size_t>(file.gcount());
+}
+stegStatus imageFile::embedPayload(const pixelLayout& layout, const std::string& payload, const unsigned bitsPerChannel,
+                                   const std::string& key, const bool deltaWrite, size_t& bytesWritten) {
+    STEG_PHASE(PIXEL_IO);
+    bytesWritten = 0;
+    if (payload.size() * 8 > layout.channelCount() * bitsPerChannel) {
+        return {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."};
+    }
+    if (!key.empty()) {
+        return embedScatteredPayload(layout, payload, bitsPerChannel, key, deltaWrite, bytesWritten);
+    }
+    size_t bitIndex = 0;
+    const size_t rowsPerBlock = std::max<size_t>(1, streamBlockSize / layout.rowStride);
+    // Blocks start on a row, so the rows a block needs follow from the payload bits left
+    auto blockRows = [&](const size_t blockRow) {
+        const size_t channelsLeft = (payload.size() * 8 - bitIndex + bitsPerChannel - 1) / bitsPerChannel;
+        return std::min({rowsPerBlock, layout.rows - blockRow, (channelsLeft + layout.rowChannels() - 1) / layout.rowChannels()});
+    };
+    std::vector<unsigned char> block;
+    std::vector<byteRange> ranges;
+    if (mapped.isOpen() && mapped.isWritable()) {
+        const pixelView view = mapped.pixels(layout);
+        if (view.data == nullptr) {
+            return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        }
+        if (!deltaWrite) {
+            bytesWritten = embedPayloadInView(view, payload, bitIndex, bitsPerChannel);
+            return {};
+        }
+        // Every block is embedded into a copy and only the bytes that change are stored back,
+        // so pages that keep their contents are never dirtied
+        for (size_t blockRow = 0; blockRow < layout.rows && bitIndex < payload.size() * 8; blockRow += rowsPerBlock) {
+            const size_t rows = blockRows(blockRow);
+            unsigned char* target = view.row(blockRow);
+            block.assign(target, target + (rows - 1) * layout.rowStride + layout.rowBytes);
+            const size_t dirtyBytes = embedPayloadInView(layout.view(block.data(), rows), payload, bitIndex, bitsPerChannel);
+            collectChangedRanges(target, block.data(), dirtyBytes, mappedMergeGap, ranges);
+            for (const byteRange& range : ranges) {
+                std::memcpy(target + range.begin, block.data() + range.begin, range.end - range.begin);
+                bytesWritten += range.end - range.begin;
+            }
+        }
+        return {};
+    }
+
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    // open and close
+    STEG_COUNT(SYSCALLS, 2);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    // Pixel rows are processed in blocks of several rows: one read, LSB rewrite in memory,
+    // and one write covering only the bytes that actually carry message bits (or, with
+    // deltaWrite, one write per range of bytes whose value changed).
+    std::vector<unsigned char> original;
+    for (size_t blockRow = 0; blockRow < layout.rows && bitIndex < payload.size() * 8; blockRow += rowsPerBlock) {
+        pixelLayout blockLayout = layout;
+        blockLayout.rows = blockRows(blockRow);
+        const size_t blockPos = layout.dataOffset + blockRow * layout.rowStride;
+        block.resize(blockLayout.regionSize());
+
+        STEG_COUNT(SEEKS, 1);
+        STEG_COUNT(SYSCALLS, 2);
+        STEG_COUNT(BYTES_READ, block.size());
+        file.seekg(static_cast<std::streamoff>(blockPos), std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()))) {
+            return {stegError::READ_FAILED, "Pixel data can't be read at row " + std::to_string(blockRow) + "."};
+        }
+        if (deltaWrite) {
+            original = block;
+        }
+        const pixelView view = layout.view(block.data(), blockLayout.rows);
+        const size_t dirtyBytes = embedPayloadInView(view, payload, bitIndex, bitsPerChannel);
+
+        if (deltaWrite) {
+            collectChangedRanges(original.data(), block.data(), dirtyBytes, fileMergeGap, ranges);
+        } else {
+            ranges.assign(1, {0, dirtyBytes});
+        }
+        if (stegStatus status = writeRanges(file, blockPos, block.data(), ranges, bytesWritten); !status) {
+            return status;
+        }
+    }
+    return {};
+}
+stegStatus imageFile::embedScatteredPayload(const pixelLayout& layout, const std::string& payload, const unsigned bitsPerChannel,
+                                            const std::string& key, const bool deltaWrite, size_t& bytesWritten) {
+    const scatterPlan plan(scatterPermutation(key, layout.channelCount()), (payload.size() * 8 + bitsPerChannel - 1) / bitsPerChannel);
+    if (mapped.isOpen() && mapped.isWritable()) {
+        const pixelView view = mapped.pixels(layout);
+        if (view.data == nullptr) {
+            return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        }
+        // Channels are stored one by one, so deltaWrite only has to skip the ones that keep their value
+        bytesWritten = embedScatteredRows(view, 0, payload, bitsPerChannel, plan, deltaWrite);
+        return {};
+    }
+
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    // open and close
+    STEG_COUNT(SYSCALLS, 2);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    // Only the runs of rows holding frame channels are read. They are spread too thin for whole
+    // blocks to be worth writing back, so the changed bytes are written in merged ranges.
+    const size_t maxRows = std::max<size_t>(1, streamBlockSize / layout.rowStride);
+    std::vector<unsigned char> block;
+    std::vector<unsigned char> original;
+    std::vector<byteRange> ranges;
+    for (const rowRun& run : plan.rowRuns(layout.rowChannels(), layout.rows, maxRows / 16, maxRows)) {
+        pixelLayout runLayout = layout;
+        runLayout.rows = run.rows;
+        const size_t blockPos = layout.dataOffset + run.firstRow * layout.rowStride;
+        block.resize(runLayout.regionSize());
+        STEG_COUNT(SEEKS, 1);
+        STEG_COUNT(SYSCALLS, 2);
+        STEG_COUNT(BYTES_READ, block.size());
+        file.seekg(static_cast<std::streamoff>(blockPos), std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()))) {
+            return {stegError::READ_FAILED, "Pixel data can't be read at row " + std::to_string(run.firstRow) + "."};
+        }
+        original = block;
+        embedScatteredRows(layout.view(block.data(), run.rows), run.firstRow, payload, bitsPerChannel, plan, false);
+        collectChangedRanges(original.data(), block.data(), block.size(), fileMergeGap, ranges);
+        if (stegStatus status = writeRanges(file, blockPos, block.data(), ranges, bytesWritten); !status) {
+            return status;
+        }
+    }
+    return {};
+}
+stegStatus imageFile::pairPalette(const size_t paletteOffset, const size_t colors, const pixelLayout& layout, size_t& bytesWritten) {
+    STEG_PHASE(PIXEL_IO);
+    bytesWritten = 0;
+    std::vector<unsigned char> head(paletteOffset + 4 * colors);
+    if (readHeader(head.data(), head.size()) < head.size()) {
+        return {stegError::INVALID_HEADER, "Palette is shorter than the header declares."};
+    }
+    unsigned char* palette = head.data() + paletteOffset;
+    const paletteOrder order = ::pairPalette(palette, colors);
+    if (!order.changes) {
+        return {};
+    }
+    reorderPalette(palette, colors, order);
+
+    if (mapped.isOpen() && mapped.isWritable()) {
+        const pixelView view = mapped.pixels(layout);
+        if (view.data == nullptr) {
+            return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        }
+        std::memcpy(mapped.data() + paletteOffset, palette, 4 * colors);
+        remapIndices(view, order);
+        bytesWritten = 4 * colors + layout.rows * layout.rowBytes;
+        return {};
+    }
+
+    std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    // open, size and close
+    STEG_COUNT(SYSCALLS, 3);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    // Checked up front, so a short file keeps its palette and its indices
+    file.seekg(0, std::ios::end);
+    if (static_cast<size_t>(file.tellg()) < layout.dataOffset + layout.regionSize()) {
+        return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+    }
+    std::vector<unsigned char> block;
+    const size_t rowsPerBlock = std::max<size_t>(1, streamBlockSize / layout.rowStride);
+    for (size_t blockRow = 0; blockRow < layout.rows; blockRow += rowsPerBlock) {
+        pixelLayout blockLayout = layout;
+        blockLayout.rows = std::min(rowsPerBlock, layout.rows - blockRow);
+        const size_t blockPos = layout.dataOffset + blockRow * layout.rowStride;
+        block.resize(blockLayout.regionSize());
+
+        STEG_COUNT(SEEKS, 1);
+        STEG_COUNT(SYSCALLS, 2);
+        STEG_COUNT(BYTES_READ, block.size());
+        file.seekg(static_cast<std::streamoff>(blockPos), std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()))) {
+            return {stegError::READ_FAILED, "Pixel data can't be read at row " + std::to_string(blockRow) + "."};
+        }
+        remapIndices(layout.view(block.data(), blockLayout.rows), order);
+        if (stegStatus status = writeRanges(file, blockPos, block.data(), {{0, block.size()}}, bytesWritten); !status) {
+            return status;
+        }
+    }
+    return writeRanges(file, paletteOffset, palette, {{0, 4 * colors}}, bytesWritten);
+}
+stegStatus imageFile::extractPayload(const pixelLayout& layout, const std::string& key, std::string& payload) const {
+    STEG_PHASE(PIXEL_IO);
+    if (mapped.isOpen()) {
+        const pixelView view = mapped.pixels(layout);
+        if (view.data == nullptr) {
+            return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        }
+        // Only the pages holding the frame are ever faulted in
+        return key.empty() ? extractFrameFromView(view, payload) : extractScatteredFrameFromView(view, key, payload);
+    }
+
+    std::fstream file(filePath, std::ios::in | std::ios::binary);
+    // open and close
+    STEG_COUNT(SYSCALLS, 2);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    if (!key.empty()) {
+        std::vector<unsigned char> block;
+        return extractScatteredFrame(layout, key, streamBlockSize, [&](const size_t firstRow, const size_t rows, pixelView& window) {
+            pixelLayout runLayout = layout;
+            runLayout.rows = rows;
+            block.resize(runLayout.regionSize());
+            STEG_COUNT(SEEKS, 1);
+            STEG_COUNT(SYSCALLS, 2);
+            STEG_COUNT(BYTES_READ, block.size());
+            file.seekg(static_cast<std::streamoff>(layout.dataOffset + firstRow * layout.rowStride), std::ios::beg);
+            if (!file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()))) {
+                return stegStatus(stegError::READ_FAILED, "Pixel data can't be read at row " + std::to_string(firstRow) + ".");
+            }
+            window = layout.view(block.data(), rows);
+            return stegStatus();
+        }, payload);
+    }
+    STEG_COUNT(SEEKS, 1);
+    STEG_COUNT(SYSCALLS, 1);
+    file.seekg(static_cast<std::streamoff>(layout.dataOffset), std::ios::beg);
+    return extractFrameFromRows(layout, [&](unsigned char* buffer, const size_t size) {
+        file.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size));
+        STEG_COUNT(SYSCALLS, 1);
+        STEG_COUNT(BYTES_READ, file.gcount());
+        return static_cast<size_t>(file.gcount());
+    }, streamBlockSize, payload);
+}
+stegStatus imageFile::embedAsciiPayload(const size_t dataOffset, const int maxValue, const std::string& payload, const bool deltaWrite,
+                                        size_t& bytesWritten) {
+    STEG_PHASE(PIXEL_IO);
+    size_t bitIndex = 0;
+    size_t consumed;
+    size_t touchedBytes;
+    size_t changedBytes;
+    bytesWritten = 0;
+    // The samples the frame needs are checked before the first digit changes
+    size_t carriers = 0;
+    size_t fixedSamples = 0;
+    if (stegStatus status = countAsciiCarriers(dataOffset, maxValue, payload.size() * 8, carriers, fixedSamples); !status) {
+        return status;
+    }
+    if (carriers < payload.size() * 8) {
+        return {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."};
+    }
+    if (mapped.isOpen() && mapped.isWritable()) {
+        // Digits are only stored to when their parity changes, which already is a delta write
+        if (stegStatus status = embedPayloadInAsciiSamples(mapped.data() + dataOffset, mapped.size() - dataOffset, true,
+                                                           maxValue, payload, bitIndex, consumed, touchedBytes, changedBytes); !status) {
+            return status;
+        }
+        bytesWritten = changedBytes;
+    } else {
+        std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+        // open and close
+        STEG_COUNT(SYSCALLS, 2);
+        if (!file.is_open()) {
+            return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+        }
+        // The body is handled in large chunks: a sample cut by the end of a chunk is left for
+        // the next one, and only the prefix up to the last rewritten digit is written back
+        // (or the ranges of changed digits with deltaWrite).
+        std::vector<unsigned char> block(streamBlockSize);
+        std::vector<unsigned char> original;
+        std::vector<byteRange> ranges;
+        size_t blockPos = dataOffset;
+        while (bitIndex < payload.size() * 8) {
+            STEG_COUNT(SEEKS, 1);
+            file.seekg(static_cast<std::streamoff>(blockPos), std::ios::beg);
+            file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()));
+            const size_t blockBytes = static_cast<size_t>(file.gcount());
+            STEG_COUNT(SYSCALLS, 2);
+            STEG_COUNT(BYTES_READ, blockBytes);
+            const bool atEnd = blockBytes < block.size();
+            file.clear();
+            if (deltaWrite) {
+                original.assign(block.begin(), block.begin() + static_cast<std::ptrdiff_t>(blockBytes));
+            }
+            if (stegStatus status = embedPayloadInAsciiSamples(block.data(), blockBytes, atEnd, maxValue, payload, bitIndex,
+                                                               consumed, touchedBytes, changedBytes); !status) {
+                return status;
+            }
+            if (deltaWrite) {
+                collectChangedRanges(original.data(), block.data(), touchedBytes, fileMergeGap, ranges);
+            } else {
+                ranges.assign(1, {0, touchedBytes});
+            }
+            if (stegStatus status = writeRanges(file, blockPos, block.data(), ranges, bytesWritten); !status) {
+                return status;
+            }
+            if (atEnd || consumed == 0) {
+                break;
+            }
+            blockPos += consumed;
+        }
+    }
+    if (bitIndex < payload.size() * 8) {
+        return {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."};
+    }
+    return {};
+}
+stegStatus imageFile::countAsciiCarriers(const size_t dataOffset, const int maxValue, const size_t carrierLimit,
+                                         size_t& carriers, size_t& fixedSamples) const {
+    size_t consumed;
+    if (mapped.isOpen()) {
+        if (dataOffset > mapped.size()) {
+            return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        }
+        return ::countAsciiCarriers(mapped.data() + dataOffset, mapped.size() - dataOffset, true, maxValue, carrierLimit,
+                                    carriers, fixedSamples, consumed);
+    }
+    std::ifstream file(filePath, std::ios::binary);
+    // open and close
+    STEG_COUNT(SYSCALLS, 2);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    std::vector<unsigned char> block(streamBlockSize);
+    size_t blockPos = dataOffset;
+    while (carriers < carrierLimit) {
+        STEG_COUNT(SEEKS, 1);
+        file.seekg(static_cast<std::streamoff>(blockPos), std::ios::beg);
+        file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()));
+        const size_t blockBytes = static_cast<size_t>(file.gcount());
+        STEG_COUNT(SYSCALLS, 2);
+        STEG_COUNT(BYTES_READ, blockBytes);
+        const bool atEnd = blockBytes < block.size();
+        file.clear();
+        if (stegStatus status = ::countAsciiCarriers(block.data(), blockBytes, atEnd, maxValue, carrierLimit, carriers, fixedSamples, consumed);
+            !status) {
+            return status;
+        }
+        if (atEnd || consumed == 0) {
+            break;
+        }
+        blockPos += consumed;
+    }
+    return {};
+}
+stegStatus imageFile::extractAsciiPayload(const size_t dataOffset, const int maxValue, const size_t capacityBytes, std::string& payload) const {
+    STEG_PHASE(PIXEL_IO);
+    frameDecoder decoder(capacityBytes);
+    size_t consumed;
+    bool finished;
+    if (mapped.isOpen()) {
+        if (dataOffset > mapped.size()) {
+            return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        }
+        if (stegStatus status = extractFrameFromAsciiSamples(mapped.data() + dataOffset, mapped.size() - dataOffset, true,
+                                                             maxValue, decoder, consumed, finished); !status) {
+            return status;
+        }
+        return decoder.finish(payload);
+    }
+
+    std::fstream file(filePath, std::ios::in | std::ios::binary);
+    // open and close
+    STEG_COUNT(SYSCALLS, 2);
+    if (!file.is_open()) {
+        return {stegError::CANT_OPEN_FILE, "File can't be opened."};
+    }
+    // The frame header sits in the first samples, so start with a small read and grow it
+    // geometrically until the frame is complete.
+    size_t blockSize = streamFirstExtractBlockSize;
+    std::vector<unsigned char> block;
+    size_t blockPos = dataOffset;
+    while (true) {
+        block.resize(blockSize);
+        STEG_COUNT(SEEKS, 1);
+        file.seekg(static_cast<std::streamoff>(blockPos), std::ios::beg);
+        file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()));
+        const size_t blockBytes = static_cast<size_t>(file.gcount());
+        STEG_COUNT(SYSCALLS, 2);
+        STEG_COUNT(BYTES_READ, blockBytes);
+        const bool atEnd = blockBytes < block.size();
+        file.clear();
+        if (stegStatus status = extractFrameFromAsciiSamples(block.data(), blockBytes, atEnd, maxValue, decoder, consumed, finished); !status) {
+            return status;
+        }
+        if (finished || atEnd || consumed == 0) {
+            break;
+        }
+        blockPos += consumed;
+        blockSize = std::min(blockSize * 2, streamBlockSize);
+    }
+    return decoder.finish(payload);
+}
@@ -0,0 +1,170 @@
+#ifndef PIXELACCESS_HPP
+#define PIXELACCESS_HPP
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "stegStatus.hpp"
+
+struct frameDecoder;
+
+// How the channels that carry payload bits sit in a row
+enum class channelPacking {
+    PACKED,     // every byte is a channel: 24-bit BGR, 8-bit palette indices, 8-bit Netpbm samples
+    BGRA,       // 4-byte pixels, the first three bytes are channels and the fourth (alpha) is left alone
+    SAMPLE16,   // 2-byte big-endian samples (Netpbm maxval above 255), the low byte of each is the channel
+};
+
+// Channels in a row of rowBytes bytes and the byte of channel x within it
+constexpr size_t packedRowChannels(const channelPacking packing, const size_t rowBytes) {
+    return packing == channelPacking::BGRA ? rowBytes / 4 * 3 : packing == channelPacking::SAMPLE16 ? rowBytes / 2 : rowBytes;
+}
+constexpr size_t packedChannelOffset(const channelPacking packing, const size_t x) {
+    return packing == channelPacking::BGRA ? x / 3 * 4 + x % 3 : packing == channelPacking::SAMPLE16 ? x * 2 + 1 : x;
+}
+
+struct pixelView;
+
+// Position of the pixel rows inside an image file
+struct pixelLayout {
+    size_t dataOffset = 0; // first byte of the first stored row
+    size_t rowBytes = 0;   // pixel bytes in one row, padding excluded
+    size_t rowStride = 0;  // distance between the starts of two rows, padding included
+    size_t rows = 0;
+    channelPacking packing = channelPacking::PACKED;
+    // Rows are stored from the top of the image down. Frames follow the storage order either way,
+    // so this only matters to a caller drawing the image.
+    bool topDown = false;
+
+    size_t rowChannels() const { return packedRowChannels(packing, rowBytes); }
+    size_t channelCount() const { return rowChannels() * rows; }
+    // The last row of an image may be stored without its padding bytes
+    size_t regionSize() const { return rows == 0 ? 0 : (rows - 1) * rowStride + rowBytes; }
+    // View over rows laid out like these, starting at firstRow in memory
+    pixelView view(unsigned char* firstRow, size_t viewRows) const;
+};
+
+// Strided view over pixel rows held in memory (a mapped file or a read buffer)
+struct pixelView {
+    unsigned char* data = nullptr;
+    size_t rowBytes = 0;
+    size_t rowStride = 0;
+    size_t rows = 0;
+    channelPacking packing = channelPacking::PACKED;
+
+    unsigned char* row(size_t y) const { return data + y * rowStride; }
+    size_t rowChannels() const { return packedRowChannels(packing, rowBytes); }
+    size_t channelCount() const { return rowChannels() * rows; }
+    // Byte of channel x within its row
+    size_t channelOffset(size_t x) const { return packedChannelOffset(packing, x); }
+    pixelView subView(size_t firstRow, size_t viewRows) const { return {row(firstRow), rowBytes, rowStride, viewRows, packing}; }
+};
+
+inline pixelView pixelLayout::view(unsigned char* firstRow, const size_t viewRows) const {
+    return {firstRow, rowBytes, rowStride, viewRows, packing};
+}
+
+// Memory mapping of a whole file, unmapped on destruction
+struct mappedFile {
+private:
+    unsigned char* mapping;
+    size_t mappedSize;
+    bool writable;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+public:
+    mappedFile();
+    ~mappedFile();
+    mappedFile(const mappedFile&) = delete;
+    mappedFile& operator=(const mappedFile&) = delete;
+
+    bool open(const std::string& filePath, bool writable);
+    void close();
+    bool isOpen() const { return mapping != nullptr; }
+    bool isWritable() const { return writable; }
+    unsigned char* data() const { return mapping; }
+    size_t size() const { return mappedSize; }
+    // View over the pixel rows described by layout, empty if the file is too short
+    pixelView pixels(const pixelLayout& layout) const;
+};
+
+// Writes the payload bits from bitIndex on (most significant bit of every byte first) into
+// the low bitsPerChannel bits (1 to maxBitsPerChannel) of the view's channels, advancing bitIndex.
+// Returns the number of bytes from the start of the view up to the last modified channel.
+size_t embedPayloadInView(const pixelView& view, const std::string& payload, size_t& bitIndex, unsigned bitsPerChannel);
+// Reads payload bits from bitIndex up to payload.size() * 8 back out of the view, advancing
+// bitIndex. payload has to be sized by the caller; the view starts at a row of the image.
+void extractPayloadFromView(const pixelView& view, std::string& payload, size_t& bitIndex, unsigned bitsPerChannel);
+
+// Delta writes also write over unchanged bytes between two changed ones up to this gap, so a file
+// gets a few large writes instead of many small ones. Mapped files use a small gap: a store dirties
+// its page, and a dirty page is written back as a whole.
+static constexpr size_t fileMergeGap = 4096;
+static constexpr size_t mappedMergeGap = 64;
+
+struct byteRange {
+    size_t begin;
+    size_t end;
+};
+// Ranges of bytes where after differs from before, ranges less than mergeGap apart merged
+void collectChangedRanges(const unsigned char* before, const unsigned char* after, size_t size,
+                          size_t mergeGap, std::vector<byteRange>& ranges);
+
+// P3 bodies store every channel as a whitespace separated decimal sample. Flipping the LSB
+// of a value never changes its number of digits (n and n ^ 1 always have the same width) and
+// the parity of a number is the parity of its last digit's character, so the LSB can be
+// rewritten in place in the text. Both functions stop at an incomplete trailing sample unless
+// atEnd is set and report how many bytes they consumed; they fail on a malformed sample.
+// Digits that already have the right parity are not written to; changedBytes counts the others.
+// A sample equal to an even maxValue carries nothing, as its LSB flipped would exceed maxValue;
+// no other sample ever becomes maxValue that way, so embedding and extraction skip the same ones.
+stegStatus embedPayloadInAsciiSamples(unsigned char* text, size_t size, bool atEnd, int maxValue, const std::string& payload,
+                                      size_t& bitIndex, size_t& consumed, size_t& touchedBytes, size_t& changedBytes);
+stegStatus extractFrameFromAsciiSamples(const unsigned char* text, size_t size, bool atEnd, int maxValue, frameDecoder& decoder,
+                                        size_t& consumed, bool& finished);
+// Counts the samples that carry a bit into carriers, stopping once it reaches carrierLimit, and
+// the ones that don't into fixedSamples, checking every sample on the way. Embedding runs it
+// first, so a payload that doesn't fit or a malformed sample leaves the text unchanged.
+stegStatus countAsciiCarriers(const unsigned char* text, size_t size, bool atEnd, int maxValue, size_t carrierLimit,
+                              size_t& carriers, size_t& fixedSamples, size_t& consumed);
+
+// Image file opened once and shared by header parsing, embedding and extraction.
+// The file is memory mapped when possible; otherwise every step falls back to
+// buffered std::fstream access.
+struct imageFile {
+private:
+    std::string filePath;
+    mappedFile mapped;
+
+    stegStatus embedScatteredPayload(const pixelLayout& layout, const std::string& frame, unsigned bitsPerChannel,
+                                     const std::string& key, bool deltaWrite, size_t& bytesWritten);
+public:
+    // Fails when the file can't be opened at all
+    stegStatus open(const std::string& inputFilePath);
+    // Copies up to size bytes from the start of the file, returns the number of bytes copied
+    size_t readHeader(unsigned char* buffer, size_t size) const;
+    // Embeds a complete frame (see payloadFrame.hpp). With deltaWrite the new channels are compared
+    // with the ones in the file and only the bytes that change are written, in merged ranges.
+    // bytesWritten reports the pixel bytes written back either way. A non-empty key scatters the
+    // frame over the whole image (keyedScatter.hpp); unmapped files then only get the bytes that
+    // change written back, deltaWrite or not.
+    stegStatus embedPayload(const pixelLayout& layout, const std::string& frame, unsigned bitsPerChannel,
+                            const std::string& key, bool deltaWrite, size_t& bytesWritten);
+    // Finds the frame and reads only the rows it occupies, leaving its payload in payload.
+    // A frame embedded with a key is only found with the same key.
+    stegStatus extractPayload(const pixelLayout& layout, const std::string& key, std::string& payload) const;
+    // Same for a P3 text body starting at dataOffset, always one bit per sample
+    // Nothing is written unless the whole frame fits
+    stegStatus embedAsciiPayload(size_t dataOffset, int maxValue, const std::string& frame, bool deltaWrite, size_t& bytesWritten);
+    // Puts the 8-bit palette of colors entries at paletteOffset in pair order (paletteOrder.hpp) and
+    // rewrites the pixel indices to match. bytesWritten is 0 when it already is in pair order.
+    stegStatus pairPalette(size_t paletteOffset, size_t colors, const pixelLayout& layout, size_t& bytesWritten);
+    // countAsciiCarriers over the whole P3 text body
+    stegStatus countAsciiCarriers(size_t dataOffset, int maxValue, size_t carrierLimit, size_t& carriers, size_t& fixedSamples) const;
+    stegStatus extractAsciiPayload(size_t dataOffset, int maxValue, size_t capacityBytes, std::string& payload) const;
+};
+
+#endif //PIXELACCESS_HPP
@@ -1,200 +1,213 @@
-#include <iostream>
-#include <fstream>
+#include <charconv>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include "ppmProcessor.hpp"
 #include "helpFunctions.hpp"
+#include "payloadFrame.hpp"
+#include "stegStats.hpp"
 
 ppmObject::ppmObject(const std::string& inputFilePath) {
     filePath = inputFilePath;
 }
-bool ppmObject::isHeaderCorrect() {
-    std::fstream file(filePath,std::ios::in);
-
-    file >> magicNumber;
-    if (magicNumber != "P6" && magicNumber != "P3") {
-        std::cerr << "Error: File signature is incorrect."<< std::endl;;
-        return false;
+stegStatus ppmObject::isHeaderCorrect() {
+    STEG_PHASE(HEADER_PARSE);
+    if (stegStatus status = image.open(filePath); !status) {
+        return status;
     }
-    std::string token;
-    int counter = 0;
-
-    while (counter < 3 && file >> token) {
-        if (token.empty()) {
-            std::cerr << "Error: Unexpected empty token in header." << std::endl;
-            return false;
+    // Kept open (mapped when possible) for the following encryption or decryption
+    std::vector<unsigned char> header(headerBufferSize);
+    if (stegStatus status = parseHeader(header.data(), image.readHeader(header.data(), header.size())); !status) {
+        return status;
+    }
+    // Which samples carry nothing only the body tells. A malformed sample is reported by whatever
+    // reads the body next; the samples before it are counted.
+    if (magicNumber == "P3" && maxChannelValue % 2 == 0) {
+        size_t carriers = 0;
+        (void)image.countAsciiCarriers(dataOffset, maxChannelValue, SIZE_MAX, carriers, fixedSamples);
+    }
+    return {};
+}
+static bool isHeaderSpace(const unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+// Finds the next token from position on, skipping whitespace and comments (from # to the end of
+// the line). Fails when the token runs into the end of the buffer, where it may be cut short.
+static bool nextHeaderToken(const unsigned char* header, const size_t headerBytes, size_t& position, size_t& tokenStart) {
+    while (position < headerBytes && (isHeaderSpace(header[position]) || header[position] == '#')) {
+        if (header[position] == '#') {
+            while (position < headerBytes && header[position] != '\n') position++;
+        } else {
+            position++;
         }
-        if (token[0] == '#') {
-            std::string discard;
-            std::getline(file, discard);
-            continue;
+    }
+    tokenStart = position;
+    while (position < headerBytes && !isHeaderSpace(header[position]) && header[position] != '#') position++;
+    return position < headerBytes;
+}
+static bool tokenEquals(const unsigned char* header, const size_t tokenStart, const size_t tokenEnd, const std::string_view text) {
+    return std::string_view(reinterpret_cast<const char*>(header + tokenStart), tokenEnd - tokenStart) == text;
+}
+static stegStatus parseHeaderNumber(const unsigned char* header, const size_t tokenStart, const size_t tokenEnd, int& value) {
+    const char* first = reinterpret_cast<const char*>(header + tokenStart);
+    const char* last = reinterpret_cast<const char*>(header + tokenEnd);
+    const auto [end, error] = std::from_chars(first, last, value);
+    if (error != std::errc() || end != last) {
+        return {stegError::INVALID_HEADER, "Invalid number in header (" + std::string(first, last) + ")."};
+    }
+    return {};
+}
+
+stegStatus ppmObject::parseHeader(const unsigned char* header, const size_t headerBytes) {
+    if (headerBytes < 2 || header[0] != 'P' || (header[1] != '3' && header[1] != '5' && header[1] != '6' && header[1] != '7')
+        || (headerBytes > 2 && !isHeaderSpace(header[2]) && header[2] != '#')) {
+        return {stegError::INVALID_HEADER, "File signature is incorrect."};
+    }
+    magicNumber.assign(reinterpret_cast<const char*>(header), 2);
+    depth = header[1] == '5' ? 1 : 3;
+    hasAlpha = false;
+    if (header[1] == '7') {
+        if (stegStatus status = parsePamHeader(header, headerBytes); !status) {
+            return status;
         }
-        try {
-            int value = std::stoi(token);
-            switch (counter) {
-                case 0: width = value; break;
-                case 1: height = value; break;
-                case 2: maxChannelValue = value; break;
-                default: return 1;
+    } else {
+        int* const values[3] = {&width, &height, &maxChannelValue};
+        size_t position = 2;
+        size_t tokenStart;
+        for (int counter = 0; counter < 3; counter++) {
+            if (!nextHeaderToken(header, headerBytes, position, tokenStart)) {
+                return {stegError::INVALID_HEADER, "Incomplete header."};
+            }
+            if (stegStatus status = parseHeaderNumber(header, tokenStart, position, *values[counter]); !status) {
+                return status;
             }
-            counter++;
-        } catch (const std::exception& e) {
-            std::cerr << "Error: Invalid number in header (" << token << ")." << std::endl;
-            return false;
         }
+        // A single whitespace character separates the max channel value from the pixel data
+        dataOffset = position + 1;
     }
-    offset = counter;
 
-    if (counter < 3) {
-        std::cerr << "Error: Incomplete header." << std::endl;
-        return false;
-    }
-    if (!file.is_open()) {
-        std::cerr << "Error: File can't be opened."<< std::endl;;
-        return false;
-    }
     if (width < 1) {
-        std::cerr << "Error: File width size is too small."<< std::endl;
-        return false;
+        return {stegError::INVALID_HEADER, "File width size is too small."};
     }
     if (height < 1) {
-        std::cerr << "Error: File height size is too small."<< std::endl;
-        return false;
+        return {stegError::INVALID_HEADER, "File height size is too small."};
     }
-    return true;
-}
-void ppmObject::printInfo(){
-    std::cout << "--- BMP Header Info ---" << std::endl;
-    std::cout << "Width: " << width << " pixels" << std::endl;
-    std::cout << "Height: " << height << " pixels" << std::endl;
-    std::cout << "Image Size: " << width * height * 3 << " bytes" << std::endl;
-    std::cout << "-----------------------" << std::endl;
-}
-bool ppmObject::isEncryptPossible(const std::string& message)  {
-    std::string messageCopy = message;
-    const std::vector<bool> messageInBits = textToBits(messageCopy);
-    if (!static_cast<size_t>(width) * static_cast<size_t>(height) * 3 >= messageInBits.size()) {
-        return false;
+    if (maxChannelValue < 1 || maxChannelValue > 65535) {
+        return {stegError::INVALID_HEADER, "Max channel value is out of range (" + std::to_string(maxChannelValue) + ")."};
     }
-    return true;
+    if (depth < 1) {
+        return {stegError::INVALID_HEADER, "Image depth is too small."};
+    }
+    // The alpha sample of a pixel is left alone, which the channel packings only cover for 8-bit RGBA
+    if (hasAlpha && (depth != 4 || maxChannelValue > 255)) {
+        return {stegError::UNSUPPORTED_FORMAT, "PAM images with an alpha channel are only supported as 8-bit RGB_ALPHA."};
+    }
+    return {};
 }
-bool ppmObject::encryption(std::string& message){
-
-
-    std::string messageCopy = message;
-    const std::vector<bool> messageInBits = textToBits(messageCopy);
-    size_t messageIndex = 0;
-    auto formatRgbValue = [](int value) -> std::string {
-        if (value < 0 || value > 255) {
-            throw std::out_of_range("RGB value out of range");
+// PAM headers are lines of a keyword and its value up to ENDHDR, in any order
+stegStatus ppmObject::parsePamHeader(const unsigned char* header, const size_t headerBytes) {
+    int* const values[4] = {&width, &height, &depth, &maxChannelValue};
+    static constexpr std::string_view keywords[4] = {"WIDTH", "HEIGHT", "DEPTH", "MAXVAL"};
+    bool seen[4] = {};
+    size_t position = 2;
+    size_t tokenStart;
+    while (true) {
+        if (!nextHeaderToken(header, headerBytes, position, tokenStart)) {
+            return {stegError::INVALID_HEADER, "Incomplete header."};
         }
-
-        std::string result = std::to_string(value);
-        while (result.length() < 3) {
-            result = "0" + result;
+        if (tokenEquals(header, tokenStart, position, "ENDHDR")) {
+            // The pixel data starts on the next line
+            while (position < headerBytes && header[position] != '\n') position++;
+            if (position == headerBytes) {
+                return {stegError::INVALID_HEADER, "Incomplete header."};
+            }
+            dataOffset = position + 1;
+            break;
         }
-
-        return result;
-    };
-
-    if (magicNumber == "P3") {
-        std::fstream file(filePath, std::ios::in | std::ios::out);
-        if (!file.is_open()) {
-            std::cerr << "Error: File can't be opened.\n";
-            return false;
+        if (tokenEquals(header, tokenStart, position, "TUPLTYPE")) {
+            // The rest of the line names the tuple type, e.g. RGB or GRAYSCALE_ALPHA
+            while (position < headerBytes && header[position] != '\n') position++;
+            size_t typeEnd = position;
+            while (typeEnd > tokenStart && isHeaderSpace(header[typeEnd - 1])) typeEnd--;
+            hasAlpha = typeEnd - tokenStart >= 6 && tokenEquals(header, typeEnd - 6, typeEnd, "_ALPHA");
+            continue;
         }
-
-        std::string line;
-
-        int linesSkipped = 0;
-        while (linesSkipped < offset && std::getline(file, line)) { ++linesSkipped; }
-        file.clear();
-        int value;
-        while (file >> value) {
-            std::streampos readPos = file.tellg();
-            if (messageIndex < messageInBits.size()) {
-                value = (value & ~1) | static_cast<int>(messageInBits[messageIndex++]);
-                std::string fixedValue = formatRgbValue(value);
-                file.seekp(readPos - std::streamoff(3));
-                file.write(fixedValue.c_str(), 3);
-                file.seekg(readPos);
-            }
-            if (messageIndex >= messageInBits.size()) {
-                return true;
-            }
+        size_t keyword = 0;
+        while (keyword < 4 && !tokenEquals(header, tokenStart, position, keywords[keyword])) keyword++;
+        if (keyword == 4) {
+            return {stegError::INVALID_HEADER, "Unknown PAM header line ("
+                                               + std::string(reinterpret_cast<const char*>(header + tokenStart), position - tokenStart) + ")."};
         }
-    }else if (magicNumber == "P6") {
-        std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "Error: File can't be opened.\n";
-            return false;
+        if (!nextHeaderToken(header, headerBytes, position, tokenStart)) {
+            return {stegError::INVALID_HEADER, "Incomplete header."};
         }
-
-
-        file.seekg(offset, std::ios::beg);
-        file.seekp(offset, std::ios::beg);
-
-        char byte;
-        while (file.read(&byte, 1)) {
-            if (messageIndex < messageInBits.size()) {
-                byte = (byte & ~1) | static_cast<char>(messageInBits[messageIndex++]);
-
-                file.seekp(-1, std::ios::cur);
-                file.write(&byte, 1);
-                file.seekg(file.tellp());
-            } else {
-                std::cout << "Message successfully encrypted.\n";
-                return true;
-            }
+        if (stegStatus status = parseHeaderNumber(header, tokenStart, position, *values[keyword]); !status) {
+            return status;
         }
-
-        std::cerr << "Error: Message is too long to be hidden in this image.\n";
-        return false;
+        seen[keyword] = true;
     }
-
-
-    return true;
+    if (!seen[0] || !seen[1] || !seen[2] || !seen[3]) {
+        return {stegError::INVALID_HEADER, "Incomplete header."};
+    }
+    return {};
 }
-bool ppmObject::decryption() {
-    if (magicNumber == "P3"){
-        std::fstream file(filePath, std::ios::in);
-        if (!file.is_open()) {
-            std::cerr << "Error: File can't be opened.\n";
-            return false;
-        }
-        std::string line;
-        int linesSkipped = 0;
-        while (linesSkipped < offset && std::getline(file, line)) {
-            ++linesSkipped;
-        }
-        file.clear();
-        std::vector<bool> extractedBits;
-        int value;
-        while (file >> value) {
-            bool bit = value & 1;
-            extractedBits.push_back(bit);
+imageDescription ppmObject::describe() const {
+    imageDescription description;
+    switch (magicNumber[1]) {
+        case '3': description.format = imageFormat::P3; break;
+        case '5': description.format = imageFormat::P5; break;
+        case '7': description.format = imageFormat::P7; break;
+        default: description.format = imageFormat::P6; break;
+    }
+    description.width = width;
+    description.height = height;
+    description.bitsPerPixel = static_cast<unsigned>(depth) * (maxChannelValue > 255 ? 16 : 8);
+    description.maxChannelValue = maxChannelValue;
+    description.fixedSamples = fixedSamples;
+    description.layout = pixelRegion();
+    return description;
+}
+pixelLayout ppmObject::pixelRegion() const {
+    pixelLayout layout;
+    layout.dataOffset = dataOffset;
+    // P3 samples are text, where the layout only gives their number
+    const bool wideSamples = isBinary() && maxChannelValue > 255;
+    layout.rowBytes = static_cast<size_t>(width) * static_cast<size_t>(depth) * (wideSamples ? 2 : 1);
+    layout.rowStride = layout.rowBytes;
+    layout.rows = static_cast<size_t>(height);
+    layout.packing = wideSamples ? channelPacking::SAMPLE16 : hasAlpha ? channelPacking::BGRA : channelPacking::PACKED;
+    return layout;
+}
+bool ppmObject::isEncryptPossible(const std::string& message, const unsigned bitsPerChannel, const payloadCodec codec)  {
+    return storedPayloadSize(message, codec) * 8 <= describe().capacityBits(bitsPerChannel);
+}
+stegStatus ppmObject::encryption(std::string& message, const unsigned bitsPerChannel, const payloadCodec codec){
+    size_t bytesWritten;
+    return embedFrame(buildFrame(message, bitsPerChannel, codec), bitsPerChannel, {}, false, bytesWritten);
+}
+stegStatus ppmObject::embedFrame(const std::string& frame, const unsigned bitsPerChannel, const std::string& key, const bool deltaWrite, size_t& bytesWritten) {
+    if (magicNumber == "P3") {
+        if (bitsPerChannel != 1) {
+            return {stegError::UNSUPPORTED_FORMAT, "P3 images only support 1 bit per channel."};
         }
-        std::string message = bitsToText(extractedBits);
-        std::cout << "Extracted message: " << message << std::endl;
-        return true;
-    }else if (magicNumber == "P6") {
-        std::fstream file(filePath, std::ios::in | std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "Error: File can't be opened.\n";
-            return false;
+        if (!key.empty()) {
+            return {stegError::UNSUPPORTED_FORMAT, "P3 images can't be used with a key."};
         }
-
-        file.seekg(offset, std::ios::beg);
-        std::vector<bool> extractedBits;
-        char byte;
-
-        while (file.read(&byte, 1)) {
-            extractedBits.push_back(byte & 1);
+        return image.embedAsciiPayload(dataOffset, maxChannelValue, frame, deltaWrite, bytesWritten);
+    }else if (isBinary()) {
+        return image.embedPayload(pixelRegion(), frame, bitsPerChannel, key, deltaWrite, bytesWritten);
+    }
+    return {stegError::UNSUPPORTED_FORMAT, "File signature is incorrect."};
+}
+stegStatus ppmObject::decryption(std::string& message, const std::string& key) {
+    if (magicNumber == "P3"){
+        if (!key.empty()) {
+            return {stegError::UNSUPPORTED_FORMAT, "P3 images can't be used with a key."};
         }
-        std::string message = bitsToText(extractedBits);
-        std::cout << "Extracted message: " << message << std::endl;
-
-        return true;
+        return image.extractAsciiPayload(dataOffset, maxChannelValue, describe().capacityBytes(), message);
+    }else if (isBinary()) {
+        return image.extractPayload(pixelRegion(), key, message);
     }
-    return false;
+    return {stegError::UNSUPPORTED_FORMAT, "File signature is incorrect."};
 }
@@ -1,23 +1,42 @@
 #ifndef PPMPROCESSOR_HPP
 #define PPMPROCESSOR_HPP
-#include <vector>
+#include <string>
+#include "pixelAccess.hpp"
+#include "steganography.hpp"
 
 struct ppmObject{
 private:
     std::string filePath;
     std::string magicNumber;
-    std::vector<std::string> comments;
     int width;
     int height;
     int maxChannelValue;
-    int offset;
+    int depth;        // samples per pixel
+    bool hasAlpha;    // PAM tuple type ending in _ALPHA, its last sample is left alone
+    size_t dataOffset;
+    size_t fixedSamples = 0;   // P3 samples equal to an even max value, counted when the file is opened
+    imageFile image;
+
+    stegStatus parsePamHeader(const unsigned char* header, size_t headerBytes);
 public:
+    // Longest header (comments included) parseHeader is given by isHeaderCorrect
+    static constexpr size_t headerBufferSize = 64 * 1024;
+
     ppmObject(const std::string &inputFilePath);
-    bool isHeaderCorrect();
-    void printInfo();
-    bool isEncryptPossible(const std::string& message);
-    bool encryption(std::string& message);
-    bool decryption();
+    stegStatus isHeaderCorrect();
+    // Validates a header already held in memory (e.g. read from a pipe), allocates nothing when it is valid
+    stegStatus parseHeader(const unsigned char* header, size_t headerBytes);
+    // P5 (PGM), P6 (PPM) and P7 (PAM) store samples in bytes, 2 bytes big-endian above a max value of 255
+    bool isBinary() const { return magicNumber != "P3"; }
+    pixelLayout pixelRegion() const;
+    imageDescription describe() const;
+    bool isEncryptPossible(const std::string& message, unsigned bitsPerChannel = 1, payloadCodec codec = payloadCodec::RAW);
+    // P3 images only carry one bit per sample
+    stegStatus encryption(std::string& message, unsigned bitsPerChannel = 1, payloadCodec codec = payloadCodec::RAW);
+    // Embeds a frame already built with buildFrame, see imageFile::embedPayload for key and deltaWrite
+    stegStatus embedFrame(const std::string& frame, unsigned bitsPerChannel, const std::string& key, bool deltaWrite, size_t& bytesWritten);
+    // The bits per channel setting is read from the hidden frame
+    stegStatus decryption(std::string& message, const std::string& key = {});
 };
 
 #endif //PPMPROCESSOR_HPP
@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <semaphore>
+#include <set>
+#include <string>
+#include <vector>
+#include "shardedPayload.hpp"
+#include "atomicFile.hpp"
+#include "crc32c.hpp"
+#include "helpFunctions.hpp"
+#include "threadPool.hpp"
+
+static constexpr unsigned char shardMagic[4] = {'S', 't', 'g', 'S'};
+
+struct shardHeader {
+    uint32_t index = 0;
+    uint32_t count = 0;
+    uint64_t offset = 0;
+    uint64_t totalBytes = 0;
+    uint32_t checksum = 0;
+};
+
+static void storeShardHeader(const shardHeader& header, unsigned char* bytes) {
+    std::memcpy(bytes, shardMagic, sizeof(shardMagic));
+    storeLittleEndian<uint32_t>(bytes + 4, header.index);
+    storeLittleEndian<uint32_t>(bytes + 8, header.count);
+    storeLittleEndian<uint64_t>(bytes + 12, header.offset);
+    storeLittleEndian<uint64_t>(bytes + 20, header.totalBytes);
+    storeLittleEndian<uint32_t>(bytes + 28, header.checksum);
+}
+static bool parseShardHeader(const std::vector<std::byte>& payload, shardHeader& header) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(payload.data());
+    if (payload.size() < shardHeaderSize || std::memcmp(bytes, shardMagic, sizeof(shardMagic)) != 0) {
+        return false;
+    }
+    header.index = loadLittleEndian<uint32_t>(bytes + 4);
+    header.count = loadLittleEndian<uint32_t>(bytes + 8);
+    header.offset = loadLittleEndian<uint64_t>(bytes + 12);
+    header.totalBytes = loadLittleEndian<uint64_t>(bytes + 20);
+    header.checksum = loadLittleEndian<uint32_t>(bytes + 28);
+    return header.index < header.count;
+}
+
+stegStatus planShards(const std::span<const size_t> capacityBytes, const size_t payloadBytes, std::vector<size_t>& shardBytes) {
+    if (capacityBytes.empty()) {
+        return {stegError::INVALID_OPTION, "No carrier images given."};
+    }
+    if (capacityBytes.size() > UINT32_MAX) {
+        return {stegError::INVALID_OPTION, "Too many carrier images."};
+    }
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < capacityBytes.size(); ++i) {
+        if (capacityBytes[i] <= shardHeaderSize) {
+            return {stegError::MESSAGE_TOO_LONG, "Carrier " + std::to_string(i + 1) + " is too small to hold a shard."};
+        }
+        totalBytes += capacityBytes[i] - shardHeaderSize;
+    }
+    if (payloadBytes > totalBytes) {
+        return {stegError::MESSAGE_TOO_LONG, "Payload of " + std::to_string(payloadBytes) + " bytes doesn't fit, the carriers hold "
+                                             + std::to_string(totalBytes) + " bytes."};
+    }
+    shardBytes.assign(capacityBytes.size(), 0);
+    size_t assigned = 0;
+    const double share = totalBytes == 0 ? 0.0 : static_cast<double>(payloadBytes) / static_cast<double>(totalBytes);
+    for (size_t i = 0; i < capacityBytes.size(); ++i) {
+        const size_t room = capacityBytes[i] - shardHeaderSize;
+        shardBytes[i] = std::min(room, static_cast<size_t>(share * static_cast<double>(room)));
+        assigned += shardBytes[i];
+    }
+    // Rounding leaves a few bytes over, they go wherever there is room left
+    for (size_t i = 0; assigned < payloadBytes; ++i) {
+        const size_t extra = std::min(payloadBytes - assigned, capacityBytes[i] - shardHeaderSize - shardBytes[i]);
+        shardBytes[i] += extra;
+        assigned += extra;
+    }
+    return {};
+}
+
+// Flushes the copies, renames them over the carriers and flushes their directories once
+static stegStatus commitCopies(std::vector<atomicFile>& copies, threadPool& pool) {
+    std::vector<stegStatus> statuses(copies.size());
+    pool.parallelFor(copies.size(), [&](const size_t i) {
+        statuses[i] = copies[i].sync();
+    });
+    for (const stegStatus& status : statuses) {
+        if (!status) return status;
+    }
+    std::set<std::string> directories;
+    for (atomicFile& copy : copies) {
+        if (stegStatus status = copy.commit(); !status) {
+            return status;
+        }
+        directories.insert(parentDirectory(copy.target()));
+    }
+    for (const std::string& directory : directories) {
+        if (stegStatus status = syncDirectory(directory); !status) {
+            return status;
+        }
+    }
+    return {};
+}
+
+stegStatus embedSharded(const std::vector<std::string>& carrierPaths, const std::span<const std::byte> payload,
+                        const stegOptions& options, const unsigned maxOpenFiles, const bool atomicWrites) {
+    threadPool& pool = globalThreadPool();
+    std::counting_semaphore<> openFiles(std::max(1u, maxOpenFiles));
+    std::vector<stegStatus> statuses(carrierPaths.size());
+
+    // Only the headers are read to plan the split
+    std::vector<size_t> capacityBytes(carrierPaths.size());
+    pool.parallelFor(carrierPaths.size(), [&](const size_t i) {
+        openFiles.acquire();
+        imageDescription description;
+        statuses[i] = describeImageFile(carrierPaths[i], description);
+        capacityBytes[i] = description.capacityBytes(options.bitsPerChannel);
+        openFiles.release();
+    });
+    for (size_t i = 0; i < carrierPaths.size(); ++i) {
+        if (!statuses[i]) {
+            return {statuses[i].error, carrierPaths[i] + ": " + statuses[i].detail};
+        }
+    }
+    std::vector<size_t> shardBytes;
+    if (stegStatus status = planShards(capacityBytes, payload.size(), shardBytes); !status) {
+        return status;
+    }
+
+    shardHeader header;
+    header.count = static_cast<uint32_t>(carrierPaths.size());
+    header.totalBytes = payload.size();
+    header.checksum = crc32c(payload.data(), payload.size());
+    std::vector<size_t> offsets(carrierPaths.size(), 0);
+    for (size_t i = 1; i < carrierPaths.size(); ++i) {
+        offsets[i] = offsets[i - 1] + shardBytes[i - 1];
+    }
+
+    std::vector<atomicFile> copies(atomicWrites ? carrierPaths.size() : 0);
+    pool.parallelFor(carrierPaths.size(), [&](const size_t i) {
+        openFiles.acquire();
+        shardHeader shard = header;
+        shard.index = static_cast<uint32_t>(i);
+        shard.offset = offsets[i];
+        std::vector<std::byte> bytes(shardHeaderSize + shardBytes[i]);
+        storeShardHeader(shard, reinterpret_cast<unsigned char*>(bytes.data()));
+        std::memcpy(bytes.data() + shardHeaderSize, payload.data() + offsets[i], shardBytes[i]);
+        if (atomicWrites) {
+            statuses[i] = copies[i].createCopy(carrierPaths[i], carrierPaths[i]);
+            if (statuses[i]) statuses[i] = embedInImageFile(copies[i].path(), bytes, options).status;
+        } else {
+            statuses[i] = embedInImageFile(carrierPaths[i], bytes, options).status;
+        }
+        openFiles.release();
+    });
+    for (size_t i = 0; i < carrierPaths.size(); ++i) {
+        if (!statuses[i]) {
+            return {statuses[i].error, carrierPaths[i] + ": " + statuses[i].detail};
+        }
+    }
+    return atomicWrites ? commitCopies(copies, pool) : stegStatus{};
+}
+
+extractResult extractSharded(const std::vector<std::string>& carrierPaths, const stegOptions& options, const unsigned maxOpenFiles) {
+    threadPool& pool = globalThreadPool();
+    std::counting_semaphore<> openFiles(std::max(1u, maxOpenFiles));
+    std::vector<extractResult> shards(carrierPaths.size());
+    std::vector<shardHeader> headers(carrierPaths.size());
+    pool.parallelFor(carrierPaths.size(), [&](const size_t i) {
+        openFiles.acquire();
+        shards[i] = extractFromImageFile(carrierPaths[i], options);
+        openFiles.release();
+        if (shards[i].status && !parseShardHeader(shards[i].payload, headers[i])) {
+            shards[i].status = {stegError::NO_PAYLOAD, "Payload isn't a shard."};
+        }
+    });
+
+    extractResult result;
+    if (carrierPaths.empty()) {
+        result.status = {stegError::INVALID_OPTION, "No carrier images given."};
+        return result;
+    }
+    for (size_t i = 0; i < carrierPaths.size(); ++i) {
+        if (!shards[i].status) {
+            result.status = {shards[i].status.error, carrierPaths[i] + ": " + shards[i].status.detail};
+            return result;
+        }
+    }
+    // Carriers in shard order, each shard has to follow on from the one before
+    std::vector<size_t> order(carrierPaths.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return headers[a].index < headers[b].index; });
+    const shardHeader& first = headers[order[0]];
+    uint64_t offset = 0;
+    for (size_t position = 0; position < order.size(); ++position) {
+        const shardHeader& header = headers[order[position]];
+        if (header.count != first.count || header.totalBytes != first.totalBytes || header.checksum != first.checksum) {
+            result.status = {stegError::CORRUPT_PAYLOAD, carrierPaths[order[position]] + ": Shard belongs to a different payload."};
+            return result;
+        }
+        if (header.index != position) {
+            const bool duplicate = position > 0 && header.index == headers[order[position - 1]].index;
+            result.status = {stegError::CORRUPT_PAYLOAD, duplicate
+                             ? carrierPaths[order[position]] + ": Shard " + std::to_string(header.index + 1) + " is given twice."
+                             : "Shard " + std::to_string(position + 1) + " of " + std::to_string(first.count) + " is missing."};
+            return result;
+        }
+        if (header.offset != offset) {
+            result.status = {stegError::CORRUPT_PAYLOAD, carrierPaths[order[position]] + ": Shard doesn't follow on from the one before."};
+            return result;
+        }
+        offset += shards[order[position]].payload.size() - shardHeaderSize;
+    }
+    if (first.count != carrierPaths.size() || offset != first.totalBytes) {
+        result.status = {stegError::CORRUPT_PAYLOAD, "Shard " + std::to_string(carrierPaths.size() + 1) + " of "
+                                                     + std::to_string(first.count) + " is missing."};
+        return result;
+    }
+
+    result.payload.resize(static_cast<size_t>(first.totalBytes));
+    pool.parallelFor(order.size(), [&](const size_t position) {
+        const std::vector<std::byte>& shard = shards[order[position]].payload;
+        std::memcpy(result.payload.data() + headers[order[position]].offset, shard.data() + shardHeaderSize, shard.size() - shardHeaderSize);
+    });
+    if (crc32c(result.payload.data(), result.payload.size()) != first.checksum) {
+        result.payload.clear();
+        result.status = {stegError::CORRUPT_PAYLOAD, "Reassembled payload doesn't match its checksum."};
+    }
+    return result;
+}
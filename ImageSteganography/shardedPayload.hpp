@@ -0,0 +1,39 @@
+#ifndef SHARDEDPAYLOAD_HPP
+#define SHARDEDPAYLOAD_HPP
+#include <span>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "steganography.hpp"
+
+// A payload larger than any single image is split into shards, one per carrier image. Each shard
+// is embedded as an ordinary frame (payloadFrame.hpp) whose payload starts with a shard header:
+//
+//   offset  size
+//        0     4   magic "StgS"
+//        4     4   shard index, from 0, little-endian
+//        8     4   shard count
+//       12     8   offset of the shard bytes in the whole payload
+//       20     8   length of the whole payload
+//       28     4   CRC-32C of the whole payload, which also tells shards of different payloads apart
+static constexpr size_t shardHeaderSize = 32;
+
+// Splits payloadBytes over carriers holding capacityBytes each (imageDescription::capacityBytes at
+// the embed setting). Every carrier gets a shard sized in proportion to what it holds after its
+// shard header, so all of them end up about equally full and take about as long to embed.
+// Fails when a carrier can't hold a shard header or the payload doesn't fit.
+stegStatus planShards(std::span<const size_t> capacityBytes, size_t payloadBytes, std::vector<size_t>& shardBytes);
+
+// Embeds payload split over the image files at carrierPaths, in place. Carriers are processed
+// concurrently on the global thread pool with at most maxOpenFiles of them open at once, so the
+// time taken follows the cores and disks rather than the number of carriers. With atomicWrites
+// every carrier is embedded into a copy (atomicFile.hpp), and the copies only replace the carriers
+// once all shards are embedded and flushed.
+stegStatus embedSharded(const std::vector<std::string>& carrierPaths, std::span<const std::byte> payload,
+                        const stegOptions& options = {}, unsigned maxOpenFiles = 64, bool atomicWrites = false);
+// Reads the shards of all carriers concurrently and puts the payload back together. The carriers
+// may be listed in any order but have to be exactly those of one sharded payload.
+extractResult extractSharded(const std::vector<std::string>& carrierPaths, const stegOptions& options = {},
+                             unsigned maxOpenFiles = 64);
+
+#endif //SHARDEDPAYLOAD_HPP
@@ -0,0 +1,112 @@
+#include "stegStats.hpp"
+#ifdef STEG_STATS
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+static constexpr const char* phaseNames[] = {"header parse", "frame build", "pixel I/O", "final write"};
+static constexpr const char* counterNames[] = {"Bytes read", "Bytes written", "Bytes mapped", "Seeks", "Syscalls",
+                                               "Channel bytes modified"};
+static constexpr size_t phaseCount = static_cast<size_t>(stegPhase::COUNT);
+static constexpr size_t counterCount = static_cast<size_t>(stegCounter::COUNT);
+
+struct traceEvent {
+    stegPhase phase;
+    unsigned thread;
+    int64_t start;
+    int64_t duration;
+};
+
+static std::atomic<bool> enabled{false};
+static bool tracing = false;
+static int64_t origin = 0;
+static std::atomic<uint64_t> counters[counterCount];
+static std::atomic<uint64_t> phaseNanoseconds[phaseCount];
+static std::atomic<uint64_t> phaseCalls[phaseCount];
+static std::mutex eventMutex;
+static std::vector<traceEvent> events;
+
+static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+// Small thread numbers in the order threads first record something
+static unsigned threadNumber() {
+    static std::atomic<unsigned> nextNumber{0};
+    thread_local const unsigned number = nextNumber++;
+    return number;
+}
+
+void enableStats(const bool trace) {
+    tracing = trace;
+    origin = now();
+    enabled.store(true, std::memory_order_release);
+}
+bool statsEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+void addCount(const stegCounter counter, const uint64_t amount) {
+    if (statsEnabled()) {
+        counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+}
+
+phaseTimer::phaseTimer(const stegPhase phase) : phase(phase), start(statsEnabled() ? now() : -1) {}
+phaseTimer::~phaseTimer() {
+    if (start < 0) {
+        return;
+    }
+    const int64_t duration = now() - start;
+    phaseNanoseconds[static_cast<size_t>(phase)].fetch_add(static_cast<uint64_t>(duration), std::memory_order_relaxed);
+    phaseCalls[static_cast<size_t>(phase)].fetch_add(1, std::memory_order_relaxed);
+    if (tracing) {
+        // A few events per image, so one lock each costs nothing next to the phase itself
+        const std::lock_guard lock(eventMutex);
+        events.push_back({phase, threadNumber(), start - origin, duration});
+    }
+}
+
+void printStats(std::ostream& output) {
+    char line[96];
+    output << "--- Statistics ---\n";
+    std::snprintf(line, sizeof(line), "Wall time: %.3f ms\n", static_cast<double>(now() - origin) / 1e6);
+    output << line;
+    for (size_t i = 0; i < phaseCount; ++i) {
+        std::snprintf(line, sizeof(line), "%-14s %10.3f ms in %llu calls\n", phaseNames[i],
+                      static_cast<double>(phaseNanoseconds[i].load()) / 1e6, static_cast<unsigned long long>(phaseCalls[i].load()));
+        output << line;
+    }
+    for (size_t i = 0; i < counterCount; ++i) {
+        output << counterNames[i] << ": " << counters[i].load() << "\n";
+    }
+    output << "------------------" << std::endl;
+}
+bool writeTrace(const std::string& filePath) {
+    std::ofstream file(filePath, std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    const std::lock_guard lock(eventMutex);
+    char event[160];
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        // Timestamps in microseconds from enableStats
+        std::snprintf(event, sizeof(event), "%s\n{\"name\":\"%s\",\"cat\":\"steg\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                      i == 0 ? "" : ",", phaseNames[static_cast<size_t>(events[i].phase)],
+                      static_cast<double>(events[i].start) / 1e3, static_cast<double>(events[i].duration) / 1e3, events[i].thread);
+        file << event;
+    }
+    // The counters once more as a counter event at the end
+    std::snprintf(event, sizeof(event), "%s\n{\"name\":\"counters\",\"cat\":\"steg\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":0,\"args\":{",
+                  events.empty() ? "" : ",", static_cast<double>(now() - origin) / 1e3);
+    file << event;
+    for (size_t i = 0; i < counterCount; ++i) {
+        file << (i == 0 ? "" : ",") << "\"" << counterNames[i] << "\":" << counters[i].load();
+    }
+    file << "}}\n]}\n";
+    return static_cast<bool>(file.flush());
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef STEGSTATS_HPP
+#define STEGSTATS_HPP
+#include <ostream>
+#include <string>
+#include <cstdint>
+
+// Timers around the phases of an embed or extract and counters of the I/O behind them, for
+// --stats and --trace. Nothing is recorded until enableStats is called, and with STEG_STATS
+// undefined (-DSTEG_STATS=OFF) STEG_PHASE and STEG_COUNT expand to nothing and this module
+// compiles to nothing.
+#ifdef STEG_STATS
+
+enum class stegPhase {
+    HEADER_PARSE,   // opening the image and parsing its header
+    FRAME_BUILD,    // compressing and framing the payload, checking and unpacking it on extract
+    PIXEL_IO,       // reading and writing the pixel rows that carry the frame
+    FINAL_WRITE,    // flushing and renaming the output and its directory
+    COUNT
+};
+enum class stegCounter {
+    BYTES_READ,       // through read calls, mapped pages are not counted
+    BYTES_WRITTEN,    // through write calls
+    BYTES_MAPPED,     // size of the files mapped
+    SEEKS,
+    SYSCALLS,         // calls into the OS, a stream read or write counted as one
+    CHANNEL_BYTES,    // pixel bytes stored to by embedding
+    COUNT
+};
+
+// With trace set, every phase is also kept as an event for writeTrace
+void enableStats(bool trace);
+bool statsEnabled();
+void addCount(stegCounter counter, uint64_t amount);
+
+// Adds the time until it goes out of scope to phase
+struct phaseTimer {
+private:
+    stegPhase phase;
+    int64_t start;   // nanoseconds, -1 while statistics are off
+public:
+    explicit phaseTimer(stegPhase phase);
+    ~phaseTimer();
+    phaseTimer(const phaseTimer&) = delete;
+    phaseTimer& operator=(const phaseTimer&) = delete;
+};
+
+// Time and calls per phase (summed over all threads) and the counters
+void printStats(std::ostream& output);
+// Chrome trace event JSON (chrome://tracing, Perfetto) with one event per phase and thread
+bool writeTrace(const std::string& filePath);
+
+#define STEG_PHASE(phase) const phaseTimer phaseScope(stegPhase::phase)
+#define STEG_COUNT(counter, amount) addCount(stegCounter::counter, static_cast<uint64_t>(amount))
+
+#else
+
+#define STEG_PHASE(phase) ((void)0)
+#define STEG_COUNT(counter, amount) ((void)0)
+
+#endif
+
+#endif //STEGSTATS_HPP
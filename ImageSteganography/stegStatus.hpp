@@ -0,0 +1,35 @@
+#ifndef STEGSTATUS_HPP
+#define STEGSTATUS_HPP
+#include <string>
+#include <utility>
+
+enum class stegError {
+    NONE,
+    CANT_OPEN_FILE,
+    READ_FAILED,
+    WRITE_FAILED,
+    UNSUPPORTED_FORMAT,
+    INVALID_HEADER,
+    TRUNCATED_PIXEL_DATA,
+    INVALID_SAMPLE,
+    MESSAGE_TOO_LONG,
+    INVALID_PAYLOAD,
+    INVALID_OPTION,
+    NO_PAYLOAD,
+    CORRUPT_PAYLOAD
+};
+
+// Outcome of a library call. The library never prints; detail holds the human readable
+// reason (e.g. "Only 24-bit BMP format is supported (bits per pixel: 8).") for the caller.
+struct stegStatus {
+    stegError error = stegError::NONE;
+    std::string detail;
+
+    stegStatus() = default;
+    stegStatus(const stegError failure, std::string reason) : error(failure), detail(std::move(reason)) {}
+
+    bool ok() const { return error == stegError::NONE; }
+    explicit operator bool() const { return ok(); }
+};
+
+#endif //STEGSTATUS_HPP
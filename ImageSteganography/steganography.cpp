@@ -0,0 +1,301 @@
+#include "steganography.hpp"
+#include "bmpProcessor.hpp"
+#include "ppmProcessor.hpp"
+#include "helpFunctions.hpp"
+#include "atomicFile.hpp"
+#include "keyedScatter.hpp"
+#include "paletteOrder.hpp"
+#include "stegStats.hpp"
+
+static stegStatus checkOptions(const stegOptions& options, const imageDescription& description) {
+    const imageFormat format = description.format;
+    if (options.bitsPerChannel < 1 || options.bitsPerChannel > maxBitsPerChannel) {
+        return {stegError::INVALID_OPTION, "Bits per channel must be between 1 and " + std::to_string(maxBitsPerChannel) + "."};
+    }
+    if (stegStatus status = checkBitsPerChannelLimit(description, options.bitsPerChannel); !status) {
+        return status;
+    }
+    if (format == imageFormat::P3 && !options.key.empty()) {
+        return {stegError::UNSUPPORTED_FORMAT, "P3 images can't be used with a key."};
+    }
+    return {};
+}
+stegStatus checkBitsPerChannelLimit(const imageDescription& description, const unsigned bitsPerChannel) {
+    const unsigned limit = description.bitsPerChannelLimit();
+    if (bitsPerChannel <= limit) {
+        return {};
+    }
+    if (description.format == imageFormat::P3) {
+        return {stegError::UNSUPPORTED_FORMAT, "P3 images only support 1 bit per channel."};
+    }
+    if (description.format == imageFormat::BMP && limit == 0) {
+        return {stegError::UNSUPPORTED_FORMAT, "8-bit BMP images need an even number of palette colors to carry a payload."};
+    }
+    if (description.format == imageFormat::BMP) {
+        return {stegError::UNSUPPORTED_FORMAT, "8-bit BMP images only support 1 bit per channel."};
+    }
+    const std::string maxValue = std::to_string(description.maxChannelValue);
+    if (limit == 0) {
+        return {stegError::UNSUPPORTED_FORMAT, "Netpbm images with an even max value (" + maxValue + ") can't carry a payload."};
+    }
+    return {stegError::UNSUPPORTED_FORMAT, "Netpbm images with a max value of " + maxValue + " only support up to "
+                                           + std::to_string(limit) + (limit > 1 ? " bits" : " bit") + " per channel."};
+}
+static std::string payloadText(const std::span<const std::byte> payload) {
+    return {reinterpret_cast<const char*>(payload.data()), payload.size()};
+}
+static std::vector<std::byte> payloadBytes(const std::string& text) {
+    const std::byte* bytes = reinterpret_cast<const std::byte*>(text.data());
+    return {bytes, bytes + text.size()};
+}
+static bool containsRegion(const size_t size, const pixelLayout& layout) {
+    return layout.dataOffset <= size && layout.regionSize() <= size - layout.dataOffset;
+}
+
+embedResult embed(const std::span<std::byte> pixels, const pixelLayout& layout, const std::span<const std::byte> payload, const stegOptions& options) {
+    embedResult result;
+    if (result.status = checkOptions(options, imageDescription()); !result.status) {
+        return result;
+    }
+    if (!containsRegion(pixels.size(), layout)) {
+        result.status = {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the layout declares."};
+        return result;
+    }
+    const std::string frame = buildFrame(payloadText(payload), options.bitsPerChannel, options.codec);
+    if (frame.size() * 8 > layout.channelCount() * options.bitsPerChannel) {
+        result.status = {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."};
+        return result;
+    }
+    STEG_PHASE(PIXEL_IO);
+    const pixelView view = layout.view(reinterpret_cast<unsigned char*>(pixels.data()) + layout.dataOffset, layout.rows);
+    if (!options.key.empty()) {
+        const size_t frameChannels = (frame.size() * 8 + options.bitsPerChannel - 1) / options.bitsPerChannel;
+        const scatterPlan plan(scatterPermutation(options.key, layout.channelCount()), frameChannels);
+        result.bytesWritten = embedScatteredRows(view, 0, frame, options.bitsPerChannel, plan, false);
+        result.bitsEmbedded = frame.size() * 8;
+        STEG_COUNT(CHANNEL_BYTES, result.bytesWritten);
+        return result;
+    }
+    result.bytesWritten = embedPayloadInView(view, frame, result.bitsEmbedded, options.bitsPerChannel);
+    STEG_COUNT(CHANNEL_BYTES, result.bytesWritten);
+    return result;
+}
+extractResult extract(const std::span<const std::byte> pixels, const pixelLayout& layout, const stegOptions& options) {
+    extractResult result;
+    if (!containsRegion(pixels.size(), layout)) {
+        result.status = {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the layout declares."};
+        return result;
+    }
+    STEG_PHASE(PIXEL_IO);
+    // Extraction only reads through the view
+    unsigned char* data = const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(pixels.data()));
+    const pixelView view = layout.view(data + layout.dataOffset, layout.rows);
+    std::string payload;
+    result.status = options.key.empty() ? extractFrameFromView(view, payload) : extractScatteredFrameFromView(view, options.key, payload);
+    result.payload = payloadBytes(payload);
+    return result;
+}
+
+stegStatus describeImage(const std::span<const std::byte> image, imageDescription& description) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(image.data());
+    if (image.size() >= 2 && bytes[0] == 'B' && bytes[1] == 'M') {
+        bmpObject bmp("");
+        stegStatus status = bmp.parseHeader(bytes, image.size());
+        if (status) {
+            description = bmp.describe();
+        }
+        return status;
+    }
+    if (image.size() >= 2 && bytes[0] == 'P') {
+        ppmObject ppm("");
+        stegStatus status = ppm.parseHeader(bytes, image.size());
+        if (status) {
+            description = ppm.describe();
+        }
+        return status;
+    }
+    return {stegError::UNSUPPORTED_FORMAT, "Unsupported image format."};
+}
+void queryCapacity(const std::span<const std::span<const std::byte>> headers, const unsigned bitsPerChannel, const std::span<size_t> capacityBits) {
+    const bool validSetting = bitsPerChannel >= 1 && bitsPerChannel <= maxBitsPerChannel;
+    for (size_t i = 0; i < headers.size() && i < capacityBits.size(); ++i) {
+        imageDescription description;
+        capacityBits[i] = validSetting && describeImage(headers[i], description) ? description.capacityBits(bitsPerChannel) : 0;
+    }
+}
+// Pairs the palette (paletteOrder.hpp) before embedding, once the payload is known to fit
+static embedResult embedInPalettedImage(const std::span<std::byte> image, const imageDescription& description,
+                                        const std::span<const std::byte> payload, const stegOptions& options) {
+    const pixelLayout& layout = description.layout;
+    if (!containsRegion(image.size(), layout) || embeddedPayloadBytes(payload, options) > description.capacityBytes(options.bitsPerChannel)) {
+        return embed(image, layout, payload, options);
+    }
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(image.data());
+    unsigned char* palette = bytes + bmpObject::fileHeaderSize + description.headerSize;
+    const paletteOrder order = pairPalette(palette, description.paletteColors);
+    if (order.changes) {
+        reorderPalette(palette, description.paletteColors, order);
+        remapIndices(layout.view(bytes + layout.dataOffset, layout.rows), order);
+    }
+    embedResult result = embed(image, layout, payload, options);
+    if (order.changes) {
+        result.bytesWritten += 4 * description.paletteColors + layout.rows * layout.rowBytes;
+    }
+    return result;
+}
+embedResult embedInImage(const std::span<std::byte> image, const std::span<const std::byte> payload, const stegOptions& options) {
+    imageDescription description;
+    embedResult result;
+    if (result.status = describeImage(image, description); !result.status) {
+        return result;
+    }
+    if (result.status = checkOptions(options, description); !result.status) {
+        return result;
+    }
+    if (description.format == imageFormat::BMP && description.bitsPerPixel == 8) {
+        return embedInPalettedImage(image, description, payload, options);
+    }
+    if (description.format != imageFormat::P3) {
+        return embed(image, description.layout, payload, options);
+    }
+    const std::string frame = buildFrame(payloadText(payload), 1, options.codec);
+    if (frame.size() - frameHeaderSize > description.capacityBytes()) {
+        result.status = {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."};
+        return result;
+    }
+    if (description.layout.dataOffset > image.size()) {
+        result.status = {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        return result;
+    }
+    STEG_PHASE(PIXEL_IO);
+    unsigned char* text = reinterpret_cast<unsigned char*>(image.data()) + description.layout.dataOffset;
+    const size_t textSize = image.size() - description.layout.dataOffset;
+    // The image is left alone unless the whole frame fits
+    size_t consumed, touchedBytes;
+    size_t carriers = 0, fixedSamples = 0;
+    if (result.status = countAsciiCarriers(text, textSize, true, description.maxChannelValue, frame.size() * 8, carriers, fixedSamples, consumed);
+        !result.status) {
+        return result;
+    }
+    if (carriers < frame.size() * 8) {
+        result.status = carriers + fixedSamples < description.layout.channelCount()
+            ? stegStatus(stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares.")
+            : stegStatus(stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image.");
+        return result;
+    }
+    result.status = embedPayloadInAsciiSamples(text, textSize, true, description.maxChannelValue, frame,
+                                               result.bitsEmbedded, consumed, touchedBytes, result.bytesWritten);
+    STEG_COUNT(CHANNEL_BYTES, result.bytesWritten);
+    return result;
+}
+extractResult extractFromImage(const std::span<const std::byte> image, const stegOptions& options) {
+    imageDescription description;
+    extractResult result;
+    if (result.status = describeImage(image, description); !result.status) {
+        return result;
+    }
+    if (description.format != imageFormat::P3) {
+        return extract(image, description.layout, options);
+    }
+    if (!options.key.empty()) {
+        result.status = {stegError::UNSUPPORTED_FORMAT, "P3 images can't be used with a key."};
+        return result;
+    }
+    if (description.layout.dataOffset > image.size()) {
+        result.status = {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+        return result;
+    }
+    STEG_PHASE(PIXEL_IO);
+    frameDecoder decoder(description.capacityBytes());
+    size_t consumed;
+    bool finished;
+    result.status = extractFrameFromAsciiSamples(reinterpret_cast<const unsigned char*>(image.data()) + description.layout.dataOffset,
+                                                 image.size() - description.layout.dataOffset, true, description.maxChannelValue,
+                                                 decoder, consumed, finished);
+    std::string payload;
+    if (result.status) {
+        result.status = decoder.finish(payload);
+    }
+    result.payload = payloadBytes(payload);
+    return result;
+}
+
+// Opens and parses the file with the object for its format, then hands it to run
+template <typename action>
+static stegStatus withImageFile(const std::string& filePath, action&& run) {
+    switch (detectFileType(filePath)) {
+        case FileType::BMP: {
+            bmpObject image(filePath);
+            if (stegStatus status = image.isHeaderCorrect(); !status) {
+                return status;
+            }
+            return run(image);
+        }
+        case FileType::PPM: {
+            ppmObject image(filePath);
+            if (stegStatus status = image.isHeaderCorrect(); !status) {
+                return status;
+            }
+            return run(image);
+        }
+        default:
+            return {stegError::UNSUPPORTED_FORMAT, "Unsupported file format."};
+    }
+}
+
+stegStatus describeImageFile(const std::string& filePath, imageDescription& description) {
+    return withImageFile(filePath, [&](auto& image) {
+        description = image.describe();
+        return stegStatus();
+    });
+}
+embedResult embedInImageFile(const std::string& filePath, const std::span<const std::byte> payload, const stegOptions& options) {
+    embedResult result;
+    result.status = withImageFile(filePath, [&](auto& image) {
+        const imageDescription description = image.describe();
+        if (stegStatus status = checkOptions(options, description); !status) {
+            return status;
+        }
+        // Raw payloads can be turned down before anything is copied
+        if (options.codec == payloadCodec::RAW && payload.size() > description.capacityBytes(options.bitsPerChannel)) {
+            return stegStatus(stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image.");
+        }
+        const std::string frame = buildFrame(payloadText(payload), options.bitsPerChannel, options.codec);
+        if (frame.size() - frameHeaderSize > description.capacityBytes(options.bitsPerChannel)) {
+            return stegStatus(stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image.");
+        }
+        stegStatus status = image.embedFrame(frame, options.bitsPerChannel, options.key, options.deltaWrite, result.bytesWritten);
+        if (status) {
+            result.bitsEmbedded = frame.size() * 8;
+            STEG_COUNT(CHANNEL_BYTES, result.bytesWritten);
+        }
+        return status;
+    });
+    return result;
+}
+embedResult embedInImageFileAtomic(const std::string& inputPath, const std::string& outputPath,
+                                   const std::span<const std::byte> payload, const stegOptions& options) {
+    atomicFile output;
+    embedResult result;
+    if (result.status = output.createCopy(inputPath, outputPath); !result.status) {
+        return result;
+    }
+    result = embedInImageFile(output.path(), payload, options);
+    if (result.status) result.status = output.sync();
+    if (result.status) result.status = output.commit();
+    if (result.status) result.status = syncDirectory(parentDirectory(outputPath));
+    return result;
+}
+extractResult extractFromImageFile(const std::string& filePath, const stegOptions& options) {
+    extractResult result;
+    result.status = withImageFile(filePath, [&](auto& image) {
+        std::string message;
+        stegStatus status = image.decryption(message, options.key);
+        result.payload = payloadBytes(message);
+        return status;
+    });
+    return result;
+}
+size_t embeddedPayloadBytes(const std::span<const std::byte> payload, const stegOptions& options) {
+    return storedPayloadSize(payloadText(payload), options.codec);
+}
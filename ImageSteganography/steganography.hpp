@@ -0,0 +1,142 @@
+#ifndef STEGANOGRAPHY_HPP
+#define STEGANOGRAPHY_HPP
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+#include "lsbKernels.hpp"
+#include "payloadFrame.hpp"
+#include "pixelAccess.hpp"
+#include "stegStatus.hpp"
+
+// Public interface of the steg library. Works on image files or on images already held in
+// memory, reports structured results and never writes to the console.
+//
+// Payloads are arbitrary bytes, hidden as a frame with a length and a CRC-32C (payloadFrame.hpp).
+// Extraction finds the bits per channel setting in the frame header on its own, and only takes
+// the key from its options.
+
+// P5 (PGM) and P7 (PAM) are handled like P6, with their own channel counts and sample sizes
+enum class imageFormat { BMP, P3, P6, P5, P7 };
+
+struct stegOptions {
+    // Low bits of every channel that carry the payload, 1 to maxBitsPerChannel.
+    // More bits multiply the capacity but make the changes easier to see and detect.
+    unsigned bitsPerChannel = 1;
+    // LZ compresses the payload before it is embedded, so it takes fewer channels. Payloads that
+    // don't get smaller are stored raw; extraction undoes whatever was used.
+    payloadCodec codec = payloadCodec::RAW;
+    // Image files only: compare the new channels with the ones in the file and write back just the
+    // bytes that change, merged into a few large writes. Pays off when the image already holds a
+    // payload that mostly matches the new one, e.g. when a token is rotated.
+    bool deltaWrite = false;
+    // Spreads the frame over the whole image in an order only this key reproduces (keyedScatter.hpp),
+    // instead of filling the image from its first row on. Extraction needs the same key.
+    // Empty for no scattering; not available for P3 images.
+    std::string key;
+};
+
+struct imageDescription {
+    imageFormat format = imageFormat::BMP;
+    int width = 0;
+    int height = 0;               // negative for a top-down BMP, as in its header
+    unsigned bitsPerPixel = 0;
+    unsigned fileSize = 0;        // as declared by a BMP header
+    unsigned headerSize = 0;      // BMP info header
+    unsigned compression = 0;
+    int maxChannelValue = 0;      // Netpbm, samples take 2 bytes above 255
+    pixelLayout layout;           // for P3 only dataOffset and the channel count apply
+    // P3 samples equal to an even max value, which carry nothing. Only counted when the image is
+    // opened as a file, as it takes reading the body; from header bytes alone it is 0.
+    size_t fixedSamples = 0;
+    unsigned paletteColors = 0;   // 8-bit BMP palette entries
+
+    // Highest bits per channel setting the image takes: P3 images carry one bit per sample, and
+    // 8-bit BMPs one per palette index, as changing higher bits picks an unrelated palette color.
+    // The index bit only goes unseen once the palette is paired (paletteOrder.hpp), which takes an
+    // even number of entries; with an odd one an 8-bit BMP carries nothing.
+    // Binary Netpbm samples carry as many bits as the max value has low bits set, so no sample
+    // ever ends up above it; with an even max value (not 2^n-1) they carry nothing.
+    unsigned bitsPerChannelLimit() const {
+        if (format == imageFormat::P3) {
+            return 1;
+        }
+        if (format == imageFormat::BMP && bitsPerPixel == 8) {
+            return paletteColors % 2 == 0 ? 1 : 0;
+        }
+        if (format == imageFormat::BMP) {
+            return maxBitsPerChannel;
+        }
+        return std::min<unsigned>(maxBitsPerChannel, std::countr_one(static_cast<unsigned>(maxChannelValue)));
+    }
+    // Payload bits that fit, the frame header already accounted for: a payload of n bytes fits
+    // exactly when n * 8 <= capacityBits. Row padding carries nothing and isn't counted.
+    // Settings above bitsPerChannelLimit have no capacity.
+    size_t capacityBits(const unsigned bitsPerChannel = 1) const {
+        if (bitsPerChannel > bitsPerChannelLimit()) {
+            return 0;
+        }
+        const size_t channels = layout.channelCount();
+        const size_t bits = (channels - std::min(fixedSamples, channels)) * bitsPerChannel;
+        return bits > frameHeaderSize * 8 ? bits - frameHeaderSize * 8 : 0;
+    }
+    // Longest payload that fits
+    size_t capacityBytes(const unsigned bitsPerChannel = 1) const { return capacityBits(bitsPerChannel) / 8; }
+};
+
+struct embedResult {
+    stegStatus status;
+    size_t bitsEmbedded = 0;   // frame header included
+    size_t bytesWritten = 0;   // pixel bytes written to the image or file
+};
+struct extractResult {
+    stegStatus status;
+    std::vector<std::byte> payload;
+};
+
+// Pixel rows at layout.dataOffset inside pixels (BMP or binary Netpbm channels). Palette indices
+// are taken as they are; embedInImage pairs the palette of an 8-bit BMP first (paletteOrder.hpp).
+embedResult embed(std::span<std::byte> pixels, const pixelLayout& layout, std::span<const std::byte> payload, const stegOptions& options = {});
+extractResult extract(std::span<const std::byte> pixels, const pixelLayout& layout, const stegOptions& options = {});
+
+// Complete BMP or Netpbm (P3, P5, P6, P7) images held in memory, header included. describeImage
+// only reads the header, so the capacity of a P3 image with an even max value is an upper bound.
+stegStatus describeImage(std::span<const std::byte> image, imageDescription& description);
+embedResult embedInImage(std::span<std::byte> image, std::span<const std::byte> payload, const stegOptions& options = {});
+// Fails for a bitsPerChannel setting above description.bitsPerChannelLimit(), telling why
+stegStatus checkBitsPerChannelLimit(const imageDescription& description, unsigned bitsPerChannel);
+extractResult extractFromImage(std::span<const std::byte> image, const stegOptions& options = {});
+
+// Payload bits (see imageDescription::capacityBits) of many images at once, from their headers
+// alone: each span only has to hold the start of its image up to the pixel data. Headers that
+// don't parse get 0, as do bitsPerChannel settings out of range; P3 images with an even max value
+// get an upper bound (see describeImage). capacityBits holds at least
+// headers.size() entries. Nothing is allocated unless a header is invalid.
+void queryCapacity(std::span<const std::span<const std::byte>> headers, unsigned bitsPerChannel, std::span<size_t> capacityBits);
+
+// Image files, the format follows from the extension. Embedding edits the file in place.
+stegStatus describeImageFile(const std::string& filePath, imageDescription& description);
+embedResult embedInImageFile(const std::string& filePath, std::span<const std::byte> payload, const stegOptions& options = {});
+extractResult extractFromImageFile(const std::string& filePath, const stegOptions& options = {});
+// Embeds into a copy of inputPath that replaces outputPath in one rename once it is complete and
+// flushed to disk, so outputPath holds either the old image or the new one, even after a crash.
+// outputPath may be inputPath. The copy shares its untouched blocks with the input where the file
+// system allows it (atomicFile.hpp), so only the pixels carrying the payload are written.
+embedResult embedInImageFileAtomic(const std::string& inputPath, const std::string& outputPath,
+                                   std::span<const std::byte> payload, const stegOptions& options = {});
+
+// Capacity bytes the payload takes when embedded with options, i.e. after compression;
+// compare with imageDescription::capacityBytes
+size_t embeddedPayloadBytes(std::span<const std::byte> payload, const stegOptions& options = {});
+
+// Text messages as payloads and back
+inline std::span<const std::byte> asBytes(const std::string& text) {
+    return std::as_bytes(std::span<const char>(text.data(), text.size()));
+}
+inline std::string asText(const std::vector<std::byte>& payload) {
+    return {reinterpret_cast<const char*>(payload.data()), payload.size()};
+}
+
+#endif //STEGANOGRAPHY_HPP
@@ -0,0 +1,214 @@
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <optional>
+#include "streamPipeline.hpp"
+#include "steganography.hpp"
+#include "payloadFrame.hpp"
+#include "keyedScatter.hpp"
+#include "bmpProcessor.hpp"
+#include "paletteOrder.hpp"
+#include "stegStats.hpp"
+
+// Large enough for every BMP header and for Netpbm headers with a fair amount of comments
+static constexpr size_t headerProbeSize = 64 * 1024;
+// Upper bound for the pixel rows held in memory at once
+static constexpr size_t streamBlockSize = 4 * 1024 * 1024;
+
+// Serves the bytes read while probing the header before the rest of the stream
+struct bufferedInput {
+    std::istream& input;
+    std::vector<unsigned char> head;
+    size_t headPos = 0;
+
+    explicit bufferedInput(std::istream& input) : input(input) {}
+    size_t read(unsigned char* buffer, const size_t size) {
+        size_t copied = std::min(size, head.size() - headPos);
+        std::memcpy(buffer, head.data() + headPos, copied);
+        headPos += copied;
+        if (copied < size) {
+            input.read(reinterpret_cast<char*>(buffer + copied), static_cast<std::streamsize>(size - copied));
+            STEG_COUNT(SYSCALLS, 1);
+            STEG_COUNT(BYTES_READ, input.gcount());
+            copied += static_cast<size_t>(input.gcount());
+        }
+        return copied;
+    }
+};
+
+static stegStatus probeHeader(bufferedInput& source, imageDescription& description) {
+    STEG_PHASE(HEADER_PARSE);
+    source.head.resize(headerProbeSize);
+    source.input.read(reinterpret_cast<char*>(source.head.data()), static_cast<std::streamsize>(source.head.size()));
+    STEG_COUNT(SYSCALLS, 1);
+    STEG_COUNT(BYTES_READ, source.input.gcount());
+    source.head.resize(static_cast<size_t>(source.input.gcount()));
+
+    if (stegStatus status = describeImage(std::as_bytes(std::span(source.head)), description); !status) {
+        return status;
+    }
+    if (description.format == imageFormat::P3) {
+        return {stegError::UNSUPPORTED_FORMAT, "Only BMP and binary Netpbm (P5, P6, P7) images can be streamed."};
+    }
+    if (description.format != imageFormat::BMP && description.layout.dataOffset > source.head.size()) {
+        return {stegError::UNSUPPORTED_FORMAT, "Netpbm header is too large to be streamed."};
+    }
+    return {};
+}
+
+// Passes count bytes (or everything up to the end of input) through unchanged
+static stegStatus copyBytes(bufferedInput& source, std::ostream* output, const size_t count, std::vector<unsigned char>& buffer) {
+    buffer.resize(std::min(count, streamBlockSize));
+    size_t left = count;
+    while (left > 0) {
+        const size_t got = source.read(buffer.data(), std::min(left, buffer.size()));
+        if (output != nullptr) {
+            STEG_COUNT(SYSCALLS, 1);
+            STEG_COUNT(BYTES_WRITTEN, got);
+            if (!output->write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(got))) {
+                return {stegError::WRITE_FAILED, "Output can't be written."};
+            }
+        }
+        if (got < std::min(left, buffer.size())) {
+            if (count == SIZE_MAX) break;
+            return {stegError::TRUNCATED_PIXEL_DATA, "Input ends before the pixel data."};
+        }
+        left -= got;
+    }
+    return {};
+}
+
+static stegStatus checkBitsPerChannel(const stegOptions& options) {
+    if (options.bitsPerChannel < 1 || options.bitsPerChannel > maxBitsPerChannel) {
+        return {stegError::INVALID_OPTION, "Bits per channel must be between 1 and " + std::to_string(maxBitsPerChannel) + "."};
+    }
+    return {};
+}
+
+stegStatus encryptStream(std::istream& input, std::ostream& output, const std::string& message, const stegOptions& options) {
+    if (stegStatus status = checkBitsPerChannel(options); !status) {
+        return status;
+    }
+    bufferedInput source(input);
+    imageDescription description;
+    if (stegStatus status = probeHeader(source, description); !status) {
+        return status;
+    }
+    if (stegStatus status = checkBitsPerChannelLimit(description, options.bitsPerChannel); !status) {
+        return status;
+    }
+    const pixelLayout& layout = description.layout;
+    const std::string payload = buildFrame(message, options.bitsPerChannel, options.codec);
+    if (payload.size() * 8 > layout.channelCount() * options.bitsPerChannel) {
+        return {stegError::MESSAGE_TOO_LONG, "Message is too long to be hidden in this image."};
+    }
+    // An 8-bit palette is paired (paletteOrder.hpp) while it is still in the probed header, and then
+    // every pixel index is rewritten to match, not only the ones that carry the frame
+    std::optional<paletteOrder> order;
+    if (description.format == imageFormat::BMP && description.bitsPerPixel == 8) {
+        const size_t paletteOffset = bmpObject::fileHeaderSize + description.headerSize;
+        if (paletteOffset + 4 * description.paletteColors > source.head.size()) {
+            return {stegError::UNSUPPORTED_FORMAT, "BMP header is too large to be streamed."};
+        }
+        unsigned char* palette = source.head.data() + paletteOffset;
+        if (const paletteOrder paired = pairPalette(palette, description.paletteColors); paired.changes) {
+            reorderPalette(palette, description.paletteColors, paired);
+            order = paired;
+        }
+    }
+
+    std::vector<unsigned char> block;
+    // Header and anything else stored before the pixel rows
+    if (stegStatus status = copyBytes(source, &output, layout.dataOffset, block); !status) {
+        return status;
+    }
+    // A scattered frame ends in the row of its last position rather than when the bits run out
+    std::optional<scatterPlan> plan;
+    size_t rowsNeeded = layout.rows;
+    if (!options.key.empty()) {
+        const size_t frameChannels = (payload.size() * 8 + options.bitsPerChannel - 1) / options.bitsPerChannel;
+        plan.emplace(scatterPermutation(options.key, layout.channelCount()), frameChannels);
+        if (!plan->visitsAll) {
+            rowsNeeded = static_cast<size_t>(plan->positions.back() / layout.rowChannels()) + 1;
+        }
+    }
+    if (order) {
+        rowsNeeded = layout.rows;
+    }
+    const size_t rowsPerBlock = std::max<size_t>(1, streamBlockSize / layout.rowStride);
+    size_t bitIndex = 0;
+    {
+        STEG_PHASE(PIXEL_IO);
+        for (size_t blockRow = 0; blockRow < rowsNeeded && (plan || order || bitIndex < payload.size() * 8); blockRow += rowsPerBlock) {
+            pixelLayout blockLayout = layout;
+            blockLayout.rows = std::min(rowsPerBlock, layout.rows - blockRow);
+            // Whole strides are read; only the image's very last row may lack its padding
+            block.resize(blockLayout.rows * layout.rowStride);
+            const size_t got = source.read(block.data(), block.size());
+            if (got < blockLayout.regionSize()) {
+                return {stegError::READ_FAILED, "Pixel data can't be read at row " + std::to_string(blockRow) + "."};
+            }
+            const pixelView view = layout.view(block.data(), blockLayout.rows);
+            if (order) {
+                remapIndices(view, *order);
+            }
+            [[maybe_unused]] const size_t storedBytes = plan ? embedScatteredRows(view, blockRow, payload, options.bitsPerChannel, *plan, false)
+                                                             : embedPayloadInView(view, payload, bitIndex, options.bitsPerChannel);
+            STEG_COUNT(CHANNEL_BYTES, storedBytes);
+            STEG_COUNT(SYSCALLS, 1);
+            STEG_COUNT(BYTES_WRITTEN, got);
+            if (!output.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(got))) {
+                return {stegError::WRITE_FAILED, "Output can't be written."};
+            }
+        }
+        // Remaining rows and any trailing bytes pass through unchanged
+        if (stegStatus status = copyBytes(source, &output, SIZE_MAX, block); !status) {
+            return status;
+        }
+    }
+    STEG_PHASE(FINAL_WRITE);
+    if (!output.flush()) {
+        return {stegError::WRITE_FAILED, "Output can't be written."};
+    }
+    return {};
+}
+stegStatus decryptStream(std::istream& input, std::string& message, const stegOptions& options) {
+    bufferedInput source(input);
+    imageDescription description;
+    if (stegStatus status = probeHeader(source, description); !status) {
+        return status;
+    }
+    const pixelLayout& layout = description.layout;
+    STEG_PHASE(PIXEL_IO);
+    std::vector<unsigned char> block;
+    if (stegStatus status = copyBytes(source, nullptr, layout.dataOffset, block); !status) {
+        return status;
+    }
+    if (!options.key.empty()) {
+        // The rows holding the header of a scattered frame aren't known to come before the
+        // others, so all of them are held in memory. The buffer grows with the data that
+        // arrives, so a header declaring more than the stream holds doesn't allocate it.
+        const size_t regionSize = layout.regionSize();
+        std::vector<unsigned char> pixels;
+        while (pixels.size() < regionSize) {
+            const size_t filled = pixels.size();
+            const size_t wanted = std::min(regionSize, filled + streamBlockSize);
+            if (wanted > pixels.capacity()) {
+                pixels.reserve(std::min(regionSize, std::max(wanted, pixels.capacity() * 2)));
+            }
+            pixels.resize(wanted);
+            if (source.read(pixels.data() + filled, wanted - filled) < wanted - filled) {
+                return {stegError::TRUNCATED_PIXEL_DATA, "Pixel data is shorter than the header declares."};
+            }
+        }
+        return extractScatteredFrameFromView(layout.view(pixels.data(), layout.rows), options.key, message);
+    }
+    // Stops reading right after the last row of the frame
+    return extractFrameFromRows(layout, [&](unsigned char* buffer, const size_t size) {
+        return source.read(buffer, size);
+    }, streamBlockSize, message);
+}
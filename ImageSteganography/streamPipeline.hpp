@@ -0,0 +1,17 @@
+#ifndef STREAMPIPELINE_HPP
+#define STREAMPIPELINE_HPP
+#include <iosfwd>
+#include <string>
+#include "steganography.hpp"
+
+// Forward-only processing of a BMP or binary Netpbm (P5, P6, P7) image arriving on a stream (e.g. a pipe).
+// The header is parsed from the first bytes and the pixel rows pass through a bounded
+// buffer, so memory use doesn't depend on the image size. The one exception is extracting
+// with a key, which needs all pixel rows in memory since the frame may start in any of them.
+
+// Copies the image from input to output with the message hidden in the pixel LSBs
+stegStatus encryptStream(std::istream& input, std::ostream& output, const std::string& message, const stegOptions& options = {});
+// Stops reading input after the last row that holds the hidden frame
+stegStatus decryptStream(std::istream& input, std::string& message, const stegOptions& options = {});
+
+#endif //STREAMPIPELINE_HPP
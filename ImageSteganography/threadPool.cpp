@@ -0,0 +1,126 @@
+#include <algorithm>
+#include "threadPool.hpp"
+
+threadPool::threadPool(const unsigned threadCount) {
+    queuedTasks = 0;
+    nextQueue = 0;
+    stopping = false;
+    const unsigned workerCount = threadCount > 1 ? threadCount - 1 : 0;
+    for (unsigned i = 0; i < workerCount; ++i) {
+        queues.push_back(std::make_unique<workerQueue>());
+    }
+    // Every queue exists before the first worker starts stealing from it
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&threadPool::workerLoop, this, i);
+    }
+}
+threadPool::~threadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+bool threadPool::popTask(const size_t queueIndex, std::function<void()>& task) {
+    {
+        workerQueue& own = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queuedTasks;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        workerQueue& victim = *queues[(queueIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
+}
+void threadPool::workerLoop(const size_t queueIndex) {
+    std::function<void()> task;
+    while (true) {
+        if (popTask(queueIndex, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeUp.wait(lock, [this] { return stopping || queuedTasks > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+// One parallelFor call. Its tasks are claimed by index from next, by the caller and by runners
+// queued to the workers; a runner dequeued after the call returned finds nothing left to claim,
+// which is why the runners share this instead of pointing into the caller's stack.
+struct parallelCall {
+    std::atomic<size_t> next{0};
+    size_t taskCount = 0;
+    const std::function<void(size_t)>* task = nullptr;
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t finished = 0;
+
+    void runClaimed() {
+        size_t ran = 0;
+        for (size_t i; (i = next.fetch_add(1)) < taskCount; ++ran) {
+            (*task)(i);
+        }
+        if (ran > 0) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            finished += ran;
+            if (finished == taskCount) {
+                done.notify_all();
+            }
+        }
+    }
+};
+
+void threadPool::parallelFor(const size_t taskCount, const std::function<void(size_t)>& task) {
+    if (workers.empty() || taskCount < 2) {
+        for (size_t i = 0; i < taskCount; ++i) task(i);
+        return;
+    }
+    const auto call = std::make_shared<parallelCall>();
+    call->taskCount = taskCount;
+    call->task = &task;
+    const size_t runners = std::min(taskCount - 1, workers.size());
+    for (size_t i = 0; i < runners; ++i) {
+        workerQueue& queue = *queues[nextQueue++ % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.emplace_back([call] { call->runClaimed(); });
+        ++queuedTasks;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wakeUp.notify_all();
+
+    // The caller only ever runs tasks of this call. Running any queued task instead could start
+    // a task of an outer call that waits for something this thread holds, e.g. a batch item
+    // waiting for an open file slot, and never return.
+    call->runClaimed();
+    std::unique_lock<std::mutex> lock(call->doneMutex);
+    call->done.wait(lock, [&] { return call->finished == taskCount; });
+}
+
+static unsigned configuredThreads = 0;
+
+void setThreadCount(const unsigned threadCount) {
+    configuredThreads = threadCount;
+}
+threadPool& globalThreadPool() {
+    static threadPool pool(configuredThreads > 0 ? configuredThreads : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
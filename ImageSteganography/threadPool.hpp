@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker pops from the back of its own queue and steals from
+// the front of the others' when it runs dry. The thread calling parallelFor helps with the
+// tasks of that call (and only those), so a pool of N threads owns N - 1 workers and nested
+// parallelFor calls can't deadlock, even when the outer tasks wait on a semaphore.
+struct threadPool {
+private:
+    struct workerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<workerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wakeUp;
+    std::atomic<size_t> queuedTasks;
+    std::atomic<size_t> nextQueue;
+    bool stopping;
+
+    bool popTask(size_t queueIndex, std::function<void()>& task);
+    void workerLoop(size_t queueIndex);
+public:
+    explicit threadPool(unsigned threadCount);
+    ~threadPool();
+    threadPool(const threadPool&) = delete;
+    threadPool& operator=(const threadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+    // Runs task(0) ... task(taskCount - 1) and returns once all of them have finished
+    void parallelFor(size_t taskCount, const std::function<void(size_t)>& task);
+};
+
+// Thread count used by embed/extract, defaults to std::thread::hardware_concurrency()
+void setThreadCount(unsigned threadCount);
+threadPool& globalThreadPool();
+
+#endif //THREADPOOL_HPP